@@ -0,0 +1,133 @@
+#include "hashtable.h"
+#include <errno.h>
+#include <locale.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// insert and lookup cost of a hash_table fed keys chosen to collide, against
+// ordinary keys. The colliding keys are 15 bytes whose first 8 equal one of
+// wyhash's secrets, which zeroes its final multiply, so they share one hash
+// under every seed: unprotected or seeded, they form a single chain and each
+// insert walks all of it. With ht_set_max_chain the table moves to SipHash
+// once a chain gets too long, and costs stay flat. Little endian only
+
+#define MAX_CHAIN 32
+
+// more colliding keys than this are only run with max_chain
+#define QUADRATIC_MAX 100000
+
+typedef struct timespec timespec;
+
+static double timediff(timespec start, timespec end) {
+  timespec e;
+  if ((end.tv_nsec - start.tv_nsec) < 0) {
+    e.tv_sec  = end.tv_sec - start.tv_sec - 1;
+    e.tv_nsec = 1000000000 + end.tv_nsec - start.tv_nsec;
+  } else {
+    e.tv_sec  = end.tv_sec - start.tv_sec;
+    e.tv_nsec = end.tv_nsec - start.tv_nsec;
+  }
+  return e.tv_sec + e.tv_nsec / 1000000000.0;
+}
+
+bool parseul(const char* str, size_t* val) {
+  char* end; // NOLINT
+  errno = 0;
+  *val  = strtoul(str, &end, 0);
+  if (end == str || *end != '\0' || errno == ERANGE) return false;
+  return true;
+}
+
+typedef enum { UNPROTECTED, SEEDED, MAX_CHAINED } protection;
+
+static const char* protection_names[] = {"unprotected", "seeded",
+                                         "max_chain"};
+
+// keys are distinct by a suffix of 7 hex digits
+#define MAX_KEYS 0x10000000
+
+// count keys of 15 bytes, colliding or ordinary, count <= MAX_KEYS
+static char** make_keys(size_t count, bool colliding) {
+  static const unsigned char secret[8] = {0x93, 0x4b, 0xb8, 0x8b,
+                                          0xc9, 0xac, 0x2e, 0x96};
+  char** keys = malloc(count * sizeof(char*));
+  if (!keys) {
+    perror("malloc keys");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t k = 0; k < count; ++k) {
+    keys[k] = malloc(16);
+    if (!keys[k]) {
+      perror("malloc key");
+      exit(EXIT_FAILURE);
+    }
+    if (colliding)
+      memcpy(keys[k], secret, 8);
+    else
+      memcpy(keys[k], "ordinary", 8);
+    snprintf(keys[k] + 8, 8, "%07x", (unsigned)(k & (MAX_KEYS - 1)));
+  }
+  return keys;
+}
+
+static void run(char** keys, size_t count, protection prot, bool colliding) {
+  hash_table* ht = ht_create(4);
+  if (prot != UNPROTECTED) ht_set_seed(ht, ht_random_seed());
+  if (prot == MAX_CHAINED) ht_set_max_chain(ht, MAX_CHAIN);
+
+  timespec start, inserted, stop;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t k = 0; k < count; ++k) ht_insert(ht, keys[k], 1);
+  clock_gettime(CLOCK_MONOTONIC, &inserted);
+  size_t found = 0;
+  for (size_t k = 0; k < count; ++k) found += ht_get(ht, keys[k]) != NULL;
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+  if (found != count) {
+    fprintf(stderr, "found %zu of %zu keys\n", found, count);
+    exit(EXIT_FAILURE);
+  }
+
+  hash_table_stats stats;
+  ht_stats(ht, &stats);
+  printf("%-10s %-13s %14.1f %14.1f %10zu %8s\n",
+         colliding ? "colliding" : "ordinary", protection_names[prot],
+         timediff(start, inserted) * 1e9 / count,
+         timediff(inserted, stop) * 1e9 / count, stats.max_chain,
+         ht->sip ? "yes" : "no");
+  ht_free(ht);
+}
+
+int main(int argc, char** argv) {
+  char usage[60];
+  snprintf(usage, 60, "Usage: %s [count]\n", argv[0]);
+  size_t count = 20000; // unprotected, colliding inserts are quadratic
+  if (argc > 1 &&
+      (!parseul(argv[1], &count) || count == 0 || count > MAX_KEYS)) {
+    fputs(usage, stderr);
+    exit(EXIT_FAILURE);
+  }
+  setlocale(LC_NUMERIC, ""); // for thousands separator
+
+  printf("\n%s\n------------------------------------------------------------"
+         "----------\n",
+         "hash_table under colliding keys");
+  printf("%'zu keys of 15 bytes, max_chain %d\n\n", count, MAX_CHAIN);
+  printf("%-10s %-13s %14s %14s %10s %8s\n", "keys", "table",
+         "insert ns/op", "lookup ns/op", "max chain", "siphash");
+  for (int colliding = 0; colliding < 2; ++colliding) {
+    char** keys = make_keys(count, colliding);
+    for (protection prot = UNPROTECTED; prot <= MAX_CHAINED; ++prot) {
+      if (colliding && prot != MAX_CHAINED && count > QUADRATIC_MAX)
+        printf("%-10s %-13s %14s\n", "colliding", protection_names[prot],
+               "skipped");
+      else
+        run(keys, count, prot, colliding);
+    }
+    for (size_t k = 0; k < count; ++k) free(keys[k]);
+    free(keys);
+  }
+}
@@ -0,0 +1,634 @@
+#include "hashtable.h"
+#include "hashtable_alloc.h"
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// hash_table benchmark suite. Every combination of table size, key length
+// range, key distribution and workload is run twice on identically prepared
+// tables: once untimed per op for ns/op, and once timing every op into a
+// latency histogram for the percentiles. Per op latencies therefore include
+// the cost of reading the clock, ~20ns, and as the clock reads serialise ops
+// they miss out on the overlapping of cache misses which ns/op benefits from.
+//
+// Keys are derived from their id and the seed only, so a given seed replays
+// exactly the same keys and op stream on every run. Bytes per entry and
+// rehashes come from ht_stats, so need HT_STATS for the latter.
+//
+// Workloads, over a table of n keys with ids [0, n):
+//   insert       n distinct keys into an empty table, in distribution order
+//   lookup-hit   ht_get_n of present keys drawn from the distribution
+//   lookup-miss  ht_get_n of absent keys, ids [n, 2n) drawn the same way
+//   delete       all n keys, in distribution order
+//   mixed        80% ht_get_n, 10% ht_inc_n, 10% ht_delete_n of drawn keys
+//
+// For insert and delete, which touch every key once, zipf order is the
+// uniform (shuffled) order.
+
+typedef struct timespec timespec;
+
+static inline uint64_t now_ns(void) {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+bool parseul(const char* str, size_t* val) {
+  char* end; // NOLINT
+  errno = 0;
+  *val  = strtoul(str, &end, 0);
+  if (end == str || *end != '\0' || errno == ERANGE) return false;
+  return true;
+}
+
+// splitmix64, small and fast, and unlike rand() the same on every platform
+static inline uint64_t next_rand(uint64_t* state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15);
+  z          = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z          = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+static inline double next_unit(uint64_t* state) {
+  return (double)(next_rand(state) >> 11) / (double)(1ULL << 53);
+}
+
+static void* xmalloc(size_t size, const char* what) {
+  void* mem = malloc(size ? size : 1);
+  if (!mem) {
+    perror(what);
+    exit(EXIT_FAILURE);
+  }
+  return mem;
+}
+
+// ---------------------------------------------------------------------------
+// keys
+
+typedef struct key_range key_range;
+struct key_range {
+  const char* name;
+  size_t      min;
+  size_t      max;
+};
+
+static const key_range key_ranges[] = {
+    {"short", 4, 8}, {"medium", 16, 24}, {"long", 48, 64}};
+#define KEY_RANGE_COUNT (sizeof key_ranges / sizeof key_ranges[0])
+
+typedef struct bench_keys bench_keys;
+struct bench_keys {
+  char**  keys; // by id
+  size_t* lens;
+  char*   bytes; // all keys, back to back
+  size_t  count;
+};
+
+// key id is its id in base 62, a '_' and random lower case padding up to a
+// random length in range. The '_' keeps ids apart so all keys are distinct
+static void keys_create(bench_keys* k, size_t count, const key_range* range,
+                        uint64_t seed) {
+  static const char digits[] =
+      "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+  uint64_t state = seed;
+  k->count       = count;
+  k->keys        = xmalloc(count * sizeof *k->keys, "malloc keys");
+  k->lens        = xmalloc(count * sizeof *k->lens, "malloc key lengths");
+
+  size_t total = 0;
+  for (size_t id = 0; id < count; id++) {
+    size_t len = range->min + next_rand(&state) % (range->max - range->min + 1);
+    size_t idlen = 1;
+    for (size_t rest = id / 62; rest; rest /= 62) idlen++;
+    if (len < idlen + 1) len = idlen + 1;
+    k->lens[id] = len;
+    total += len + 1;
+  }
+  k->bytes = xmalloc(total, "malloc key bytes");
+
+  char* p = k->bytes;
+  for (size_t id = 0; id < count; id++) {
+    k->keys[id] = p;
+    size_t pos  = 0;
+    size_t rest = id;
+    do {
+      p[pos++] = digits[rest % 62];
+      rest /= 62;
+    } while (rest);
+    p[pos++] = '_';
+    while (pos < k->lens[id]) p[pos++] = (char)('a' + next_rand(&state) % 26);
+    p[pos] = '\0';
+    p += pos + 1;
+  }
+}
+
+static void keys_free(bench_keys* k) {
+  free(k->bytes);
+  free(k->lens);
+  free(k->keys);
+}
+
+// ---------------------------------------------------------------------------
+// distributions, each yields ids in [0, n) to which lookup-miss adds n
+
+typedef enum { DIST_UNIFORM, DIST_ZIPF, DIST_SEQUENTIAL } dist_kind;
+
+static const char* dist_names[] = {"uniform", "zipf", "sequential"};
+#define DIST_COUNT (sizeof dist_names / sizeof dist_names[0])
+
+typedef struct dist dist;
+struct dist {
+  dist_kind kind;
+  size_t    n;
+  uint32_t* perm; // random permutation of [0, n), maps zipf ranks to ids
+  double*   cdf;  // zipf only, cdf[r] = P(rank <= r)
+};
+
+static void dist_create(dist* d, dist_kind kind, size_t n, double zipf_s,
+                        uint64_t seed) {
+  uint64_t state = seed;
+  d->kind        = kind;
+  d->n           = n;
+  d->perm        = xmalloc(n * sizeof *d->perm, "malloc permutation");
+  d->cdf         = NULL;
+  for (size_t i = 0; i < n; i++) d->perm[i] = (uint32_t)i;
+  for (size_t i = n - 1; i > 0; i--) { // Fisher-Yates
+    size_t   j = next_rand(&state) % (i + 1);
+    uint32_t t = d->perm[i];
+    d->perm[i] = d->perm[j];
+    d->perm[j] = t;
+  }
+  if (kind != DIST_ZIPF) return;
+
+  d->cdf     = xmalloc(n * sizeof *d->cdf, "malloc zipf cdf");
+  double sum = 0;
+  for (size_t r = 0; r < n; r++)
+    d->cdf[r] = sum += pow((double)(r + 1), -zipf_s);
+  for (size_t r = 0; r < n; r++) d->cdf[r] /= sum;
+}
+
+static void dist_free(dist* d) {
+  free(d->cdf);
+  free(d->perm);
+}
+
+// the id of the i'th op
+static inline uint32_t dist_draw(const dist* d, size_t i, uint64_t* state) {
+  switch (d->kind) {
+  case DIST_UNIFORM:
+    return (uint32_t)(next_rand(state) % d->n);
+  case DIST_SEQUENTIAL:
+    return (uint32_t)(i % d->n);
+  case DIST_ZIPF: {
+    double u  = next_unit(state);
+    size_t lo = 0;
+    size_t hi = d->n - 1;
+    while (lo < hi) { // first rank with cdf >= u
+      size_t mid = lo + (hi - lo) / 2;
+      if (d->cdf[mid] < u)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return d->perm[lo];
+  }
+  }
+  return 0;
+}
+
+// the id of the i'th key in an every-key-once pass
+static inline uint32_t dist_order(const dist* d, size_t i) {
+  return d->kind == DIST_SEQUENTIAL ? (uint32_t)i : d->perm[i];
+}
+
+// ---------------------------------------------------------------------------
+// workloads
+
+typedef enum { OP_GET, OP_INSERT, OP_INC, OP_DELETE } op_kind;
+
+typedef enum {
+  WL_INSERT,
+  WL_LOOKUP_HIT,
+  WL_LOOKUP_MISS,
+  WL_DELETE,
+  WL_MIXED
+} workload_kind;
+
+static const char* workload_names[] = {"insert", "lookup-hit", "lookup-miss",
+                                       "delete", "mixed"};
+#define WORKLOAD_COUNT (sizeof workload_names / sizeof workload_names[0])
+
+typedef struct op_stream op_stream;
+struct op_stream {
+  uint32_t* ids;
+  uint8_t*  kinds;
+  size_t    count;
+};
+
+static void ops_create(op_stream* ops, workload_kind wl, const dist* d,
+                       size_t opcount, uint64_t seed) {
+  uint64_t state = seed;
+  size_t   n     = d->n;
+  if (wl == WL_INSERT || wl == WL_DELETE) opcount = n;
+  ops->count = opcount;
+  ops->ids   = xmalloc(opcount * sizeof *ops->ids, "malloc op ids");
+  ops->kinds = xmalloc(opcount, "malloc op kinds");
+  for (size_t i = 0; i < opcount; i++) {
+    switch (wl) {
+    case WL_INSERT:
+      ops->ids[i]   = dist_order(d, i);
+      ops->kinds[i] = OP_INSERT;
+      break;
+    case WL_DELETE:
+      ops->ids[i]   = dist_order(d, i);
+      ops->kinds[i] = OP_DELETE;
+      break;
+    case WL_LOOKUP_HIT:
+      ops->ids[i]   = dist_draw(d, i, &state);
+      ops->kinds[i] = OP_GET;
+      break;
+    case WL_LOOKUP_MISS:
+      ops->ids[i]   = (uint32_t)(n + dist_draw(d, i, &state));
+      ops->kinds[i] = OP_GET;
+      break;
+    case WL_MIXED: {
+      ops->ids[i]   = dist_draw(d, i, &state);
+      uint64_t pct  = next_rand(&state) % 100;
+      ops->kinds[i] = pct < 80 ? OP_GET : pct < 90 ? OP_INC : OP_DELETE;
+      break;
+    }
+    }
+  }
+}
+
+static void ops_free(op_stream* ops) {
+  free(ops->kinds);
+  free(ops->ids);
+}
+
+// an empty table for insert, otherwise one holding all n keys, inserted in
+// shuffled order
+static hash_table* table_prepare(workload_kind wl, const bench_keys* k,
+                                 const dist* d) {
+  hash_table* ht = ht_create(4);
+  if (wl == WL_INSERT) return ht;
+  for (size_t i = 0; i < d->n; i++) {
+    uint32_t id = d->perm[i];
+    ht_insert_n(ht, k->keys[id], k->lens[id], 1);
+  }
+  return ht;
+}
+
+// ---------------------------------------------------------------------------
+// latency histogram, log linear: exact below HIST_SUB ns, then HIST_SUB
+// buckets per power of 2, so within ~3%
+
+#define HIST_SUB_BITS 5
+#define HIST_SUB      (1U << HIST_SUB_BITS)
+#define HIST_BUCKETS  ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+static inline size_t hist_bucket(uint64_t ns) {
+  if (ns < HIST_SUB) return ns;
+  unsigned msb   = 63 - __builtin_clzll(ns);
+  unsigned shift = msb - HIST_SUB_BITS;
+  return (msb - HIST_SUB_BITS + 1) * HIST_SUB + (ns >> shift) - HIST_SUB;
+}
+
+// the smallest latency in bucket b
+static uint64_t hist_value(size_t b) {
+  if (b < HIST_SUB) return b;
+  unsigned shift = b / HIST_SUB - 1;
+  return (uint64_t)(b % HIST_SUB + HIST_SUB) << shift;
+}
+
+static uint64_t hist_percentile(const uint64_t* hist, size_t count, double p) {
+  size_t rank = (size_t)(p * (double)count);
+  if (rank >= count) rank = count - 1;
+  size_t seen = 0;
+  for (size_t b = 0; b < HIST_BUCKETS; b++) {
+    seen += hist[b];
+    if (seen > rank) return hist_value(b);
+  }
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+// running
+
+static volatile ht_value_t sink; // keeps lookups from being optimised out
+
+static inline void run_op(hash_table* ht, const bench_keys* k, uint32_t id,
+                          uint8_t kind) {
+  const char* key = k->keys[id];
+  size_t      len = k->lens[id];
+  switch (kind) {
+  case OP_GET: {
+    hash_table_item* item = ht_get_n(ht, key, len);
+    if (item) sink = item->value;
+    break;
+  }
+  case OP_INSERT:
+    ht_insert_n(ht, key, len, 1);
+    break;
+  case OP_INC:
+    ht_inc_n(ht, key, len);
+    break;
+  case OP_DELETE:
+    ht_delete_n(ht, key, len);
+    break;
+  }
+}
+
+// returns elapsed ns
+static uint64_t run_untimed(hash_table* ht, const bench_keys* k,
+                            const op_stream* ops) {
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < ops->count; i++)
+    run_op(ht, k, ops->ids[i], ops->kinds[i]);
+  return now_ns() - start;
+}
+
+static void run_timed(hash_table* ht, const bench_keys* k,
+                      const op_stream* ops, uint64_t* hist) {
+  for (size_t i = 0; i < ops->count; i++) {
+    uint64_t start = now_ns();
+    run_op(ht, k, ops->ids[i], ops->kinds[i]);
+    hist[hist_bucket(now_ns() - start)]++;
+  }
+}
+
+typedef struct result result;
+struct result {
+  size_t      n;
+  const char* keys;
+  const char* dist;
+  const char* workload;
+  size_t      ops;
+  double      ns_per_op;
+  uint64_t    p50;
+  uint64_t    p99;
+  uint64_t    p999;
+  double      bytes_per_entry;
+  size_t      rehashes;
+};
+
+static result run_workload(workload_kind wl, const bench_keys* k, const dist* d,
+                           size_t opcount, uint64_t seed) {
+  op_stream ops;
+  ops_create(&ops, wl, d, opcount, seed);
+
+  hash_table* ht      = table_prepare(wl, k, d);
+  uint64_t    elapsed = run_untimed(ht, k, &ops);
+  ht_free(ht);
+
+  uint64_t* hist = calloc(HIST_BUCKETS, sizeof *hist);
+  if (!hist) {
+    perror("calloc histogram");
+    exit(EXIT_FAILURE);
+  }
+  hash_table_stats before, after;
+  ht = table_prepare(wl, k, d);
+  ht_stats(ht, &before);
+  run_timed(ht, k, &ops, hist);
+  ht_stats(ht, &after);
+  ht_free(ht);
+  // bytes per entry with the table full: after insert, before the others
+  const hash_table_stats* full = wl == WL_INSERT ? &after : &before;
+
+  result r = {.n               = d->n,
+              .dist            = dist_names[d->kind],
+              .workload        = workload_names[wl],
+              .ops             = ops.count,
+              .ns_per_op       = (double)elapsed / (double)ops.count,
+              .p50             = hist_percentile(hist, ops.count, 0.50),
+              .p99             = hist_percentile(hist, ops.count, 0.99),
+              .p999            = hist_percentile(hist, ops.count, 0.999),
+              .bytes_per_entry = full->itemcount
+                                     ? (double)full->total_bytes /
+                                           (double)full->itemcount
+                                     : 0,
+              .rehashes        = after.rehashes - before.rehashes};
+  free(hist);
+  ops_free(&ops);
+  return r;
+}
+
+// ---------------------------------------------------------------------------
+// output
+
+typedef enum { FMT_TABLE, FMT_CSV, FMT_JSON } out_format;
+
+static void print_header(out_format fmt) {
+  switch (fmt) {
+  case FMT_TABLE:
+    printf("%10s %-7s %-10s %-12s %10s %8s %7s %7s %7s %8s %8s\n", "size",
+           "keys", "dist", "workload", "ops", "ns/op", "p50", "p99", "p99.9",
+           "B/entry", "rehashes");
+    break;
+  case FMT_CSV:
+    puts("size,keys,dist,workload,ops,ns_per_op,p50_ns,p99_ns,p999_ns,"
+         "bytes_per_entry,rehashes");
+    break;
+  case FMT_JSON:
+    puts("[");
+    break;
+  }
+}
+
+static void print_result(out_format fmt, const result* r, bool first) {
+  switch (fmt) {
+  case FMT_TABLE:
+    printf("%10zu %-7s %-10s %-12s %10zu %8.1f %7llu %7llu %7llu %8.1f %8zu\n",
+           r->n, r->keys, r->dist, r->workload, r->ops, r->ns_per_op,
+           (unsigned long long)r->p50, (unsigned long long)r->p99,
+           (unsigned long long)r->p999, r->bytes_per_entry, r->rehashes);
+    break;
+  case FMT_CSV:
+    printf("%zu,%s,%s,%s,%zu,%.2f,%llu,%llu,%llu,%.2f,%zu\n", r->n, r->keys,
+           r->dist, r->workload, r->ops, r->ns_per_op,
+           (unsigned long long)r->p50, (unsigned long long)r->p99,
+           (unsigned long long)r->p999, r->bytes_per_entry, r->rehashes);
+    break;
+  case FMT_JSON:
+    printf("%s  {\"size\": %zu, \"keys\": \"%s\", \"dist\": \"%s\", "
+           "\"workload\": \"%s\", \"ops\": %zu, \"ns_per_op\": %.2f, "
+           "\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, "
+           "\"bytes_per_entry\": %.2f, \"rehashes\": %zu}",
+           first ? "" : ",\n", r->n, r->keys, r->dist, r->workload, r->ops,
+           r->ns_per_op, (unsigned long long)r->p50,
+           (unsigned long long)r->p99, (unsigned long long)r->p999,
+           r->bytes_per_entry, r->rehashes);
+    break;
+  }
+  fflush(stdout);
+}
+
+static void print_footer(out_format fmt) {
+  if (fmt == FMT_JSON) puts("\n]");
+}
+
+// ---------------------------------------------------------------------------
+// options
+
+// whether name is in the comma separated list, NULL meaning all
+static bool selected(const char* list, const char* name) {
+  if (!list) return true;
+  size_t len = strlen(name);
+  for (const char* p = list; *p;) {
+    const char* comma = strchr(p, ',');
+    size_t      plen  = comma ? (size_t)(comma - p) : strlen(p);
+    if (plen == len && strncmp(p, name, len) == 0) return true;
+    p += plen + (comma ? 1 : 0);
+  }
+  return false;
+}
+
+// every name in list must be one of names
+static bool valid_list(const char* list, const char** names, size_t count) {
+  if (!list) return true;
+  for (const char* p = list; *p;) {
+    const char* comma = strchr(p, ',');
+    size_t      plen  = comma ? (size_t)(comma - p) : strlen(p);
+    bool        found = false;
+    for (size_t i = 0; i < count; i++)
+      if (strlen(names[i]) == plen && strncmp(p, names[i], plen) == 0)
+        found = true;
+    if (!found) return false;
+    p += plen + (comma ? 1 : 0);
+  }
+  return true;
+}
+
+static bool parse_sizes(char* list, size_t* sizes, size_t* count, size_t max) {
+  *count = 0;
+  for (char* tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+    if (*count == max || !parseul(tok, &sizes[*count]) || sizes[*count] == 0 ||
+        sizes[*count] > UINT32_MAX / 2)
+      return false;
+    (*count)++;
+  }
+  return *count > 0;
+}
+
+int main(int argc, char** argv) {
+  char usage[360];
+  snprintf(usage, sizeof usage,
+           "Usage: %s [-n sizes] [-o ops] [-k short,medium,long]\n"
+           "       [-d uniform,zipf,sequential] "
+           "[-w insert,lookup-hit,lookup-miss,delete,mixed]\n"
+           "       [-z zipf_exponent] [-s seed] [-f table|csv|json]\n"
+           "       [-a malloc|huge|numa_node]\n",
+           argv[0]);
+
+  size_t      sizes[16] = {1000, 100000, 1000000};
+  size_t      sizecount = 3;
+  size_t      opcount   = 1000000;
+  const char* keylist   = NULL;
+  const char* distlist  = NULL;
+  const char* wllist    = NULL;
+  double      zipf_s    = 0.99;
+  size_t      seed      = 1;
+  out_format  fmt       = FMT_TABLE;
+  size_t      node;
+
+  const char* key_names[KEY_RANGE_COUNT];
+  for (size_t i = 0; i < KEY_RANGE_COUNT; i++)
+    key_names[i] = key_ranges[i].name;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:o:k:d:w:z:s:f:a:")) != -1) {
+    bool ok = true;
+    switch (opt) {
+    case 'n':
+      ok = parse_sizes(optarg, sizes, &sizecount, 16);
+      break;
+    case 'o':
+      ok = parseul(optarg, &opcount) && opcount > 0;
+      break;
+    case 'k':
+      keylist = optarg;
+      ok      = valid_list(keylist, key_names, KEY_RANGE_COUNT);
+      break;
+    case 'd':
+      distlist = optarg;
+      ok       = valid_list(distlist, dist_names, DIST_COUNT);
+      break;
+    case 'w':
+      wllist = optarg;
+      ok     = valid_list(wllist, workload_names, WORKLOAD_COUNT);
+      break;
+    case 'z': {
+      char* end; // NOLINT
+      zipf_s = strtod(optarg, &end);
+      ok     = end != optarg && *end == '\0' && zipf_s > 0;
+      break;
+    }
+    case 's':
+      ok = parseul(optarg, &seed);
+      break;
+    case 'f':
+      if (strcmp(optarg, "table") == 0)
+        fmt = FMT_TABLE;
+      else if (strcmp(optarg, "csv") == 0)
+        fmt = FMT_CSV;
+      else if (strcmp(optarg, "json") == 0)
+        fmt = FMT_JSON;
+      else
+        ok = false;
+      break;
+    case 'a': // for every table, see hashtable_alloc.h
+      if (strcmp(optarg, "huge") == 0) {
+        ht_set_default_allocator(&ht_allocator_huge);
+      } else if (parseul(optarg, &node) && node < HT_NUMA_NODES) {
+        ht_allocator numa = ht_allocator_numa((int)node);
+        ht_set_default_allocator(&numa);
+      } else {
+        ok = strcmp(optarg, "malloc") == 0;
+      }
+      break;
+    default:
+      ok = false;
+    }
+    if (!ok) {
+      fputs(usage, stderr);
+      if (opt != '?') fprintf(stderr, "Invalid -%c: \"%s\"\n", opt, optarg);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (optind != argc) {
+    fputs(usage, stderr);
+    exit(EXIT_FAILURE);
+  }
+
+  print_header(fmt);
+  bool first = true;
+  for (size_t s = 0; s < sizecount; s++) {
+    size_t n = sizes[s];
+    for (size_t kr = 0; kr < KEY_RANGE_COUNT; kr++) {
+      if (!selected(keylist, key_ranges[kr].name)) continue;
+      bench_keys k;
+      keys_create(&k, 2 * n, &key_ranges[kr], seed + kr); // misses are [n, 2n)
+      for (size_t dk = 0; dk < DIST_COUNT; dk++) {
+        if (!selected(distlist, dist_names[dk])) continue;
+        dist d;
+        dist_create(&d, (dist_kind)dk, n, zipf_s, seed);
+        for (size_t wl = 0; wl < WORKLOAD_COUNT; wl++) {
+          if (!selected(wllist, workload_names[wl])) continue;
+          result r = run_workload((workload_kind)wl, &k, &d, opcount, seed);
+          r.keys   = key_ranges[kr].name;
+          print_result(fmt, &r, first);
+          first = false;
+        }
+        dist_free(&d);
+      }
+      keys_free(&k);
+    }
+  }
+  print_footer(fmt);
+}
@@ -0,0 +1,88 @@
+#include "hashtable.h"
+#include <errno.h>
+#include <locale.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// per op latency of ht_inc with unique keys, so the table keeps growing.
+// With stop-the-world rehashing the max op time grows with the table, with
+// incremental rehashing it stays bounded
+
+typedef struct timespec timespec;
+
+static inline uint64_t now_ns(void) {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+bool parseul(const char* str, size_t* val) {
+  char* end; // NOLINT
+  errno = 0;
+  *val  = strtoul(str, &end, 0);
+  if (end == str || *end != '\0' || errno == ERANGE) return false;
+  return true;
+}
+
+static int cmp_u32(const void* a, const void* b) {
+  uint32_t a_val = *(const uint32_t*)a;
+  uint32_t b_val = *(const uint32_t*)b;
+  if (a_val == b_val) return 0;
+  return a_val < b_val ? -1 : 1;
+}
+
+static void latency_bench(size_t count, bool incremental) {
+  uint32_t* lat = malloc(count * sizeof *lat);
+  if (!lat) {
+    perror("malloc latencies");
+    exit(EXIT_FAILURE);
+  }
+
+  hash_table* ht = ht_create(4);
+  ht_set_incremental(ht, incremental);
+
+  char     key[32];
+  uint64_t total = 0;
+  for (size_t i = 0; i < count; ++i) {
+    snprintf(key, sizeof key, "key%zu", i);
+    uint64_t start = now_ns();
+    ht_inc(ht, key);
+    uint64_t elapsed = now_ns() - start;
+    lat[i]           = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+    total += elapsed;
+  }
+  size_t slots = ht->size;
+  ht_free(ht);
+
+  qsort(lat, count, sizeof *lat, cmp_u32);
+  printf("\n%s rehash\n----------------------------\n",
+         incremental ? "incremental" : "stop-the-world");
+  printf("%-17s %'10zu\n", "ht_inc count", count);
+  printf("%-17s %'10zu\n", "Slot count", slots);
+  printf("%-17s %10.1f ns\n", "mean", (double)total / count);
+  printf("%-17s %'10u ns\n", "p50", lat[count / 2]);
+  printf("%-17s %'10u ns\n", "p99", lat[count / 100 * 99]);
+  printf("%-17s %'10u ns\n", "p99.9", lat[count / 1000 * 999]);
+  printf("%-17s %'10u ns\n", "max", lat[count - 1]);
+  free(lat);
+}
+
+int main(int argc, char** argv) {
+  char usage[50];
+  snprintf(usage, 50, "Usage: %s [count]\n", argv[0]);
+  size_t count = 4000000;
+  if (argc > 1) {
+    if (!parseul(argv[1], &count) || count < 1000) {
+      fputs(usage, stderr);
+      fprintf(stderr, "Invalid `count`: \"%s\"\n", argv[1]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  setlocale(LC_NUMERIC, ""); // for thousands separator
+
+  latency_bench(count, false);
+  latency_bench(count, true);
+}
@@ -0,0 +1,195 @@
+#include "hashtable_rcu.h"
+#include "hashtable_sharded.h"
+#include <errno.h>
+#include <locale.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// lookup throughput of 1 to 32 reader threads, each looking up its own slice
+// of a stream of preloaded keys, against one writer thread. For
+// hash_table_rcu, with the writer idle and then with it inserting new keys
+// as fast as it can, so growing the table throughout. The baseline is a
+// hash_table behind one global mutex, a single shard of hash_table_sharded,
+// with the same writer
+
+typedef struct timespec timespec;
+
+static double timediff(timespec start, timespec end) {
+  timespec e;
+  if ((end.tv_nsec - start.tv_nsec) < 0) {
+    e.tv_sec  = end.tv_sec - start.tv_sec - 1;
+    e.tv_nsec = 1000000000 + end.tv_nsec - start.tv_nsec;
+  } else {
+    e.tv_sec  = end.tv_sec - start.tv_sec;
+    e.tv_nsec = end.tv_nsec - start.tv_nsec;
+  }
+  return e.tv_sec + e.tv_nsec / 1000000000.0;
+}
+
+bool parseul(const char* str, size_t* val) {
+  char* end; // NOLINT
+  errno = 0;
+  *val  = strtoul(str, &end, 0);
+  if (end == str || *end != '\0' || errno == ERANGE) return false;
+  return true;
+}
+
+typedef enum { RCU, RCU_WRITER, LOCKED_WRITER } mode;
+
+typedef struct bench bench;
+struct bench {
+  hash_table_rcu*     rcu;
+  hash_table_sharded* locked;
+  char**              keys;
+  size_t              keycount;
+  _Atomic bool        stop; // the writer's
+  size_t              writes;
+};
+
+typedef struct reader_args reader_args;
+struct reader_args {
+  bench* b;
+  mode   mode;
+  size_t start;
+  size_t end;
+  size_t found;
+};
+
+static void* reader(void* arg) {
+  reader_args* args = arg;
+  ht_value_t   value;
+  if (args->mode == LOCKED_WRITER) {
+    for (size_t i = args->start; i < args->end; ++i)
+      args->found += ht_sh_get(args->b->locked, args->b->keys[i], &value);
+    return NULL;
+  }
+  ht_rcu_reader* r = ht_rcu_reader_create(args->b->rcu);
+  for (size_t i = args->start; i < args->end; ++i)
+    args->found += ht_rcu_get(r, args->b->keys[i], &value);
+  ht_rcu_reader_free(r);
+  return NULL;
+}
+
+// inserts new keys until stopped
+static void* writer(void* arg) {
+  bench* b = arg;
+  char   key[24];
+  for (b->writes = 0; !atomic_load(&b->stop); ++b->writes) {
+    snprintf(key, sizeof key, "new%zu", b->writes);
+    if (b->rcu)
+      ht_rcu_insert(b->rcu, key, 1);
+    else
+      ht_sh_insert(b->locked, key, 1);
+  }
+  return NULL;
+}
+
+// returns wall clock seconds for threadcount readers to look up all keys
+static double run(char** keys, size_t keycount, mode mode,
+                  size_t threadcount, size_t* writes) {
+  bench b = {.keys = keys, .keycount = keycount};
+  atomic_init(&b.stop, false);
+  if (mode == LOCKED_WRITER) {
+    b.locked = ht_sh_create(1024, 1);
+    for (size_t k = 0; k < keycount; ++k) ht_sh_insert(b.locked, keys[k], 1);
+  } else {
+    b.rcu = ht_rcu_create(1024);
+    for (size_t k = 0; k < keycount; ++k) ht_rcu_insert(b.rcu, keys[k], 1);
+  }
+  pthread_t   threads[32];
+  pthread_t   writer_thread;
+  reader_args args[32];
+
+  timespec start, stop;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (mode != RCU &&
+      pthread_create(&writer_thread, NULL, writer, &b) != 0) {
+    perror("pthread_create");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t t = 0; t < threadcount; ++t) {
+    args[t] = (reader_args){&b, mode, keycount * t / threadcount,
+                            keycount * (t + 1) / threadcount, 0};
+    if (pthread_create(&threads[t], NULL, reader, &args[t]) != 0) {
+      perror("pthread_create");
+      exit(EXIT_FAILURE);
+    }
+  }
+  size_t found = 0;
+  for (size_t t = 0; t < threadcount; ++t) {
+    pthread_join(threads[t], NULL);
+    found += args[t].found;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+  atomic_store(&b.stop, true);
+  if (mode != RCU) pthread_join(writer_thread, NULL);
+  if (found != keycount) {
+    fprintf(stderr, "found %zu of %zu keys\n", found, keycount);
+    exit(EXIT_FAILURE);
+  }
+
+  *writes = b.writes;
+  if (b.rcu) ht_rcu_free(b.rcu);
+  if (b.locked) ht_sh_free(b.locked);
+  return timediff(start, stop);
+}
+
+int main(int argc, char** argv) {
+  char usage[60];
+  snprintf(usage, 60, "Usage: %s [count]\n", argv[0]);
+  size_t keycount = 4000000;
+  if (argc > 1 && !parseul(argv[1], &keycount)) {
+    fputs(usage, stderr);
+    exit(EXIT_FAILURE);
+  }
+  setlocale(LC_NUMERIC, ""); // for thousands separator
+
+  // distinct keys, looked up in a shuffled order
+  srand(1); // fixed seed
+  char** keys = malloc(keycount * sizeof(char*));
+  if (!keys) {
+    perror("malloc keys");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t k = 0; k < keycount; ++k) {
+    keys[k] = malloc(24);
+    if (!keys[k]) {
+      perror("malloc key");
+      exit(EXIT_FAILURE);
+    }
+    snprintf(keys[k], 24, "key%zu", k);
+  }
+  for (size_t k = keycount - 1; k > 0; --k) {
+    size_t j = (size_t)rand() % (k + 1);
+    char*  t = keys[k];
+    keys[k]  = keys[j];
+    keys[j]  = t;
+  }
+
+  printf("\n%s\n------------------------------------------------------------"
+         "----------\n",
+         "ht_rcu_get throughput");
+  printf("%'zu keys, readers against 1 writer inserting new keys\n\n",
+         keycount);
+  printf("%-8s %12s %9s %14s %10s %14s\n", "readers", "rcu Mops/s",
+         "speedup", "+writer Mops/s", "writes/s", "locked Mops/s");
+  double base = 0;
+  for (size_t threadcount = 1; threadcount <= 32; threadcount *= 2) {
+    size_t writes, locked_writes;
+    double idle   = run(keys, keycount, RCU, threadcount, &writes);
+    double busy   = run(keys, keycount, RCU_WRITER, threadcount, &writes);
+    double locked = run(keys, keycount, LOCKED_WRITER, threadcount,
+                        &locked_writes);
+    if (threadcount == 1) base = idle;
+    printf("%-8zu %12.2f %8.2fx %14.2f %10.0f %14.2f\n", threadcount,
+           keycount / idle / 1e6, base / idle, keycount / busy / 1e6,
+           writes / busy, keycount / locked / 1e6);
+  }
+
+  for (size_t k = 0; k < keycount; ++k) free(keys[k]);
+  free(keys);
+}
@@ -0,0 +1,142 @@
+#include "reader.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// fills buf from fd until it is full or at EOF, as pipes return at most what
+// the writer has written so far. Returns the bytes read
+static size_t read_full(int fd, char* buf, size_t size) {
+  size_t total = 0;
+  while (total < size) {
+    ssize_t got = read(fd, buf + total, size - total);
+    if (got < 0) {
+      if (errno == EINTR) continue;
+      perror("read");
+      exit(EXIT_FAILURE);
+    }
+    if (got == 0) break; // EOF
+    total += got;
+  }
+  return total;
+}
+
+static void* readahead(void* arg) {
+  reader* r = arg;
+  for (int i = 0;; i ^= 1) {
+    pthread_mutex_lock(&r->lock);
+    while (r->full[i] && !r->closing) pthread_cond_wait(&r->cond, &r->lock);
+    bool closing = r->closing;
+    pthread_mutex_unlock(&r->lock);
+    if (closing) return NULL;
+
+    size_t len = read_full(r->fd, r->bufs[i], READER_BUFSIZE);
+
+    pthread_mutex_lock(&r->lock);
+    r->lens[i] = len;
+    r->full[i] = true;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    if (len == 0) return NULL; // EOF, which the caller sees as an empty block
+  }
+}
+
+// mmaps regular files. Returns false if fd needs the readahead thread
+static bool reader_try_map(reader* r) {
+  struct stat st;
+  if (fstat(r->fd, &st) != 0 || !S_ISREG(st.st_mode)) return false;
+  r->maplen = st.st_size;
+  if (r->maplen == 0) return true; // can't mmap 0 bytes, it's simply EOF
+  void* map = mmap(NULL, r->maplen, PROT_READ, MAP_PRIVATE, r->fd, 0);
+  if (map == MAP_FAILED) return false;
+  madvise(map, r->maplen, MADV_SEQUENTIAL); // aggressive readahead, early drop
+  r->map = map;
+  return true;
+}
+
+reader* reader_open_fd(int fd, bool owns_fd) {
+  reader* r = calloc(1, sizeof *r);
+  if (!r) {
+    perror("calloc reader");
+    exit(EXIT_FAILURE);
+  }
+  r->fd      = fd;
+  r->owns_fd = owns_fd;
+  r->current = -1;
+  if (reader_try_map(r)) return r;
+
+  r->threaded = true;
+  r->bufs[0]  = malloc(READER_BUFSIZE);
+  r->bufs[1]  = malloc(READER_BUFSIZE);
+  if (!r->bufs[0] || !r->bufs[1]) {
+    perror("malloc reader buffers");
+    exit(EXIT_FAILURE);
+  }
+  pthread_mutex_init(&r->lock, NULL);
+  pthread_cond_init(&r->cond, NULL);
+  if (pthread_create(&r->thread, NULL, readahead, r) != 0) {
+    perror("pthread_create");
+    exit(EXIT_FAILURE);
+  }
+  return r;
+}
+
+reader* reader_open(const char* path) {
+  if (path[0] == '-' && path[1] == '\0')
+    return reader_open_fd(STDIN_FILENO, false);
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return NULL;
+  return reader_open_fd(fd, true);
+}
+
+// closing before EOF waits for any read() the thread is blocked in
+void reader_close(reader* r) {
+  if (r->threaded) {
+    pthread_mutex_lock(&r->lock);
+    r->closing = true;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->thread, NULL);
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->cond);
+    free(r->bufs[0]);
+    free(r->bufs[1]);
+  }
+  if (r->map) munmap((void*)r->map, r->maplen);
+  if (r->owns_fd) close(r->fd);
+  free(r);
+}
+
+const char* reader_next(reader* r, size_t* len) {
+  if (!r->threaded) {
+    if (r->map_done || !r->map) return NULL;
+    r->map_done = true;
+    *len        = r->maplen;
+    return r->map;
+  }
+
+  pthread_mutex_lock(&r->lock);
+  if (r->current >= 0) { // hand the previous block back to the thread
+    r->full[r->current] = false;
+    r->current          = -1;
+    pthread_cond_broadcast(&r->cond);
+  }
+  while (!r->full[r->next]) pthread_cond_wait(&r->cond, &r->lock);
+  int i = r->next;
+  pthread_mutex_unlock(&r->lock);
+
+  if (r->lens[i] == 0) return NULL; // EOF, left full so the thread stays done
+  r->current = i;
+  r->next ^= 1;
+  *len = r->lens[i];
+  return r->bufs[i];
+}
+
+const char* reader_map(const reader* r, size_t* len) {
+  if (r->threaded) return NULL;
+  *len = r->maplen;
+  return r->map ? r->map : ""; // an empty file is an empty map
+}
@@ -0,0 +1,49 @@
+// input for topwords, as a sequence of read only blocks of bytes which the
+// caller tokenizes in place. Regular files are mmap'ed and returned as one
+// block. Pipes, terminals and stdin are read by a background thread into two
+// large buffers, so reading the next block overlaps processing this one.
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define READER_BUFSIZE (1024 * 1024)
+
+typedef struct reader reader;
+struct reader {
+  int  fd;
+  bool owns_fd;
+
+  // mmap backend
+  const char* map;
+  size_t      maplen;
+  bool        map_done; // the single block has been returned
+
+  // readahead backend. The thread fills bufs[i] while the caller has the
+  // other one, a buffer with full[i] set belongs to the caller
+  bool            threaded;
+  pthread_t       thread;
+  pthread_mutex_t lock;
+  pthread_cond_t  cond;
+  char*           bufs[2];
+  size_t          lens[2];  // 0 => EOF
+  bool            full[2];
+  int             next;     // buffer the caller gets next
+  int             current;  // buffer the caller has, -1 => none
+  bool            closing;
+};
+
+// path "-" means stdin. Returns NULL with errno set if path can't be opened
+reader* reader_open(const char* path);
+// takes ownership of fd if owns_fd
+reader* reader_open_fd(int fd, bool owns_fd);
+void    reader_close(reader* r);
+
+// the next block, of *len > 0 bytes, or NULL at EOF. The block is valid until
+// the next call
+const char* reader_next(reader* r, size_t* len);
+
+// the whole input as one block if it is mmap'ed, else NULL. For callers which
+// split it themselves, instead of calling reader_next
+const char* reader_map(const reader* r, size_t* len);
@@ -0,0 +1,124 @@
+#include "hashtable_sharded.h"
+#include <errno.h>
+#include <locale.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// multi threaded ht_sh_inc throughput, 1 to 32 threads, each counting its own
+// slice of a shared stream of keys. One shard is the same as wrapping a
+// hash_table in a single global mutex, which is the baseline
+
+typedef struct timespec timespec;
+
+static double timediff(timespec start, timespec end) {
+  timespec e;
+  if ((end.tv_nsec - start.tv_nsec) < 0) {
+    e.tv_sec  = end.tv_sec - start.tv_sec - 1;
+    e.tv_nsec = 1000000000 + end.tv_nsec - start.tv_nsec;
+  } else {
+    e.tv_sec  = end.tv_sec - start.tv_sec;
+    e.tv_nsec = end.tv_nsec - start.tv_nsec;
+  }
+  return e.tv_sec + e.tv_nsec / 1000000000.0;
+}
+
+bool parseul(const char* str, size_t* val) {
+  char* end; // NOLINT
+  errno = 0;
+  *val  = strtoul(str, &end, 0);
+  if (end == str || *end != '\0' || errno == ERANGE) return false;
+  return true;
+}
+
+typedef struct worker_args worker_args;
+struct worker_args {
+  hash_table_sharded* table;
+  char**              keys;
+  size_t              start;
+  size_t              end;
+};
+
+static void* worker(void* arg) {
+  worker_args* args = arg;
+  for (size_t i = args->start; i < args->end; ++i)
+    ht_sh_inc(args->table, args->keys[i]);
+  return NULL;
+}
+
+// returns wall clock seconds to count all keys with threadcount threads
+static double run(char** keys, size_t keycount, size_t shardcount,
+                  size_t threadcount) {
+  hash_table_sharded* table = ht_sh_create(32 * 1024, shardcount);
+  pthread_t           threads[32];
+  worker_args         args[32];
+
+  timespec start, stop;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t t = 0; t < threadcount; ++t) {
+    args[t] = (worker_args){table, keys, keycount * t / threadcount,
+                            keycount * (t + 1) / threadcount};
+    if (pthread_create(&threads[t], NULL, worker, &args[t]) != 0) {
+      perror("pthread_create");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (size_t t = 0; t < threadcount; ++t) pthread_join(threads[t], NULL);
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+
+  ht_sh_free(table);
+  return timediff(start, stop);
+}
+
+int main(int argc, char** argv) {
+  char usage[60];
+  snprintf(usage, 60, "Usage: %s [count] [shards]\n", argv[0]);
+  size_t keycount   = 4000000;
+  size_t shardcount = 256;
+  if ((argc > 1 && !parseul(argv[1], &keycount)) ||
+      (argc > 2 && !parseul(argv[2], &shardcount))) {
+    fputs(usage, stderr);
+    exit(EXIT_FAILURE);
+  }
+  setlocale(LC_NUMERIC, ""); // for thousands separator
+
+  // 1 to 8 char keys over 26 letters: ~1M distinct keys, many repeats
+  srand(1); // fixed seed
+  char** keys = malloc(keycount * sizeof(char*));
+  if (!keys) {
+    perror("malloc keys");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t k = 0; k < keycount; ++k) {
+    size_t length = 1 + rand() % 8;
+    keys[k]       = malloc(length + 1);
+    if (!keys[k]) {
+      perror("malloc key");
+      exit(EXIT_FAILURE);
+    }
+    for (size_t chr = 0; chr < length; ++chr)
+      keys[k][chr] = (char)('a' + rand() % (length < 4 ? 26 : 6));
+    keys[k][length] = '\0';
+  }
+
+  printf("\n%s\n----------------------------------------------------\n",
+         "ht_sh_inc throughput");
+  printf("%'zu keys, %zu shards vs 1 shard (global lock)\n\n", keycount,
+         shardcount);
+  printf("%-8s %14s %10s %14s\n", "threads", "sharded Mops/s", "speedup",
+         "1 shard Mops/s");
+  double base = 0;
+  for (size_t threadcount = 1; threadcount <= 32; threadcount *= 2) {
+    double secs   = run(keys, keycount, shardcount, threadcount);
+    double single = run(keys, keycount, 1, threadcount);
+    if (threadcount == 1) base = secs;
+    printf("%-8zu %14.2f %9.2fx %14.2f\n", threadcount, keycount / secs / 1e6,
+           base / secs, keycount / single / 1e6);
+  }
+
+  for (size_t k = 0; k < keycount; ++k) free(keys[k]);
+  free(keys);
+}
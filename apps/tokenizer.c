@@ -0,0 +1,307 @@
+#include "tokenizer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__) && !defined(TOK_NO_SIMD)
+#include <immintrin.h>
+#define TOK_AVX2
+#elif defined(__SSE2__) && !defined(TOK_NO_SIMD)
+#include <emmintrin.h>
+#define TOK_SSE2
+#endif
+
+typedef uint32_t tok_mask; // one bit per byte of a stride
+
+// the classifiers set bits in *letter for ASCII letters, in *upper for ASCII
+// capitals and in *high for non ASCII bytes, for n bytes from p
+
+static inline void classify_scalar(const char* p, unsigned n, tok_mask* letter,
+                                   tok_mask* upper, tok_mask* high) {
+  *letter = *upper = *high = 0;
+  for (unsigned i = 0; i < n; ++i) {
+    char c = p[i];
+    *letter |= (tok_mask)tok_is_letter(c) << i;
+    *upper |= (tok_mask)(c >= 'A' && c <= 'Z') << i;
+    *high |= (tok_mask)((c & 0x80) != 0) << i;
+  }
+}
+
+// letters are found with one signed compare: x - 'a' + 0x80 is below
+// 0x80 + 26, as a signed byte, exactly for x in 'a'..'z'. Or'ing in 0x20
+// first maps the capitals onto the lowercase letters
+#if defined(TOK_AVX2)
+static inline void classify(const char* p, tok_mask* letter, tok_mask* upper,
+                            tok_mask* high) {
+  __m256i v     = _mm256_loadu_si256((const __m256i*)p);
+  __m256i limit = _mm256_set1_epi8((char)(0x80 + 26));
+  __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+  __m256i l     = _mm256_add_epi8(lower, _mm256_set1_epi8((char)(0x80 - 'a')));
+  __m256i u     = _mm256_add_epi8(v, _mm256_set1_epi8((char)(0x80 - 'A')));
+  *letter = (tok_mask)_mm256_movemask_epi8(_mm256_cmpgt_epi8(limit, l));
+  *upper  = (tok_mask)_mm256_movemask_epi8(_mm256_cmpgt_epi8(limit, u));
+  *high   = (tok_mask)_mm256_movemask_epi8(v);
+}
+#elif defined(TOK_SSE2)
+static inline void classify16(const char* p, tok_mask* letter,
+                              tok_mask* upper, tok_mask* high) {
+  __m128i v     = _mm_loadu_si128((const __m128i*)p);
+  __m128i limit = _mm_set1_epi8((char)(0x80 + 26));
+  __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  __m128i l     = _mm_add_epi8(lower, _mm_set1_epi8((char)(0x80 - 'a')));
+  __m128i u     = _mm_add_epi8(v, _mm_set1_epi8((char)(0x80 - 'A')));
+  *letter       = (tok_mask)_mm_movemask_epi8(_mm_cmplt_epi8(l, limit));
+  *upper        = (tok_mask)_mm_movemask_epi8(_mm_cmplt_epi8(u, limit));
+  *high         = (tok_mask)_mm_movemask_epi8(v);
+}
+
+static inline void classify(const char* p, tok_mask* letter, tok_mask* upper,
+                            tok_mask* high) {
+  tok_mask l1, u1, h1, l2, u2, h2;
+  classify16(p, &l1, &u1, &h1);
+  classify16(p + 16, &l2, &u2, &h2);
+  *letter = l1 | l2 << 16;
+  *upper  = u1 | u2 << 16;
+  *high   = h1 | h2 << 16;
+}
+#else
+static inline void classify(const char* p, tok_mask* letter, tok_mask* upper,
+                            tok_mask* high) {
+  classify_scalar(p, TOK_STRIDE, letter, upper, high);
+}
+#endif
+
+static inline bool utf8_is_cont(unsigned char c) { return (c & 0xc0) == 0x80; }
+
+// decodes the 2 or 3 byte UTF-8 character at p, 0 if it is truncated, longer
+// or invalid
+static uint32_t utf8_decode(const unsigned char* p, size_t avail) {
+  if (p[0] >= 0xc0 && p[0] < 0xe0 && avail >= 2 && utf8_is_cont(p[1]))
+    return (uint32_t)(p[0] & 0x1f) << 6 | (p[1] & 0x3f);
+  if (p[0] >= 0xe0 && p[0] < 0xf0 && avail >= 3 && utf8_is_cont(p[1]) &&
+      utf8_is_cont(p[2]))
+    return (uint32_t)(p[0] & 0x0f) << 12 | (uint32_t)(p[1] & 0x3f) << 6 |
+           (p[2] & 0x3f);
+  return 0;
+}
+
+// whether the non ASCII character starting at p separates words: Latin-1
+// punctuation, the general and CJK punctuation blocks, the BOM and emoji.
+// Invalid UTF-8 doesn't, so that all bytes of a punctuation character are
+// continuation bytes
+static bool utf8_is_punct(const unsigned char* p, size_t avail) {
+  if (p[0] == 0xf0) // U+1Fxxx, emoji
+    return avail >= 4 && p[1] == 0x9f && utf8_is_cont(p[2]) &&
+           utf8_is_cont(p[3]);
+  uint32_t cp = utf8_decode(p, avail);
+  if (cp >= 0x80 && cp < 0xc0) return cp != 0xaa && cp != 0xb5 && cp != 0xba;
+  return cp == 0xd7 || cp == 0xf7 || (cp >= 0x2000 && cp < 0x2070) ||
+         (cp >= 0x3000 && cp < 0x3040) || cp == 0xfeff;
+}
+
+static inline unsigned utf8_seq_len(unsigned char lead) {
+  return lead >= 0xf0 ? 4 : lead >= 0xe0 ? 3 : 2;
+}
+
+// the bits of high which are bytes of punctuation characters. Continuation
+// bytes of one started in an earlier stride are counted down in t->skip
+static tok_mask utf8_punct(tokenizer* t, const char* p, const char* end,
+                           tok_mask high) {
+  tok_mask punct = 0;
+  while (high) {
+    unsigned      i = __builtin_ctz(high);
+    unsigned char c = (unsigned char)p[i];
+    high &= high - 1;
+    if (t->skip) {
+      t->skip--;
+      punct |= (tok_mask)1 << i;
+    } else if (c >= 0xc0 && utf8_is_punct((const unsigned char*)p + i,
+                                           (size_t)(end - p - i))) {
+      t->skip = utf8_seq_len(c) - 1;
+      punct |= (tok_mask)1 << i;
+    }
+  }
+  return punct;
+}
+
+// lowercases ASCII capitals in place
+static void fold_ascii(char* w, size_t len) {
+  size_t i = 0;
+#if defined(TOK_SSE2) || defined(TOK_AVX2)
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(w + i));
+    __m128i u = _mm_add_epi8(v, _mm_set1_epi8((char)(0x80 - 'A')));
+    u         = _mm_cmplt_epi8(u, _mm_set1_epi8((char)(0x80 + 26)));
+    v         = _mm_add_epi8(v, _mm_and_si128(u, _mm_set1_epi8(0x20)));
+    _mm_storeu_si128((__m128i*)(w + i), v);
+  }
+#endif
+  for (; i < len; ++i) w[i] = tok_tolower(w[i]);
+}
+
+// lowercase of a 2 byte character, or cp itself. All results are 2 bytes too
+static uint32_t fold_cp(uint32_t cp) {
+  if (cp >= 0xc0 && cp <= 0xde && cp != 0xd7) return cp + 0x20; // Latin-1
+  if (cp == 0x178) return 0xff;                                  // Y diaeresis
+  if ((cp >= 0x100 && cp <= 0x137) || (cp >= 0x14a && cp <= 0x177))
+    return (cp & 1) || cp == 0x130 ? cp : cp + 1; // Latin Extended-A pairs
+  if ((cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17e))
+    return (cp & 1) ? cp + 1 : cp;
+  if (cp >= 0x391 && cp <= 0x3a9 && cp != 0x3a2) return cp + 0x20; // Greek
+  if (cp == 0x386) return 0x3ac;
+  if (cp >= 0x388 && cp <= 0x38a) return cp + 0x25;
+  if (cp == 0x38c) return 0x3cc;
+  if (cp == 0x38e || cp == 0x38f) return cp + 0x3f;
+  if (cp >= 0x410 && cp <= 0x42f) return cp + 0x20; // Cyrillic
+  if (cp >= 0x400 && cp <= 0x40f) return cp + 0x50;
+  return cp;
+}
+
+// lowercases the 2 byte characters fold_cp knows about, in place
+static void fold_utf8(char* w, size_t len) {
+  unsigned char* p = (unsigned char*)w;
+  for (size_t i = 0; i < len; ++i) {
+    if (p[i] < 0xc3 || p[i] > 0xd0) continue; // lead bytes of U+00C0..U+043F
+    uint32_t cp = utf8_decode(p + i, len - i);
+    if (!cp) continue;
+    uint32_t lc = fold_cp(cp);
+    p[i]        = (unsigned char)(0xc0 | lc >> 6);
+    p[i + 1]    = (unsigned char)(0x80 | (lc & 0x3f));
+    ++i;
+  }
+}
+
+static void word_append(tokenizer* t, const char* src, size_t len) {
+  if (!len) return;
+  if (t->len + len > t->cap) {
+    t->cap  = (t->len + len) * 2;
+    t->word = realloc(t->word, t->cap);
+    if (!t->word) {
+      perror("realloc word");
+      exit(EXIT_FAILURE);
+    }
+  }
+  memcpy(t->word + t->len, src, len);
+  t->len += len;
+}
+
+static inline void count_word(tokenizer* t, hash_table* ht, const char* word,
+                              size_t len) {
+  if (t->count)
+    t->count(t->counter, word, len);
+  else
+    ht_inc_n(ht, word, len); // takes a copy
+}
+
+// counts the word in t->word, after folding it
+static void word_count(tokenizer* t, hash_table* ht) {
+  fold_ascii(t->word, t->len);
+  if (t->utf8) fold_utf8(t->word, t->len);
+  count_word(t, ht, t->word, t->len);
+  t->len = 0;
+}
+
+void tok_init(tokenizer* t, bool utf8) { *t = (tokenizer){.utf8 = utf8}; }
+
+void tok_set_counter(tokenizer* t, tok_count_fn count, void* counter) {
+  t->count   = count;
+  t->counter = counter;
+}
+
+void tok_free(tokenizer* t) {
+  free(t->word);
+  t->word = NULL;
+}
+
+static void tok_scan(tokenizer* t, hash_table* ht, const char* block,
+                     size_t len) {
+  const char* end = block + len;
+
+  // a word continued from the last block is always completed in t->word
+  bool        in_word = t->len > 0;
+  bool        fold    = in_word; // word must be copied and folded
+  const char* start   = block;   // of the current word
+
+  for (const char* base = block; base < end; base += TOK_STRIDE) {
+    unsigned n = end - base < TOK_STRIDE ? (unsigned)(end - base) : TOK_STRIDE;
+    tok_mask letter, upper, high;
+    if (n == TOK_STRIDE)
+      classify(base, &letter, &upper, &high);
+    else
+      classify_scalar(base, n, &letter, &upper, &high);
+
+    tok_mask words = letter;
+    tok_mask folds = upper;
+    if (t->utf8 && high) {
+      words |= high & ~utf8_punct(t, base, end, high);
+      folds |= high;
+    }
+    if (!in_word && !words) continue; // only separators
+
+    tok_mask valid = n == TOK_STRIDE ? ~(tok_mask)0 : ((tok_mask)1 << n) - 1;
+    unsigned pos   = 0; // bits below pos are done
+    while (pos < n) {
+      tok_mask from = ~(tok_mask)0 << pos;
+      if (in_word) {
+        tok_mask stops = ~words & valid & from;
+        if (!stops) {
+          fold |= (folds & from) != 0;
+          break; // word continues into the next stride
+        }
+        unsigned stop = __builtin_ctz(stops);
+        fold |= (folds & from & (((tok_mask)1 << stop) - 1)) != 0;
+        if (fold) {
+          word_append(t, start, base + stop - start);
+          word_count(t, ht);
+        } else {
+          count_word(t, ht, start, base + stop - start);
+        }
+        in_word = false;
+        pos     = stop;
+      } else {
+        tok_mask starts = words & from;
+        if (!starts) break;
+        pos     = __builtin_ctz(starts);
+        start   = base + pos;
+        in_word = true;
+        fold    = false;
+      }
+    }
+  }
+  if (in_word) word_append(t, start, end - start);
+}
+
+void tok_block(tokenizer* t, hash_table* ht, const char* block, size_t len) {
+  if (t->partlen) { // complete the character split by the last block first
+    unsigned charlen = utf8_seq_len((unsigned char)t->part[0]);
+    while (t->partlen < charlen && len && utf8_is_cont(*block)) {
+      t->part[t->partlen++] = *block++;
+      len--;
+    }
+    if (t->partlen < charlen && !len) return; // may continue in the next
+    unsigned partlen = t->partlen; // complete, or invalid and so cut short
+    t->partlen       = 0;
+    tok_scan(t, ht, t->part, partlen);
+  }
+  if (t->utf8) { // hold back a character split by the end of this block
+    for (size_t back = 1; back <= 3 && back <= len; ++back) {
+      unsigned char c = (unsigned char)block[len - back];
+      if (c < 0x80) break;      // ASCII, so not split
+      if (utf8_is_cont(c)) continue; // look further back for the lead byte
+      if (utf8_seq_len(c) > back) {
+        memcpy(t->part, block + len - back, back);
+        t->partlen = back;
+        len -= back;
+      }
+      break;
+    }
+  }
+  tok_scan(t, ht, block, len);
+}
+
+void tok_finish(tokenizer* t, hash_table* ht) {
+  if (t->partlen) tok_scan(t, ht, t->part, t->partlen); // truncated at EOF
+  t->partlen = 0;
+  if (t->len) word_count(t, ht);
+  t->skip = 0;
+}
@@ -0,0 +1,72 @@
+// splits text into words and counts them into a hash_table. A word is a run
+// of ASCII letters or, in UTF-8 mode, of ASCII letters and non ASCII
+// characters other than common punctuation and symbols. Words are case folded
+// before counting: ASCII always, and in UTF-8 mode also the Latin-1, Latin
+// Extended-A, Greek and Cyrillic capitals.
+//
+// Input is classified TOK_STRIDE bytes at a time, with AVX2 or SSE2 where
+// available, into bitmasks of word bytes and bytes needing folding. Word
+// boundaries are then found with count trailing zeros, and words which need
+// no folding are counted straight from the input.
+#pragma once
+
+#include "hashtable.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TOK_STRIDE 32
+
+// counts a word in place of ht_inc_n, see tok_set_counter. word is folded,
+// and only valid for the call
+typedef void (*tok_count_fn)(void* counter, const char* word, size_t len);
+
+typedef struct tokenizer tokenizer;
+struct tokenizer {
+  bool         utf8;
+  tok_count_fn count; // NULL => words go to the hash_table
+  void*        counter;
+
+  // a word which runs off the end of a block, to be completed by the next
+  // one. Grows as needed, so there is no limit on word length
+  char*  word;
+  size_t len;
+  size_t cap;
+
+  // UTF-8 continuation bytes still to come of a punctuation character which
+  // straddles strides
+  unsigned skip;
+
+  // the start of a UTF-8 character split by the end of a block. It's held
+  // back until complete, as it can't be classified before
+  char     part[4];
+  unsigned partlen;
+};
+
+void tok_init(tokenizer* t, bool utf8);
+void tok_free(tokenizer* t);
+
+// passes words to count instead of counting them into a hash_table, which
+// tok_block and tok_finish are then given as NULL
+void tok_set_counter(tokenizer* t, tok_count_fn count, void* counter);
+
+// counts the words in a read only block. A word running off the end is kept
+// and continued by the next call
+void tok_block(tokenizer* t, hash_table* ht, const char* block, size_t len);
+
+// counts the word left over at the end of the input, if any
+void tok_finish(tokenizer* t, hash_table* ht);
+
+static inline bool tok_is_letter(char c) {
+  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+static inline char tok_tolower(char c) {
+  return (c >= 'A' && c <= 'Z') ? (char)(c + 'a' - 'A') : c;
+}
+
+// whether c could be inside a word or multibyte character, ie whether input
+// may not be split just before it
+static inline bool tok_may_continue(char c, bool utf8) {
+  return tok_is_letter(c) || (utf8 && (c & 0x80));
+}
@@ -1,23 +1,20 @@
 #include "hashtable.h"
+#include "hashtable_approx.h"
+#include "hashtable_spill.h"
+#include "reader.h"
+#include "tokenizer.h"
+#include "wordcount.h"
 #include <errno.h>
+#include <getopt.h>
 #include <limits.h>
 #include <locale.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
-
-static inline bool ht_is_alpha(char c) {
-  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
-}
-static inline char ht_tolower(char c) { return (c < 'a') ? c + 'a' - 'A' : c; }
-
-static int cmp_ht_items(const void* a, const void* b) {
-  int a_val = (*(hash_table_item**)a)->value;
-  int b_val = (*(hash_table_item**)b)->value;
-  if (a_val == b_val) return 0;
-  return a_val < b_val ? 1 : -1;
-}
+#include <unistd.h>
 
 bool parseul(const char* str, size_t* val) {
   char* end; // NOLINT
@@ -27,6 +24,22 @@ bool parseul(const char* str, size_t* val) {
   return true;
 }
 
+// a byte count with an optional K, M or G suffix, in 1024s
+static bool parse_bytes(const char* str, size_t* val) {
+  char* end; // NOLINT
+  errno = 0;
+  *val  = strtoul(str, &end, 0);
+  if (end == str || errno == ERANGE) return false;
+  size_t shift = 0;
+  if (*end == 'K' || *end == 'k') shift = 10;
+  if (*end == 'M' || *end == 'm') shift = 20;
+  if (*end == 'G' || *end == 'g') shift = 30;
+  if (shift) ++end;
+  if (*end != '\0' || *val > (SIZE_MAX >> shift)) return false;
+  *val <<= shift;
+  return true;
+}
+
 static inline size_t minul(size_t a, size_t b) { return a < b ? a : b; }
 
 static inline int rand_range(int start, int end) {
@@ -47,46 +60,28 @@ static double timediff(timespec start, timespec end) {
   return e.tv_sec + e.tv_nsec / 1000000000.0;
 }
 
-static void parse_and_map(FILE* fp, size_t limit) {
+static void parse_and_map(reader* in, size_t limit, bool utf8) {
   hash_table* ht = ht_create(32 * 1024);
+  ht_set_seed(ht, ht_random_seed()); // see WC_MAX_CHAIN
+  ht_set_max_chain(ht, WC_MAX_CHAIN);
 
   timespec start, stop;
   clock_gettime(CLOCK_MONOTONIC, &start);
 
-#define BUFSIZE 1024
-#define WORDSIZE 50
-  char  buf[BUFSIZE];
-  char  word[WORDSIZE];
-  char* word_ptr = word;
-  while (!feof(fp) && !ferror(fp)) {
-    size_t bytes_read = fread(buf, 1, BUFSIZE, fp);
-    char*  bufptr     = buf;
-    while ((bufptr < buf + bytes_read)) {
-      char c = *bufptr;
-      if (ht_is_alpha(c)) {
-        *word_ptr++ = ht_tolower(c);
-        if (word_ptr - word == WORDSIZE - 1) { // -1 for NULL terminator
-          fputs("word too long. terminating\n", stderr);
-          exit(EXIT_FAILURE);
-        }
-      } else if (word_ptr > word) {
-        *word_ptr++ = '\0'; // terminate word
-        ht_inc(ht, word);   // record (takes a copy)
-        word_ptr = word;    // restart new word
-      }
-      ++bufptr; // next char from buf
-    }
-  }
+  tokenizer tok;
+  tok_init(&tok, utf8);
+  const char* block;
+  size_t      len;
+  while ((block = reader_next(in, &len))) tok_block(&tok, ht, block, len);
+  tok_finish(&tok, ht); // last word, unterminated at EOF
+  tok_free(&tok);
 
   clock_gettime(CLOCK_MONOTONIC, &stop);
 
-  // build a flat view of the hashtable items
-  hash_table_item** view = ht_create_flat_view(ht);
-
-  // now sort that view and print the top 10
-  qsort(view, ht->itemcount, sizeof(hash_table_item*), cmp_ht_items);
-  size_t wordcnt = 0;
-  for (size_t i = 0; i < ht->itemcount; i++) wordcnt += view[i]->value;
+  // select and sort only the top items
+  size_t            topcount;
+  hash_table_item** top     = ht_top_k(ht, limit, wc_cmp_items, &topcount);
+  size_t            wordcnt = wc_sum_values(ht);
 
   printf("\n%s\n----------------------------\n", "file wordcounts");
   printf("%-17s %'10zu\n", "Word count", wordcnt);
@@ -95,14 +90,175 @@ static void parse_and_map(FILE* fp, size_t limit) {
   printf("read + parse + ht_inc(): %.9fs\n", timediff(start, stop));
 
   printf("\nTop %zu\n----------------------------\n", limit);
-  for (size_t i = 0; i < minul(limit, ht->itemcount); i++)
-    printf("%-13s %'6d %6.2f%%\n", view[i]->key, view[i]->value,
-           100.0 * view[i]->value / wordcnt);
+  for (size_t i = 0; i < topcount; i++)
+    printf("%-13s %'6d %6.2f%%\n", top[i]->key, top[i]->value,
+           100.0 * top[i]->value / wordcnt);
 
-  free(view);
+  free(top);
   ht_free(ht);
 }
 
+static void approx_count(void* counter, const char* word, size_t len) {
+  ht_ap_inc_n(counter, word, len);
+}
+
+// as parse_and_map, but counting into a fixed size approximate counter,
+// for inputs with too many distinct words to count exactly
+static void approx_parse_and_map(reader* in, size_t limit, bool utf8,
+                                 size_t bytes) {
+  hash_table_approx* approx = ht_ap_create(bytes);
+
+  timespec start, stop;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  tokenizer tok;
+  tok_init(&tok, utf8);
+  tok_set_counter(&tok, approx_count, approx);
+  const char* block;
+  size_t      len;
+  while ((block = reader_next(in, &len))) tok_block(&tok, NULL, block, len);
+  tok_finish(&tok, NULL);
+  tok_free(&tok);
+
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+
+  size_t      topcount;
+  ht_ap_item* top     = ht_ap_top_k(approx, limit, &topcount);
+  uint64_t    wordcnt = approx->total;
+
+  printf("\n%s\n----------------------------\n", "file wordcounts (approx)");
+  printf("%-17s %'10llu\n", "Word count", (unsigned long long)wordcnt);
+  printf("%-17s %'10zu\n", "Memory bytes", ht_ap_bytes(approx));
+  printf("%-17s %'10.0f at %.0f%%\n", "Count error <=", ht_ap_error(approx),
+         100 * HT_AP_CONFIDENCE);
+  printf("read + parse + ht_ap_inc(): %.9fs\n", timediff(start, stop));
+
+  printf("\nTop %zu\n----------------------------\n", limit);
+  for (size_t i = 0; i < topcount; i++)
+    printf("%-13s %'6llu %6.2f%%\n", top[i].key,
+           (unsigned long long)top[i].count, 100.0 * top[i].count / wordcnt);
+
+  free(top);
+  ht_ap_free(approx);
+}
+
+static void spill_count(void* counter, const char* word, size_t len) {
+  if (!ht_sp_inc_n(counter, word, len)) {
+    perror("spill");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// as parse_and_map, but keeping the table within a memory budget by
+// spilling it to sorted runs on disk, which are merged at the end. Exact,
+// for inputs with too many distinct words to hold in memory
+static void spill_parse_and_map(reader* in, size_t limit, bool utf8,
+                                size_t bytes) {
+  hash_table_spill* spill = ht_sp_create(bytes, NULL);
+  if (!spill) {
+    perror("spill directory");
+    exit(EXIT_FAILURE);
+  }
+
+  timespec start, counted, stop;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  tokenizer tok;
+  tok_init(&tok, utf8);
+  tok_set_counter(&tok, spill_count, spill);
+  const char* block;
+  size_t      len;
+  while ((block = reader_next(in, &len))) tok_block(&tok, NULL, block, len);
+  tok_finish(&tok, NULL);
+  tok_free(&tok);
+
+  clock_gettime(CLOCK_MONOTONIC, &counted);
+
+  size_t      topcount;
+  ht_sp_item* top = ht_sp_top_k(spill, limit, &topcount);
+  if (!top) {
+    perror("spill merge");
+    exit(EXIT_FAILURE);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+  uint64_t wordcnt = spill->total;
+
+  printf("\n%s\n----------------------------\n", "file wordcounts (spill)");
+  printf("%-17s %'10llu\n", "Word count", (unsigned long long)wordcnt);
+  printf("%-17s %'10zu\n", "Spills", spill->spills);
+  printf("%-17s %'10llu\n", "Spilled bytes",
+         (unsigned long long)spill->spilled);
+  printf("read + parse + ht_sp_inc(): %.9fs\n", timediff(start, counted));
+  printf("merge: %.9fs\n", timediff(counted, stop));
+
+  printf("\nTop %zu\n----------------------------\n", limit);
+  for (size_t i = 0; i < topcount; i++)
+    printf("%-13s %'6llu %6.2f%%\n", top[i].key,
+           (unsigned long long)top[i].count, 100.0 * top[i].count / wordcnt);
+
+  ht_sp_free_items(top, topcount);
+  ht_sp_free(spill);
+}
+
+static void parallel_parse_and_map(reader* in, size_t limit, bool utf8,
+                                   size_t threadcount) {
+  size_t      size;
+  const char* map = reader_map(in, &size);
+  if (!map) {
+    fputs("-j needs a regular file. terminating\n", stderr);
+    exit(EXIT_FAILURE);
+  }
+
+  timespec start, counted, stop;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  wc_chunk* chunks = wc_count(map, size, utf8, threadcount, WC_MAX_CHAIN);
+  clock_gettime(CLOCK_MONOTONIC, &counted);
+  wc_part* merges = wc_merge(chunks, threadcount, limit);
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+
+  // the partitions hold disjoint words, so the overall top items are the
+  // top of their top items
+  size_t itemcount = 0;
+  size_t slotcount = 0;
+  size_t wordcnt   = 0;
+  size_t topcount  = 0;
+  for (size_t p = 0; p < threadcount; ++p) {
+    itemcount += merges[p].table->itemcount;
+    slotcount += merges[p].table->size;
+    wordcnt += merges[p].wordcnt;
+    topcount += merges[p].topcount;
+  }
+  hash_table_item** top = malloc(topcount * sizeof(hash_table_item*) + 1);
+  if (!top) {
+    perror("malloc top");
+    exit(EXIT_FAILURE);
+  }
+  topcount = 0;
+  for (size_t p = 0; p < threadcount; ++p) {
+    memcpy(top + topcount, merges[p].top,
+           merges[p].topcount * sizeof(hash_table_item*));
+    topcount += merges[p].topcount;
+  }
+  qsort(top, topcount, sizeof(hash_table_item*), wc_cmp_items);
+  topcount = minul(limit, topcount);
+
+  printf("\n%s (%zu threads)\n----------------------------\n",
+         "file wordcounts", threadcount);
+  printf("%-17s %'10zu\n", "Word count", wordcnt);
+  printf("%-17s %'10zu\n", "Unique count", itemcount);
+  printf("%-17s %'10zu\n", "Slot count", slotcount);
+  printf("read + parse + ht_inc(): %.9fs\n", timediff(start, counted));
+  printf("merge: %.9fs\n", timediff(counted, stop));
+
+  printf("\nTop %zu\n----------------------------\n", limit);
+  for (size_t i = 0; i < topcount; i++)
+    printf("%-13s %'6d %6.2f%%\n", top[i]->key, top[i]->value,
+           100.0 * top[i]->value / wordcnt);
+
+  free(top);
+  wc_free_parts(merges, threadcount);
+}
+
 static void rand_ht_bench(size_t limit) {
   srand(1); // fixed seed
 
@@ -134,10 +290,9 @@ static void rand_ht_bench(size_t limit) {
   for (size_t i = 0; i < str_count; ++i) ht_inc(ht, strs[i]);
   clock_gettime(CLOCK_MONOTONIC, &stop);
 
-  hash_table_item** view = ht_create_flat_view(ht);
-  qsort(view, ht->itemcount, sizeof(hash_table_item*), cmp_ht_items);
-  size_t wordcnt = 0;
-  for (size_t i = 0; i < ht->itemcount; i++) wordcnt += view[i]->value;
+  size_t            topcount;
+  hash_table_item** top     = ht_top_k(ht, limit, wc_cmp_items, &topcount);
+  size_t            wordcnt = wc_sum_values(ht);
 
   printf("\n%s\n----------------------------\n", "rand bench test");
   printf("%-17s %'10zu\n", "Word count", wordcnt);
@@ -146,42 +301,97 @@ static void rand_ht_bench(size_t limit) {
 
   printf("ht_inc(): %.9fs\n", timediff(start, stop));
 
+  // the same counts again, in batches, as ingest would deliver them
+  hash_table* bt = ht_create(32 * 1024);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < str_count; i += 1024)
+    ht_inc_batch(bt, strs + i, NULL, minul(1024, str_count - i), NULL);
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+  printf("ht_inc_batch(): %.9fs\n", timediff(start, stop));
+  if (bt->itemcount != ht->itemcount) {
+    fputs("ht_inc_batch() counts differ. terminating\n", stderr);
+    exit(EXIT_FAILURE);
+  }
+  ht_free(bt);
+
   printf("\nTop %zu\n----------------------------\n", limit);
-  for (size_t i = 0; i < minul(limit, ht->itemcount); i++)
-    printf("%-13s %'6d %6.2f%%\n", view[i]->key, view[i]->value,
-           100.0 * view[i]->value / wordcnt);
+  for (size_t i = 0; i < topcount; i++)
+    printf("%-13s %'6d %6.2f%%\n", top[i]->key, top[i]->value,
+           100.0 * top[i]->value / wordcnt);
 
-  free(view);
+  free(top);
   ht_free(ht);
   for (size_t i = 0; i < str_count; ++i) free(strs[i]);
   free(strs);
 }
 
 int main(int argc, char** argv) {
-  char usage[50];
-  snprintf(usage, 50, "Usage: %s filename [limit]\n", argv[0]);
-  if (argc < 2) {
+  char usage[160];
+  snprintf(usage, 160,
+           "Usage: %s [-u] [-j threads] [--approx MEM | --spill MEM] "
+           "filename|- [limit]\n",
+           argv[0]);
+  size_t threadcount = 1;
+  size_t approxmem   = 0;     // --approx: approximate counts in this memory
+  size_t spillmem    = 0;     // --spill: exact counts, spilling past this
+  bool   utf8        = false; // -u: non ASCII letters are word characters
+  int    opt;
+
+  static const struct option longopts[] = {
+      {"approx", required_argument, NULL, 'a'},
+      {"spill", required_argument, NULL, 's'},
+      {NULL, 0, NULL, 0}};
+  while ((opt = getopt_long(argc, argv, "uj:", longopts, NULL)) != -1) {
+    if (opt == 'u') {
+      utf8 = true;
+    } else if (opt == 'a' && parse_bytes(optarg, &approxmem) && approxmem) {
+      continue;
+    } else if (opt == 's' && parse_bytes(optarg, &spillmem) && spillmem) {
+      continue;
+    } else if (opt != 'j' || !parseul(optarg, &threadcount) ||
+               threadcount == 0) {
+      fputs(usage, stderr);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if ((approxmem || spillmem) && threadcount > 1) {
+    fputs(usage, stderr);
+    fputs("--approx and --spill count on one thread, without -j\n", stderr);
+    exit(EXIT_FAILURE);
+  }
+  if (approxmem && spillmem) {
+    fputs(usage, stderr);
+    exit(EXIT_FAILURE);
+  }
+  if (optind >= argc) {
     fputs(usage, stderr);
     exit(EXIT_FAILURE);
   }
-  FILE* fp = fopen(argv[1], "re");
-  if (!fp) {
-    perror("fopen");
+  reader* in = reader_open(argv[optind]);
+  if (!in) {
+    perror("open");
     exit(EXIT_FAILURE);
   }
   size_t limit = 10;
-  if (argc > 2) {
-    if (!parseul(argv[2], &limit)) {
+  if (argc > optind + 1) {
+    if (!parseul(argv[optind + 1], &limit)) {
       fputs(usage, stderr);
-      fprintf(stderr, "Invalid `limit`: \"%s\"\n", argv[2]);
-      fclose(fp);
+      fprintf(stderr, "Invalid `limit`: \"%s\"\n", argv[optind + 1]);
+      reader_close(in);
       exit(EXIT_FAILURE);
     }
   }
   setlocale(LC_NUMERIC, ""); // for thousands separator
 
   rand_ht_bench(limit);
-  parse_and_map(fp, limit);
+  if (approxmem)
+    approx_parse_and_map(in, limit, utf8, approxmem);
+  else if (spillmem)
+    spill_parse_and_map(in, limit, utf8, spillmem);
+  else if (threadcount > 1)
+    parallel_parse_and_map(in, limit, utf8, threadcount);
+  else
+    parse_and_map(in, limit, utf8);
 
-  fclose(fp);
+  reader_close(in);
 }
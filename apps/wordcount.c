@@ -0,0 +1,190 @@
+#include "wordcount.h"
+#include "hashtable_hash.h"
+#include "tokenizer.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int wc_cmp_items(const void* a, const void* b) {
+  int a_val = (*(hash_table_item**)a)->value;
+  int b_val = (*(hash_table_item**)b)->value;
+  if (a_val == b_val) return 0;
+  return a_val < b_val ? 1 : -1;
+}
+
+size_t wc_sum_values(const hash_table* ht) {
+  size_t               sum  = 0;
+  hash_table_iterator* iter = ht_create_iter(ht);
+  for (hash_table_item* item = ht_iter_current(iter); item;
+       item                  = ht_iter_next(iter))
+    sum += item->value;
+  ht_free_iter(iter);
+  return sum;
+}
+
+static hash_table* word_table(uint64_t seed, size_t max_chain) {
+  hash_table* ht = ht_create_pooled(32 * 1024);
+  ht_set_seed(ht, seed);
+  ht_set_max_chain(ht, max_chain);
+  return ht;
+}
+
+// the merge partition of an item. Uses the high bits, as the low ones select
+// its slot. The count tables share a seed, so a word has the same hash in
+// each, unless its table moved to SipHash
+static inline size_t part_of(const wc_chunk*        chunk,
+                             const hash_table_item* item) {
+  uint64_t hash = item->hash;
+  if (chunk->table->sip)
+    hash = ht_hash_wyhash_seeded(item->key, item->keylen, chunk->seed);
+  return (hash >> 32) % chunk->partcount;
+}
+
+// moves a chunk boundary forward until it no longer splits a word, or a
+// UTF-8 character
+static size_t align_to_word(const char* map, size_t pos, size_t size,
+                            bool utf8) {
+  while (pos > 0 && pos < size && tok_may_continue(map[pos - 1], utf8)) ++pos;
+  return pos;
+}
+
+// counting sort of the table's items by merge partition
+static void group_by_part(wc_chunk* chunk) {
+  hash_table_item** view = ht_create_flat_view(chunk->table);
+  size_t            n    = chunk->table->itemcount;
+  chunk->items           = malloc(n * sizeof(hash_table_item*) + 1);
+  chunk->offsets         = calloc(chunk->partcount + 1, sizeof(size_t));
+  if (!chunk->items || !chunk->offsets) {
+    perror("malloc partitions");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t i = 0; i < n; ++i)
+    chunk->offsets[part_of(chunk, view[i]) + 1]++;
+  for (size_t p = 0; p < chunk->partcount; ++p)
+    chunk->offsets[p + 1] += chunk->offsets[p];
+  size_t* next = malloc(chunk->partcount * sizeof(size_t));
+  if (!next) {
+    perror("malloc partitions");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(next, chunk->offsets, chunk->partcount * sizeof(size_t));
+  for (size_t i = 0; i < n; ++i)
+    chunk->items[next[part_of(chunk, view[i])]++] = view[i];
+  free(next);
+  free(view);
+}
+
+static void* count_chunk(void* arg) {
+  wc_chunk* chunk = arg;
+  chunk->table    = word_table(chunk->seed, chunk->max_chain);
+
+  tokenizer tok;
+  tok_init(&tok, chunk->utf8);
+  tok_block(&tok, chunk->table, chunk->map + chunk->start,
+            chunk->end - chunk->start);
+  tok_finish(&tok, chunk->table); // last word of the file
+  tok_free(&tok);
+
+  group_by_part(chunk);
+  return NULL;
+}
+
+static void* merge_part(void* arg) {
+  wc_part* part = arg;
+  part->table   = word_table(ht_random_seed(), part->chunks[0].max_chain);
+  for (size_t t = 0; t < part->chunkcount; ++t) {
+    const wc_chunk* c = &part->chunks[t];
+    for (size_t i = c->offsets[part->part]; i < c->offsets[part->part + 1];
+         ++i) {
+      hash_table_item* item = c->items[i];
+      ht_get_or_create_n(part->table, item->key, item->keylen, 0)->value +=
+          item->value;
+    }
+  }
+  part->top =
+      ht_top_k(part->table, part->limit, wc_cmp_items, &part->topcount);
+  part->wordcnt = wc_sum_values(part->table);
+  return NULL;
+}
+
+static pthread_t* create_threads(size_t threadcount) {
+  pthread_t* threads = malloc(threadcount * sizeof(pthread_t));
+  if (!threads) {
+    perror("malloc threads");
+    exit(EXIT_FAILURE);
+  }
+  return threads;
+}
+
+static void start_thread(pthread_t* thread, void* (*fn)(void*), void* arg) {
+  if (pthread_create(thread, NULL, fn, arg) != 0) {
+    perror("pthread_create");
+    exit(EXIT_FAILURE);
+  }
+}
+
+wc_chunk* wc_count(const char* map, size_t size, bool utf8,
+                   size_t threadcount, size_t max_chain) {
+  pthread_t* threads = create_threads(threadcount);
+  wc_chunk*  chunks  = malloc(threadcount * sizeof(wc_chunk));
+  if (!chunks) {
+    perror("malloc chunks");
+    exit(EXIT_FAILURE);
+  }
+
+  uint64_t seed        = ht_random_seed();
+  size_t   chunk_start = 0;
+  for (size_t t = 0; t < threadcount; ++t) {
+    size_t target = (size_t)((uintmax_t)size * (t + 1) / threadcount);
+    // a long word may already have carried the previous chunk past target
+    size_t chunk_end = align_to_word(
+        map, target > chunk_start ? target : chunk_start, size, utf8);
+    chunks[t]   = (wc_chunk){.map       = map,
+                             .start     = chunk_start,
+                             .end       = chunk_end,
+                             .partcount = threadcount,
+                             .max_chain = max_chain,
+                             .seed      = seed,
+                             .utf8      = utf8};
+    chunk_start = chunk_end;
+    start_thread(&threads[t], count_chunk, &chunks[t]);
+  }
+  for (size_t t = 0; t < threadcount; ++t) pthread_join(threads[t], NULL);
+  free(threads);
+  return chunks;
+}
+
+wc_part* wc_merge(wc_chunk* chunks, size_t threadcount, size_t limit) {
+  pthread_t* threads = create_threads(threadcount);
+  wc_part*   parts   = malloc(threadcount * sizeof(wc_part));
+  if (!parts) {
+    perror("malloc parts");
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t p = 0; p < threadcount; ++p) {
+    parts[p] = (wc_part){.chunks     = chunks,
+                         .chunkcount = threadcount,
+                         .part       = p,
+                         .limit      = limit};
+    start_thread(&threads[p], merge_part, &parts[p]);
+  }
+  for (size_t p = 0; p < threadcount; ++p) pthread_join(threads[p], NULL);
+  for (size_t t = 0; t < threadcount; ++t) {
+    free(chunks[t].items);
+    free(chunks[t].offsets);
+    ht_free(chunks[t].table);
+  }
+  free(chunks);
+  free(threads);
+  return parts;
+}
+
+void wc_free_parts(wc_part* parts, size_t threadcount) {
+  for (size_t p = 0; p < threadcount; ++p) {
+    free(parts[p].top);
+    ht_free(parts[p].table);
+  }
+  free(parts);
+}
@@ -0,0 +1,61 @@
+// parallel word counting for topwords -j. The mapped input is split into one
+// chunk per thread, with chunk boundaries moved forward to the start of a
+// word. Each thread counts its chunk into its own table, with no locking,
+// then groups its items by merge partition. The tables are merged in
+// parallel: merge thread p takes partition p from every table, so each word
+// is merged by exactly one thread.
+#pragma once
+
+#include "hashtable.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// words come from the input, so the tables counting them hash under a
+// random seed, and move to SipHash should the input pile words into one
+// chain, see ht_set_max_chain
+#define WC_MAX_CHAIN 64
+
+typedef struct wc_chunk wc_chunk;
+struct wc_chunk {
+  const char*       map;
+  size_t            start;
+  size_t            end;
+  size_t            partcount;
+  size_t            max_chain; // of every table
+  uint64_t          seed;      // of every count table
+  bool              utf8;
+  hash_table*       table;   // out
+  hash_table_item** items;   // out: items of table, grouped by partition
+  size_t*           offsets; // out: partition p is items[offsets[p], [p + 1])
+};
+
+typedef struct wc_part wc_part;
+struct wc_part {
+  wc_chunk*         chunks; // one per count thread
+  size_t            chunkcount;
+  size_t            part;
+  size_t            limit;
+  hash_table*       table;    // out
+  hash_table_item** top;      // out: top limit items of table
+  size_t            topcount; // out
+  size_t            wordcnt;  // out: total of the counts in table
+};
+
+// orders items by descending count, for ht_top_k and qsort
+int wc_cmp_items(const void* a, const void* b);
+
+// the total of all counts
+size_t wc_sum_values(const hash_table* ht);
+
+// counts the words of map[0, size) on threadcount threads, into one chunk
+// each, which wc_merge takes
+wc_chunk* wc_count(const char* map, size_t size, bool utf8,
+                   size_t threadcount, size_t max_chain);
+
+// merges the chunks on threadcount threads, into one partition each, and
+// frees them. The partitions hold disjoint words, so the overall top items
+// are the top of their top items
+wc_part* wc_merge(wc_chunk* chunks, size_t threadcount, size_t limit);
+
+void wc_free_parts(wc_part* parts, size_t threadcount);
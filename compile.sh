@@ -6,4 +6,17 @@ cd "$(dirname $(realpath $0))"
 cmake -DCMAKE_BUILD_TYPE=Release -B build -S . && \
     cmake --build build -- -j8 && \
     ./build/tests/test_hashtable && \
+    ./build/tests/test_hashtable_oa && \
+    ./build/tests/test_hashtable_tmpl && \
+    ./build/tests/test_hashtable_sharded && \
+    ./build/tests/test_hashtable_mapped && \
+    ./build/tests/test_hashtable_frozen && \
+    ./build/tests/test_hashtable_approx && \
+    ./build/tests/test_hashtable_rcu && \
+    ./build/tests/test_hashtable_spill && \
+    ./build/tests/test_hashtable_alloc && \
+    ./build/tests/test_hashtable_intern && \
+    ./build/tests/test_reader && \
+    ./build/tests/test_tokenizer && \
+    ./build/tests/test_wordcount && \
     ./build/bin/topwords ./data/shakespeare.txt 10
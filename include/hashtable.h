@@ -1,29 +1,152 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 typedef char* ht_key_t;
 typedef int   ht_value_t;
 
+// keys shorter than this are stored inside the item, without a separate
+// allocation. The default makes an item 56 bytes, ie one 64 byte malloc chunk
+#ifndef HT_INLINE_KEY
+#define HT_INLINE_KEY 20
+#endif
+
+// counting of resizes and their time, see ht_stats. Costs a clock read per
+// stop-the-world resize. -DHT_STATS=0 compiles the counting out, the counters
+// then stay 0
+#ifndef HT_STATS
+#define HT_STATS 1
+#endif
+
 // key => value plus pointer to next item for hash collisions
+// the full hash of the key is kept so rehashing never touches key bytes
+// and mismatches are rejected without comparing keys
+// keys are stored NUL terminated, keylen excludes the terminator. key points
+// at inline_key when keylen < HT_INLINE_KEY, otherwise at a separate copy
 typedef struct hash_table_item hash_table_item;
 struct hash_table_item {
   ht_key_t         key;
   ht_value_t       value;
+  uint32_t         keylen;
+  uint64_t         hash;
   hash_table_item* next;
+  uint32_t         entry; // index in the table's entries
+  char             inline_key[HT_INLINE_KEY];
+};
+
+// when a table resizes, see ht_set_policy. Chaining copes with loads above
+// 1, at the cost of longer chains
+typedef struct ht_policy ht_policy;
+struct ht_policy {
+  double   max_load;  // grow once itemcount > max_load * size
+  double   min_load;  // halve once itemcount < min_load * size
+  unsigned growth;    // size multiplier when growing, a power of 2
+  bool     no_shrink; // never shrink, eg for tables refilled after deletes
+};
+
+#define HT_POLICY_DEFAULT                                                      \
+  ((ht_policy){                                                                \
+      .max_load = 0.8, .min_load = 0.2, .growth = 2, .no_shrink = false})
+
+// slab pages for items and a bump arena for key bytes, see ht_create_pooled
+typedef struct ht_pool ht_pool;
+
+// where a table gets the memory for its slots, items, keys and pool pages,
+// see ht_set_allocator. alloc returns size bytes, zeroed if zero is set, or
+// NULL with errno set. free gets back the size that was asked for, so
+// backends that map memory can unmap it. A zeroed ht_allocator is malloc.
+// Built in backends are in hashtable_alloc.h
+typedef struct ht_allocator ht_allocator;
+struct ht_allocator {
+  void* (*alloc)(void* ctx, size_t size, bool zero);
+  void (*free)(void* ctx, void* ptr, size_t size);
+  void* ctx;
 };
 
 // Array of pointers to HashTableItems, plus counters
+// During an incremental resize the previous slots are kept alongside and a
+// few of them are migrated into the new ones on every insert or delete
+// The items are also kept in a dense array of entries in insertion order, so
+// iteration and flat views are a sequential sweep of it, with none of the
+// empty slots or chains in between. Deletes leave a NULL hole in the
+// entries, which are compacted on rehash, or when they run out
 typedef struct hash_table hash_table;
 struct hash_table {
-  hash_table_item** slots;     // hash slots into which items are filled
-  size_t            size;      // how many slots exist
-  size_t            itemcount; // how many items exist
+  hash_table_item** slots;       // hash slots into which items are filled
+  size_t            size;        // how many slots exist
+  size_t            itemcount;   // how many items exist
+  hash_table_item** entries;     // items in insertion order, NULL if deleted
+  size_t            entrycount;  // how many entries are used, incl deleted
+  size_t            entrycap;    // how many entries are allocated
+  ht_pool*          pool;        // NULL => items and keys are malloc'd singly
+  hash_table_item** old_slots;   // slots being migrated from, or NULL
+  size_t            old_size;    // how many old_slots exist, 0 if none
+  size_t            migrated;    // old_slots [0, migrated) are now empty
+  bool              incremental; // resize by migrating, see ht_set_incremental
+  ht_policy         policy;      // see ht_set_policy
+  size_t            grow_at;     // grow when itemcount exceeds this
+  size_t            shrink_at;   // shrink when itemcount drops below this
+  size_t            rehashes;    // resizes started, see HT_STATS
+  uint64_t          rehash_ns;   // time spent in stop-the-world resizes
+  ht_allocator      allocator;   // see ht_set_allocator
+  uint64_t          seed;        // of the hash, see ht_set_seed
+  bool              sip;         // hashing with SipHash, see ht_set_max_chain
+  uint64_t          sipkey;      // with seed, the 128 bit SipHash key
+  size_t            max_chain;   // 0 => no limit, see ht_set_max_chain
+  size_t            reseeds;     // switches to SipHash
 };
 
 hash_table* ht_create(size_t size);
+hash_table* ht_create_pooled(size_t size);
+void        ht_set_incremental(hash_table* table, bool incremental);
 void        ht_free(hash_table* table);
 
+// the allocator of tables created from now on, NULL for malloc. Not thread
+// safe, set it before creating any tables
+void ht_set_default_allocator(const ht_allocator* allocator);
+
+// moves an empty table onto allocator, NULL for malloc. Returns false,
+// leaving the table as is, if it holds items or pool pages
+bool ht_set_allocator(hash_table* table, const ht_allocator* allocator);
+
+// Returns false, leaving the table as is, if the policy could resize back
+// and forth: it needs max_load > 0, growth >= 2 and, unless no_shrink,
+// min_load below both max_load / growth and max_load / 2. Takes effect from
+// the next insert or delete
+bool ht_set_policy(hash_table* table, ht_policy policy);
+
+// Keys are hashed with ht_hash_bytes (see hashtable_hash.h) by default, so
+// anyone who chooses the keys can find keys that collide, and make lookups
+// walk one long chain. A seeded table hashes with wyhash under the seed
+// instead, rehashing all its items now, and seed 0 goes back to the
+// default. ht_random_seed returns a random, non zero, seed
+void     ht_set_seed(hash_table* table, uint64_t seed);
+uint64_t ht_random_seed(void);
+
+// Seeded wyhash still has keys that collide whatever the seed. Once an
+// insert makes a chain longer than max_chain items, the table takes that as
+// an attack and moves, for good, to SipHash under a new random 128 bit key,
+// rehashing all its items. The default 0 never checks. Chains are rarely
+// longer than about 10 items at the default policy, but grow with max_load
+void ht_set_max_chain(hash_table* table, size_t max_chain);
+
+// the hash of item by ht_hash_bytes, which other table kinds use. That is
+// item->hash, unless the table is seeded
+uint64_t ht_item_hash_bytes(const hash_table*      table,
+                            const hash_table_item* item);
+
+// makes room for n items without growing. Deletes may shrink the table
+// again, unless the policy is no_shrink
+void ht_reserve(hash_table* table, size_t n);
+
+// a new table holding keys[i] => values[i], sized once up front so loading
+// never rehashes. lens may be NULL for NUL terminated keys. Of duplicate keys
+// the last value wins
+hash_table* ht_build_from_arrays(const ht_key_t* keys, const size_t* lens,
+                                 const ht_value_t* values, size_t n);
+
 hash_table_item* ht_insert(hash_table* restrict table, ht_key_t key,
                            ht_value_t value);
 
@@ -37,18 +160,117 @@ hash_table_item* ht_get_or_create(hash_table* restrict table, ht_key_t key,
 hash_table_item* ht_inc(hash_table* restrict table, ht_key_t key);
 hash_table_item* ht_dec(hash_table* restrict table, ht_key_t key);
 
+// length delimited variants of the above. key need not be NUL terminated,
+// and is hashed and compared in place. Storing a key longer than UINT32_MAX
+// bytes exits
+hash_table_item* ht_insert_n(hash_table* restrict table, const char* key,
+                             size_t len, ht_value_t value);
+
+void ht_delete_n(hash_table* restrict table, const char* key, size_t len);
+
+hash_table_item* ht_get_n(const hash_table* restrict table, const char* key,
+                          size_t len);
+
+hash_table_item* ht_get_or_create_n(hash_table* restrict table,
+                                    const char* key, size_t len,
+                                    ht_value_t value);
+
+hash_table_item* ht_inc_n(hash_table* restrict table, const char* key,
+                          size_t len);
+hash_table_item* ht_dec_n(hash_table* restrict table, const char* key,
+                          size_t len);
+
+// variants of the above for a key already hashed, with hash =
+// ht_hash_bytes(key, len), so a caller that also needs the hash, like the
+// sharded table, hashes it once. Used as is when the table is unseeded, a
+// seeded table hashes the key itself
+hash_table_item* ht_insert_h(hash_table* restrict table, const char* key,
+                             size_t len, uint64_t hash, ht_value_t value);
+
+void ht_delete_h(hash_table* restrict table, const char* key, size_t len,
+                 uint64_t hash);
+
+hash_table_item* ht_get_h(const hash_table* restrict table, const char* key,
+                          size_t len, uint64_t hash);
+
+hash_table_item* ht_get_or_create_h(hash_table* restrict table,
+                                    const char* key, size_t len,
+                                    uint64_t hash, ht_value_t value);
+
+hash_table_item* ht_inc_h(hash_table* restrict table, const char* key,
+                          size_t len, uint64_t hash);
+hash_table_item* ht_dec_h(hash_table* restrict table, const char* key,
+                          size_t len, uint64_t hash);
+
+// batched variants, the same as calling the above on each key in order but
+// with the memory accesses of several keys overlapped. lens may be NULL for
+// NUL terminated keys. items receives the result for each key, and may be
+// NULL for insert and inc
+void ht_insert_batch(hash_table* restrict table, const ht_key_t* keys,
+                     const size_t* lens, const ht_value_t* values,
+                     size_t count, hash_table_item** items);
+void ht_get_batch(const hash_table* restrict table, const ht_key_t* keys,
+                  const size_t* lens, size_t count, hash_table_item** items);
+void ht_inc_batch(hash_table* restrict table, const ht_key_t* keys,
+                  const size_t* lens, size_t count, hash_table_item** items);
+
 hash_table_item* ht_rehash(hash_table* restrict table, size_t new_size,
                            hash_table_item* restrict old_item);
 
+// a malloc'd copy of the entries without their holes, itemcount items in
+// insertion order
 hash_table_item** ht_create_flat_view(const hash_table* restrict table);
 
+// the table's own entries, in insertion order, compacting them first if
+// there were deletes. Valid until the next insert or delete
+hash_table_item** ht_items(hash_table* restrict table);
+
+// ranks items for ht_top_k, as for qsort on a flat view: gets two
+// hash_table_item** and returns < 0 if the first ranks before the second
+typedef int (*ht_item_cmp)(const void* a, const void* b);
+
+// the k best items by cmp, best first, in a malloc'd array of *count items
+hash_table_item** ht_top_k(const hash_table* restrict table, size_t k,
+                           ht_item_cmp cmp, size_t* count);
+hash_table_item** ht_top_k_parallel(const hash_table* restrict table,
+                                    size_t k, ht_item_cmp cmp,
+                                    size_t threadcount, size_t* count);
+
 void ht_print(const hash_table* restrict table);
 
+// chain lengths >= HT_STATS_CHAINS - 1 share the last histogram bucket
+#define HT_STATS_CHAINS 16
+
+// a snapshot of a table's shape and memory use, see ht_stats. During an
+// incremental resize the slots not yet migrated count alongside the new ones
+typedef struct hash_table_stats hash_table_stats;
+struct hash_table_stats {
+  size_t   size;
+  size_t   itemcount;
+  size_t   slots;       // slots in use, size plus any not yet migrated
+  size_t   empty_slots; // of slots
+  size_t   max_chain;
+  size_t   chains[HT_STATS_CHAINS]; // slots by chain length
+  double   probes_hit;  // mean items visited by a successful lookup
+  double   probes_miss; // mean items visited by an unsuccessful lookup
+  size_t   rehashes;    // see HT_STATS
+  uint64_t rehash_ns;
+  size_t   slot_bytes;  // allocated for slots, entries, items and keys, not
+  size_t   entry_bytes; // counting allocator overhead. Pooled tables count
+  size_t   item_bytes;  // whole pages, including deleted items and keys
+  size_t   key_bytes;
+  size_t   total_bytes;
+};
+
+// walks every slot, so costs more than iterating the table
+void ht_stats(const hash_table* restrict table, hash_table_stats* stats);
+void ht_print_stats(const hash_table_stats* stats);
+
 typedef struct hash_table_iterator hash_table_iterator;
 struct hash_table_iterator {
   const hash_table* table;
   hash_table_item*  item;
-  size_t            slotidx;
+  size_t            entryidx;
 };
 
 hash_table_iterator* ht_create_iter(const hash_table* restrict table);
@@ -0,0 +1,32 @@
+// built in allocators for hash_table, see ht_set_allocator.
+//
+// A lookup in a large table is a random access into its slots, and once
+// those span gigabytes much of its cost is the TLB miss, and on a machine
+// with several sockets, memory attached to the other socket. The allocators
+// here map large allocations, such as the slots of big tables, in 2 MB
+// aligned blocks advised with MADV_HUGEPAGE, so transparent huge pages can
+// back them with a TLB entry per 2 MB rather than per 4 KB, and can bind
+// mapped memory to one NUMA node, for tables used by threads on that node.
+//
+// Smaller allocations come from malloc and free, so items and keys are only
+// placed on the node for pooled tables, whose 64 KB pages are mapped.
+#pragma once
+
+#include "hashtable.h"
+
+#define HT_HUGE_PAGE (2 * 1024 * 1024)
+
+// ht_allocator_numa maps allocations from this many bytes, and bigger
+#define HT_NUMA_MAP_MIN (64 * 1024)
+
+// nodes [0, HT_NUMA_NODES) can be bound to
+#define HT_NUMA_NODES 1024
+
+// maps allocations of HT_HUGE_PAGE bytes and more in huge pages
+extern const ht_allocator ht_allocator_huge;
+
+// as ht_allocator_huge, and also maps allocations of HT_NUMA_MAP_MIN bytes
+// and more, with all mapped memory bound to node by mbind(2). Allocations
+// fail, with errno set, if the memory can't be bound, eg with ENOSYS where
+// there is no NUMA support or EINVAL if there is no such node
+ht_allocator ht_allocator_numa(int node);
@@ -0,0 +1,83 @@
+// approximate counting in a fixed memory budget, for streams with too many
+// distinct keys to count exactly. Memory is allocated once, by ht_ap_create,
+// and never grows, so there are no rehash pauses either.
+//
+// Counts come from a conservative update Count-Min sketch: depth rows of
+// width counters, each key adding to one counter per row and reading as the
+// smallest of them. An estimate is never below the true count, and with
+// probability 1 - e^-depth at most e * total / width above it, see
+// ht_ap_error.
+//
+// The top keys are kept in a Space-Saving summary of a fixed number of
+// candidates. A key not in the summary replaces the candidate with the
+// smallest count once its estimate exceeds that count. Every key whose true
+// count exceeds the smallest count in the summary is in the summary.
+//
+// Candidates are identified by hash and length. Keys of HT_AP_KEY bytes or
+// more are kept as their first HT_AP_KEY - 1 bytes.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HT_AP_KEY        32
+#define HT_AP_DEPTH      4            // sketch rows
+#define HT_AP_CONFIDENCE 0.9816843611 // 1 - e^-HT_AP_DEPTH, of ht_ap_error
+
+typedef struct ht_ap_candidate ht_ap_candidate;
+struct ht_ap_candidate {
+  uint64_t hash;
+  uint32_t count;   // the estimate when last seen
+  uint32_t keylen;  // of the whole key
+  uint32_t heapidx; // position in heap
+  char     key[HT_AP_KEY];
+};
+
+typedef struct hash_table_approx hash_table_approx;
+struct hash_table_approx {
+  uint32_t*        sketch; // HT_AP_DEPTH rows of width
+  size_t           width;  // power of 2
+  ht_ap_candidate* candidates;
+  uint32_t*        heap;  // candidate indices, a min heap by count
+  uint32_t*        index; // hash => candidate index + 1, 0 for empty
+  size_t           capacity;
+  size_t           count;     // candidates in use
+  size_t           indexsize; // power of 2, >= 2 * capacity
+  uint64_t         total;     // of all increments
+};
+
+// a top key, by ht_ap_top_k
+typedef struct ht_ap_item ht_ap_item;
+struct ht_ap_item {
+  const char* key; // NUL terminated, truncated to HT_AP_KEY - 1 bytes
+  size_t      keylen;
+  uint64_t    count; // upper bound on the true count
+};
+
+// uses about bytes of memory, split evenly between sketch and summary. The
+// smallest budgets are raised to a minimum of a few KB
+hash_table_approx* ht_ap_create(size_t bytes);
+void               ht_ap_free(hash_table_approx* approx);
+
+// counts one occurrence of key. Returns its new estimate. Counts saturate at
+// UINT32_MAX. Counting a key longer than UINT32_MAX bytes exits
+uint32_t ht_ap_inc(hash_table_approx* approx, const char* key);
+uint32_t ht_ap_inc_n(hash_table_approx* approx, const char* key, size_t len);
+
+// the estimated count of a key, >= its true count
+uint32_t ht_ap_estimate(const hash_table_approx* approx, const char* key,
+                        size_t len);
+
+// the k candidates with the highest estimates, best first, in a malloc'd
+// array of *count items. Keys point into approx, so are valid until the
+// next inc
+ht_ap_item* ht_ap_top_k(const hash_table_approx* approx, size_t k,
+                        size_t* count);
+
+// the bound on how far an estimate may be above the true count, which holds
+// with probability HT_AP_CONFIDENCE
+double ht_ap_error(const hash_table_approx* approx);
+
+// bytes allocated, for comparison with the budget
+size_t ht_ap_bytes(const hash_table_approx* approx);
@@ -0,0 +1,82 @@
+// an immutable table for read only serving, built from a hash_table by
+// ht_freeze. Keys are placed with a minimal perfect hash, PTHash style: the
+// cached hash of a key picks a bucket, and each bucket has a pilot, searched
+// for at build time, which sends all its keys to distinct free entries. So
+// the entries are packed with none empty, and a lookup reads one pilot and
+// one entry, compares one key and is done, hit or miss.
+//
+// Keys are first split into partitions of about HT_FZ_PART_KEYS, each with
+// its own perfect hash onto its own range of entries. Partitions are built
+// independently, in parallel with ht_freeze_parallel, and each build works
+// within cache. The result doesn't depend on the number of threads.
+#pragma once
+
+#include "hashtable.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HT_FZ_PART_KEYS (64 * 1024)
+
+// mean keys per bucket. Fewer pilots against a longer search for them, which
+// grows steeply above ~5 as there is no slack among the entries
+#define HT_FZ_BUCKET_KEYS 4
+
+// keys shorter than this are stored in the entry, in place of key_offset, so
+// a lookup of them touches no key bytes elsewhere
+#define HT_FZ_INLINE_KEY 8
+
+typedef struct ht_fz_part ht_fz_part;
+struct ht_fz_part {
+  uint64_t offset;  // of its first entry
+  uint64_t pilots;  // of its first pilot
+  uint32_t count;   // entries
+  uint32_t buckets; // pilots
+};
+
+typedef struct ht_fz_entry ht_fz_entry;
+struct ht_fz_entry {
+  union {
+    uint64_t key_offset; // into keys
+    char     inline_key[HT_FZ_INLINE_KEY];
+  };
+  uint32_t   keylen;
+  ht_value_t value;
+};
+
+typedef struct hash_table_frozen hash_table_frozen;
+struct hash_table_frozen {
+  size_t       itemcount;
+  size_t       partcount;
+  ht_fz_part*  parts;
+  uint32_t*    pilots;
+  ht_fz_entry* entries; // itemcount, in perfect hash order
+  char*        keys;    // the longer keys, NUL terminated, in entry order
+  size_t       keybytes;
+};
+
+// the NUL terminated key of an entry
+static inline const char* ht_fz_entry_key(const hash_table_frozen* frozen,
+                                          const ht_fz_entry*       entry) {
+  return entry->keylen < HT_FZ_INLINE_KEY ? entry->inline_key
+                                          : frozen->keys + entry->key_offset;
+}
+
+// Returns NULL, with errno EINVAL, in the ~n^2 / 2^65 case of two keys with
+// the same 64 bit hash, which no perfect hash can separate. The table is
+// only read, and may be freed afterwards
+hash_table_frozen* ht_freeze(const hash_table* restrict table);
+hash_table_frozen* ht_freeze_parallel(const hash_table* restrict table,
+                                      size_t threadcount);
+void               ht_fz_free(hash_table_frozen* frozen);
+
+// Values are returned by copy
+bool ht_fz_get(const hash_table_frozen* frozen, ht_key_t key,
+               ht_value_t* value);
+bool ht_fz_get_n(const hash_table_frozen* frozen, const char* key, size_t len,
+                 ht_value_t* value);
+
+size_t ht_fz_itemcount(const hash_table_frozen* frozen);
+
+// bytes allocated for the whole frozen table
+size_t ht_fz_bytes(const hash_table_frozen* frozen);
@@ -0,0 +1,177 @@
+// hash functions for the hashtables. All take a key of len bytes, which need
+// not be NUL terminated, and return a full 64 bit hash.
+// The one used is selected at compile time with -DHT_HASH_FN=<function>,
+// which may also name a user supplied
+//   uint64_t fn(const char* key, size_t len);
+// declared before this header is included
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef HT_HASH_FN
+#define HT_HASH_FN ht_hash_wyhash
+#endif
+
+// FNV-1a, one byte at a time. Simple and good for very short keys
+// https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function#FNV-1a_hash
+static inline uint64_t ht_hash_fnv1a(const char* restrict key, size_t len) {
+  uint64_t hash = 0xcbf29ce484222325; // FNV_offset_basis
+  for (size_t i = 0; i < len; i++)
+    hash = (hash ^ (uint8_t)key[i]) * 0x100000001b3; // FNV_prime
+  return hash;
+}
+
+// wyhash, which consumes 8 or 16 bytes per step and mixes with a 64x64=>128
+// bit multiply. Much faster than FNV-1a on keys beyond a few words.
+// https://github.com/wangyi-fudan/wyhash (final version 4)
+
+// 64x64 => 128 bit multiply, low half into a, high half into b
+static inline void ht_wymum(uint64_t* a, uint64_t* b) {
+#ifdef __SIZEOF_INT128__
+  __extension__ typedef unsigned __int128 u128;
+  u128 r = (u128)*a * *b;
+  *a     = (uint64_t)r;
+  *b     = (uint64_t)(r >> 64);
+#else
+  uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32), c = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  c += lo < t;
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t ht_wymix(uint64_t a, uint64_t b) {
+  ht_wymum(&a, &b);
+  return a ^ b;
+}
+
+// unaligned reads. The hash is defined on little endian values, big endian
+// machines get a different, equally good, hash
+static inline uint64_t ht_wyr8(const char* p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+static inline uint64_t ht_wyr4(const char* p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+static inline uint64_t ht_wyr3(const char* p, size_t len) {
+  return ((uint64_t)(uint8_t)p[0] << 16) |
+         ((uint64_t)(uint8_t)p[len >> 1] << 8) | (uint8_t)p[len - 1];
+}
+
+// wyhash under a seed, seed 0 being ht_hash_wyhash. The seed moves keys
+// around, but is no protection against keys chosen to collide: some inputs
+// collide under every seed, see ht_hash_siphash
+static inline uint64_t ht_hash_wyhash_seeded(const char* restrict key,
+                                             size_t len, uint64_t seed) {
+  static const uint64_t s[4] = {0x2d358dccaa6c78a5, 0x8bb84b93962eacc9,
+                                0x4b33a62ed433d4a3, 0x4d5a2da51de1aa47};
+
+  const char* p = key;
+  uint64_t    a, b;
+  seed ^= ht_wymix(seed ^ s[0], s[1]);
+  if (len <= 16) {
+    if (len >= 4) {
+      a = (ht_wyr4(p) << 32) | ht_wyr4(p + ((len >> 3) << 2));
+      b = (ht_wyr4(p + len - 4) << 32) |
+          ht_wyr4(p + len - 4 - ((len >> 3) << 2));
+    } else if (len > 0) {
+      a = ht_wyr3(p, len);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i >= 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = ht_wymix(ht_wyr8(p) ^ s[1], ht_wyr8(p + 8) ^ seed);
+        see1 = ht_wymix(ht_wyr8(p + 16) ^ s[2], ht_wyr8(p + 24) ^ see1);
+        see2 = ht_wymix(ht_wyr8(p + 32) ^ s[3], ht_wyr8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i >= 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = ht_wymix(ht_wyr8(p) ^ s[1], ht_wyr8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = ht_wyr8(p + i - 16);
+    b = ht_wyr8(p + i - 8);
+  }
+  a ^= s[1];
+  b ^= seed;
+  ht_wymum(&a, &b);
+  return ht_wymix(a ^ s[0] ^ len, b ^ s[1]);
+}
+
+static inline uint64_t ht_hash_wyhash(const char* restrict key, size_t len) {
+  return ht_hash_wyhash_seeded(key, len, 0);
+}
+
+// SipHash-2-4, a keyed hash that is a cryptographic PRF: without the 128 bit
+// key, colliding keys can't be found any faster than by trying. Several
+// times slower than wyhash, so used only by tables under attack, see
+// ht_set_max_chain. https://www.aumasson.jp/siphash/siphash.pdf
+#define HT_SIP_ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+static inline void ht_sipround(uint64_t v[4]) {
+  v[0] += v[1];
+  v[1] = HT_SIP_ROTL(v[1], 13) ^ v[0];
+  v[0] = HT_SIP_ROTL(v[0], 32);
+  v[2] += v[3];
+  v[3] = HT_SIP_ROTL(v[3], 16) ^ v[2];
+  v[0] += v[3];
+  v[3] = HT_SIP_ROTL(v[3], 21) ^ v[0];
+  v[2] += v[1];
+  v[1] = HT_SIP_ROTL(v[1], 17) ^ v[2];
+  v[2] = HT_SIP_ROTL(v[2], 32);
+}
+
+static inline uint64_t ht_hash_siphash(const char* restrict key, size_t len,
+                                       uint64_t k0, uint64_t k1) {
+  uint64_t v[4] = {k0 ^ 0x736f6d6570736575, k1 ^ 0x646f72616e646f6d,
+                   k0 ^ 0x6c7967656e657261, k1 ^ 0x7465646279746573};
+  const char* end = key + (len & ~(size_t)7);
+  for (const char* p = key; p != end; p += 8) {
+    uint64_t m = ht_wyr8(p); // little endian, as for wyhash
+    v[3] ^= m;
+    ht_sipround(v);
+    ht_sipround(v);
+    v[0] ^= m;
+  }
+  uint64_t m = (uint64_t)len << 56; // the last 0 to 7 bytes, and the length
+  for (size_t i = 0; i < (len & 7); i++)
+    m |= (uint64_t)(uint8_t)end[i] << 8 * i;
+  v[3] ^= m;
+  ht_sipround(v);
+  ht_sipround(v);
+  v[0] ^= m;
+  v[2] ^= 0xff;
+  for (int i = 0; i < 4; i++) ht_sipround(v);
+  return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
+// the selected hash function
+static inline uint64_t ht_hash_bytes(const char* restrict key, size_t len) {
+  return HT_HASH_FN(key, len);
+}
+
+// hash for integer keys, up to 64 bits. One multiply based mix, so that
+// sequential keys spread over the whole table
+static inline uint64_t ht_hash_u64(uint64_t key) {
+  return ht_wymix(key ^ 0x2d358dccaa6c78a5, 0x8bb84b93962eacc9);
+}
@@ -0,0 +1,58 @@
+// string interning: each distinct key gets a dense uint32_t id, 0, 1, 2, ...
+// in order of first sight, which it keeps for the life of the table. What
+// else is known about a key can then be held in plain arrays indexed by id,
+// so a key is hashed and compared once, by ht_intern, and later passes are
+// array indexing.
+//
+// Key bytes are kept back to back, each NUL terminated, in one string pool,
+// and found through an offset per id. The index is open addressing with
+// linear probing. Each slot holds an id and the high half of its key's hash,
+// so probing rejects almost all mismatches without reading the pool. Keys
+// can't be removed.
+//
+// Keys usually come from the input, so the index hashes with wyhash under a
+// random seed of its own, see ht_set_seed, and whoever picks the keys can't
+// aim them at one probe sequence.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HT_INTERN_NONE UINT32_MAX // not an id, see ht_intern_find
+
+typedef struct ht_intern_slot ht_intern_slot;
+struct ht_intern_slot {
+  uint32_t ref;  // id + 1, 0 for an empty slot
+  uint32_t hash; // the high 32 bits of the key's
+};
+
+typedef struct hash_table_intern hash_table_intern;
+struct hash_table_intern {
+  ht_intern_slot* slots;
+  size_t          size;     // how many slots exist, a power of 2
+  size_t          count;    // ids handed out
+  size_t*         offsets;  // of each id's key in pool, then the pool's end
+  size_t          offcap;   // offsets allocated, at least count + 1
+  char*           pool;     // key bytes
+  size_t          poolsize; // bytes in use
+  size_t          poolcap;  // bytes allocated
+  uint64_t        seed;     // of the index's hash, random
+};
+
+// a table for about size keys before it grows
+hash_table_intern* ht_intern_create(size_t size);
+void               ht_intern_free(hash_table_intern* table);
+
+// the id of key, interning it first if it's new
+uint32_t ht_intern(hash_table_intern* table, const char* key);
+uint32_t ht_intern_n(hash_table_intern* table, const char* key, size_t len);
+
+// the id of key if it is interned, else HT_INTERN_NONE
+uint32_t ht_intern_find(const hash_table_intern* table, const char* key);
+uint32_t ht_intern_find_n(const hash_table_intern* table, const char* key,
+                          size_t len);
+
+// the NUL terminated key of id, in the pool. Valid until the next ht_intern,
+// which may move the pool as it grows
+const char* ht_key_of(const hash_table_intern* table, uint32_t id);
+size_t      ht_keylen_of(const hash_table_intern* table, uint32_t id);
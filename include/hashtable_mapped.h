@@ -0,0 +1,87 @@
+// a read only hash_table snapshot, saved with ht_save and mmap'ed back with
+// ht_open_mapped. Opening reads only the header, lookups are answered from
+// the mapping without parsing or allocating. The first write promotes it to
+// an ordinary hash_table, which then holds all the data.
+//
+// File layout, all offsets from the start of the file and all integers in
+// host byte order, so a file is only portable between hosts of the same byte
+// order and hash function (see hashtable_hash.h), both of which are checked:
+//
+//   ht_mp_header
+//   uint64_t     buckets[bucketcount + 1]  bucket b is entries[buckets[b],
+//                                          buckets[b + 1]), b = hash & mask
+//   ht_mp_entry  entries[itemcount]
+//   char         keys[keybytes]            NUL terminated, back to back
+#pragma once
+
+#include "hashtable.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HT_MP_MAGIC   "HTMAPPED"
+#define HT_MP_VERSION 1
+
+typedef struct ht_mp_header ht_mp_header;
+struct ht_mp_header {
+  char     magic[8];
+  uint32_t version;
+  uint32_t byte_order; // 0x01020304 as written
+  uint64_t hash_check; // hash of HT_MP_MAGIC with the writer's hash function
+  uint64_t itemcount;
+  uint64_t bucketcount; // power of 2
+  uint64_t keybytes;
+  uint64_t buckets_offset;
+  uint64_t entries_offset;
+  uint64_t keys_offset;
+};
+
+typedef struct ht_mp_entry ht_mp_entry;
+struct ht_mp_entry {
+  uint64_t   hash;
+  uint64_t   key_offset; // into keys
+  uint32_t   keylen;
+  ht_value_t value;
+};
+
+typedef struct hash_table_mapped hash_table_mapped;
+struct hash_table_mapped {
+  const ht_mp_header* header; // the mapping, NULL once promoted
+  size_t              maplen;
+  const uint64_t*     buckets;
+  const ht_mp_entry*  entries;
+  const char*         keys;
+  hash_table*         table; // NULL until promoted by the first write
+};
+
+// Returns false, with errno set, if the file can't be written
+bool ht_save(const hash_table* restrict table, const char* path);
+
+// Returns NULL, with errno set, if path can't be mapped or is not a valid
+// snapshot for this build (EINVAL)
+hash_table_mapped* ht_open_mapped(const char* path);
+void               ht_mp_close(hash_table_mapped* map);
+
+// reads don't promote. Values are returned by copy. A lookup that runs into
+// a corrupt bucket or key returns false with errno set to EINVAL
+bool ht_mp_get(const hash_table_mapped* map, ht_key_t key, ht_value_t* value);
+bool ht_mp_get_n(const hash_table_mapped* map, const char* key, size_t len,
+                 ht_value_t* value);
+
+size_t ht_mp_itemcount(const hash_table_mapped* map);
+
+// writes promote to a hash_table first. inc and dec return the new value
+void       ht_mp_insert(hash_table_mapped* map, ht_key_t key, ht_value_t value);
+void       ht_mp_delete(hash_table_mapped* map, ht_key_t key);
+ht_value_t ht_mp_inc(hash_table_mapped* map, ht_key_t key);
+ht_value_t ht_mp_dec(hash_table_mapped* map, ht_key_t key);
+
+void ht_mp_insert_n(hash_table_mapped* map, const char* key, size_t len,
+                    ht_value_t value);
+void ht_mp_delete_n(hash_table_mapped* map, const char* key, size_t len);
+ht_value_t ht_mp_inc_n(hash_table_mapped* map, const char* key, size_t len);
+ht_value_t ht_mp_dec_n(hash_table_mapped* map, const char* key, size_t len);
+
+// the promoted hash_table, promoting now if need be, for the full API. It
+// remains owned by map
+hash_table* ht_mp_table(hash_table_mapped* map);
@@ -0,0 +1,101 @@
+// an open addressing hashtable, probed a group of control bytes at a time
+// (Swiss table style). Same semantics as hash_table, different memory layout.
+//
+// Items are kept apart from the slots, compact dict style: each slot holds a
+// control byte and the index of an entry, and the entries are a dense array
+// in insertion order. So iteration and flat views are a sequential sweep of
+// the entries, in insertion order, with none of the empty slots in between.
+// Deletes leave a hole in the entries, which rehash compacts.
+#pragma once
+
+#include "hashtable.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define HT_OA_GROUP 16 // slots probed together, one SSE2 register of ctrl bytes
+
+// key => value, stored directly in the entry array. Pointers to items are
+// only valid until the next insert or delete, which may move them
+// keys are stored NUL terminated, keylen excludes the terminator
+typedef struct hash_table_oa_item hash_table_oa_item;
+struct hash_table_oa_item {
+  ht_key_t   key; // NULL for a deleted entry
+  ht_value_t value;
+  uint32_t   keylen;
+};
+
+// One control byte per slot which is either empty, deleted (a tombstone) or
+// the lowest 7 bits of the key's hash, and for full slots the entry index
+typedef struct hash_table_oa hash_table_oa;
+struct hash_table_oa {
+  int8_t*             ctrl;       // control bytes, one per slot
+  uint32_t*           index;      // entry indices, one per slot
+  hash_table_oa_item* entries;    // items in insertion order, 7/8 of size
+  size_t              size;       // how many slots exist, multiple of group
+  size_t              entrycount; // how many entries are used, incl deleted
+  size_t              itemcount;  // how many items exist
+  size_t              tombstones; // how many deleted slots exist
+};
+
+hash_table_oa* ht_oa_create(size_t size);
+void           ht_oa_free(hash_table_oa* table);
+
+hash_table_oa_item* ht_oa_insert(hash_table_oa* restrict table, ht_key_t key,
+                                 ht_value_t value);
+
+void ht_oa_delete(hash_table_oa* restrict table, ht_key_t key);
+
+hash_table_oa_item* ht_oa_get(const hash_table_oa* restrict table,
+                              ht_key_t                      key);
+
+hash_table_oa_item* ht_oa_get_or_create(hash_table_oa* restrict table,
+                                        ht_key_t key, ht_value_t value);
+
+hash_table_oa_item* ht_oa_inc(hash_table_oa* restrict table, ht_key_t key);
+hash_table_oa_item* ht_oa_dec(hash_table_oa* restrict table, ht_key_t key);
+
+// length delimited variants of the above. key need not be NUL terminated,
+// and is hashed and compared in place. Storing a key longer than UINT32_MAX
+// bytes exits, as with hash_table
+hash_table_oa_item* ht_oa_insert_n(hash_table_oa* restrict table,
+                                   const char* key, size_t len,
+                                   ht_value_t value);
+
+void ht_oa_delete_n(hash_table_oa* restrict table, const char* key,
+                    size_t len);
+
+hash_table_oa_item* ht_oa_get_n(const hash_table_oa* restrict table,
+                                const char* key, size_t len);
+
+hash_table_oa_item* ht_oa_get_or_create_n(hash_table_oa* restrict table,
+                                          const char* key, size_t len,
+                                          ht_value_t value);
+
+hash_table_oa_item* ht_oa_inc_n(hash_table_oa* restrict table,
+                                const char* key, size_t len);
+hash_table_oa_item* ht_oa_dec_n(hash_table_oa* restrict table,
+                                const char* key, size_t len);
+
+void ht_oa_rehash(hash_table_oa* restrict table, size_t new_size);
+
+hash_table_oa_item**
+ht_oa_create_flat_view(const hash_table_oa* restrict table);
+
+// the items themselves, itemcount of them in insertion order. Compacts the
+// entries first if there were deletes. Valid until the next insert or delete
+hash_table_oa_item* ht_oa_items(hash_table_oa* restrict table);
+
+void ht_oa_print(const hash_table_oa* restrict table);
+
+typedef struct hash_table_oa_iterator hash_table_oa_iterator;
+struct hash_table_oa_iterator {
+  const hash_table_oa* table;
+  hash_table_oa_item*  item;
+  size_t               entryidx;
+};
+
+hash_table_oa_iterator* ht_oa_create_iter(const hash_table_oa* restrict table);
+void                ht_oa_free_iter(hash_table_oa_iterator* restrict iter);
+hash_table_oa_item* ht_oa_iter_reset(hash_table_oa_iterator* restrict iter);
+hash_table_oa_item* ht_oa_iter_current(hash_table_oa_iterator* restrict iter);
+hash_table_oa_item* ht_oa_iter_next(hash_table_oa_iterator* restrict iter);
@@ -0,0 +1,120 @@
+// a hashtable for one writer thread and many reader threads, where readers
+// take no locks and never wait for the writer.
+//
+// Slots are an open addressing array of item pointers, probed linearly. Keys
+// are immutable once an item is published and values are atomic, so readers
+// follow pointers with plain atomic loads. The writer never moves an item:
+// a delete replaces its pointer with a tombstone, and a resize builds a whole
+// new slot array, of the same items, and publishes it with a single store.
+//
+// What the writer unlinks, deleted items and old slot arrays, is reclaimed
+// epoch style. A reader announces the global epoch on entering a read
+// section and clears it on leaving. Each retired pointer is tagged with the
+// epoch it was retired in, and the writer frees it once no reader is still
+// in that epoch or an older one. A reader stuck in a read section delays
+// reclamation, never the writer. On Linux the fences between readers and
+// writer are left to the writer, with membarrier(2), so a read section costs
+// readers two plain stores. -DHT_RCU_NO_MEMBARRIER gives readers a fence of
+// their own instead.
+//
+// The writer functions must all be called from the same thread, or under a
+// lock of the caller's. Readers each need their own ht_rcu_reader.
+#pragma once
+
+#include "hashtable.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// retired pointers held before the writer tries to reclaim them
+#define HT_RCU_RETIRE_BATCH 64
+
+typedef struct ht_rcu_item ht_rcu_item;
+struct ht_rcu_item {
+  _Atomic ht_value_t value;
+  uint32_t           keylen;
+  uint64_t           hash;
+  char               key[]; // NUL terminated
+};
+
+typedef struct ht_rcu_slots ht_rcu_slots;
+struct ht_rcu_slots {
+  size_t                size; // power of 2
+  _Atomic(ht_rcu_item*) slots[];
+};
+
+typedef struct ht_rcu_retired ht_rcu_retired;
+struct ht_rcu_retired {
+  void*    ptr;
+  uint64_t epoch;
+};
+
+typedef struct hash_table_rcu hash_table_rcu;
+typedef struct ht_rcu_reader  ht_rcu_reader;
+
+// one per reader thread, on its own cache line as it is written on every
+// read section
+struct ht_rcu_reader {
+  _Alignas(64) _Atomic uint64_t epoch; // 0 outside a read section
+  unsigned        depth;               // of nested read sections
+  hash_table_rcu* table;
+  ht_rcu_reader*  next;
+};
+
+struct hash_table_rcu {
+  _Atomic(ht_rcu_slots*) slots;
+  size_t                 itemcount;  // the rest is the writer's
+  size_t                 tombstones; // slots of deleted items
+  ht_rcu_retired*        retired;    // waiting for readers to move on
+  size_t                 retiredcount;
+  size_t                 retiredsize;
+  _Alignas(64) _Atomic uint64_t epoch;      // starts at 1
+  bool                          membarrier; // the writer fences for readers
+  pthread_mutex_t               readerslock;
+  ht_rcu_reader*                readers;
+};
+
+// size is rounded up to a power of 2. No readers may be left at free
+hash_table_rcu* ht_rcu_create(size_t size);
+void            ht_rcu_free(hash_table_rcu* table);
+
+// writer functions. inc and dec return the new value. Storing a key longer
+// than UINT32_MAX bytes exits, as with hash_table
+void       ht_rcu_insert(hash_table_rcu* table, ht_key_t key, ht_value_t value);
+void       ht_rcu_delete(hash_table_rcu* table, ht_key_t key);
+ht_value_t ht_rcu_inc(hash_table_rcu* table, ht_key_t key);
+ht_value_t ht_rcu_dec(hash_table_rcu* table, ht_key_t key);
+
+void ht_rcu_insert_n(hash_table_rcu* table, const char* key, size_t len,
+                     ht_value_t value);
+void ht_rcu_delete_n(hash_table_rcu* table, const char* key, size_t len);
+ht_value_t ht_rcu_inc_n(hash_table_rcu* table, const char* key, size_t len);
+ht_value_t ht_rcu_dec_n(hash_table_rcu* table, const char* key, size_t len);
+
+// frees everything retired, first waiting for readers which may still hold
+// any of it to leave their read sections. Reclamation otherwise happens in
+// batches as the writer goes
+void ht_rcu_synchronize(hash_table_rcu* table);
+
+size_t ht_rcu_itemcount(const hash_table_rcu* table);
+
+// reader functions. A reader may be created and freed by any thread, and
+// used by one thread at a time
+ht_rcu_reader* ht_rcu_reader_create(hash_table_rcu* table);
+void           ht_rcu_reader_free(ht_rcu_reader* reader);
+
+// a read section, which may be nested. Items found in it stay valid until
+// it ends
+void ht_rcu_read_lock(ht_rcu_reader* reader);
+void ht_rcu_read_unlock(ht_rcu_reader* reader);
+
+// lookups in a read section of their own. Values are returned by copy
+bool ht_rcu_get(ht_rcu_reader* reader, ht_key_t key, ht_value_t* value);
+bool ht_rcu_get_n(ht_rcu_reader* reader, const char* key, size_t len,
+                  ht_value_t* value);
+
+// a lookup inside a read section, the item is valid until its end
+const ht_rcu_item* ht_rcu_find(ht_rcu_reader* reader, const char* key,
+                               size_t len);
@@ -0,0 +1,66 @@
+// a thread safe hashtable, partitioned into independently locked and
+// independently resized shards of hash_table. Keys are assigned to shards by
+// the high bits of their hash, the shard tables use the low bits for slots.
+#pragma once
+
+#include "hashtable.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// one shard per cache line, so locking one doesn't contend with its
+// neighbours
+typedef struct ht_shard ht_shard;
+struct ht_shard {
+  _Alignas(64) pthread_mutex_t lock;
+  hash_table* table;
+};
+
+typedef struct hash_table_sharded hash_table_sharded;
+struct hash_table_sharded {
+  ht_shard* shards;
+  size_t    shardcount; // power of 2
+  unsigned  shardshift; // shard index = hash >> shardshift
+};
+
+// shardcount is rounded up to a power of 2. size is the initial total size
+hash_table_sharded* ht_sh_create(size_t size, size_t shardcount);
+void                ht_sh_free(hash_table_sharded* table);
+
+// all of these are thread safe. Values are returned by copy, as items may be
+// changed or freed by other threads as soon as the shard lock is released
+void ht_sh_insert(hash_table_sharded* table, ht_key_t key, ht_value_t value);
+void ht_sh_delete(hash_table_sharded* table, ht_key_t key);
+bool ht_sh_get(hash_table_sharded* table, ht_key_t key, ht_value_t* value);
+ht_value_t ht_sh_inc(hash_table_sharded* table, ht_key_t key);
+ht_value_t ht_sh_dec(hash_table_sharded* table, ht_key_t key);
+
+void ht_sh_insert_n(hash_table_sharded* table, const char* key, size_t len,
+                    ht_value_t value);
+void ht_sh_delete_n(hash_table_sharded* table, const char* key, size_t len);
+bool ht_sh_get_n(hash_table_sharded* table, const char* key, size_t len,
+                 ht_value_t* value);
+ht_value_t ht_sh_inc_n(hash_table_sharded* table, const char* key, size_t len);
+ht_value_t ht_sh_dec_n(hash_table_sharded* table, const char* key, size_t len);
+
+size_t ht_sh_itemcount(hash_table_sharded* table);
+
+// a consistent copy of all items: every shard is locked while it's taken.
+// Keys point into the snapshot, which owns them
+typedef struct hash_table_sh_entry hash_table_sh_entry;
+struct hash_table_sh_entry {
+  const char* key;
+  uint32_t    keylen;
+  ht_value_t  value;
+};
+
+typedef struct hash_table_sh_snapshot hash_table_sh_snapshot;
+struct hash_table_sh_snapshot {
+  hash_table_sh_entry* entries;
+  size_t               itemcount;
+  char*                keys; // all key bytes, NUL terminated, back to back
+};
+
+hash_table_sh_snapshot* ht_sh_create_snapshot(hash_table_sharded* table);
+void ht_sh_free_snapshot(hash_table_sh_snapshot* snapshot);
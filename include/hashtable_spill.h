@@ -0,0 +1,89 @@
+// exact counting of more distinct keys than fit in memory. Keys are counted
+// into a hash_table until it reaches a memory budget, and then spilled: its
+// items are split into partitions by the high bits of their hash, each
+// partition is sorted by key and written to a run file of its own, and the
+// table is cleared to count on.
+//
+// At the end the runs of each partition, and what is left in the table, are
+// merged in a streaming pass, which adds up the counts of equal keys. A key's
+// counts are all in one partition, so partitions are merged one at a time,
+// each from only its own runs, holding one record and one open file per run.
+// To bound the open files, at most fanin runs are merged at once: beyond
+// that, groups of fanin runs are first merged into bigger runs, which
+// replace them, pass by pass until fanin or fewer are left.
+//
+// Run files are kept in a private directory, made by ht_sp_create and
+// removed with its contents by ht_sp_free. A run is a series of records:
+//
+//   uint32_t   keylen
+//   ht_value_t count
+//   char       key[keylen]              not NUL terminated
+//
+// in host byte order, sorted by key as by memcmp, shorter keys first on a
+// common prefix. A key has several records in a merged run if its count is
+// beyond ht_value_t, which add up to it.
+#pragma once
+
+#include "hashtable.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HT_SP_PARTS 16 // partitions, a power of 2 up to 256
+#define HT_SP_FANIN 64 // default fanin, well under the usual 1024 open files
+
+typedef struct hash_table_spill hash_table_spill;
+struct hash_table_spill {
+  hash_table* table;    // counts since the last spill, pooled and seeded
+  size_t      budget;   // bytes
+  size_t      keybytes; // of keys in table not stored inline
+  char*       dir;      // of the run files
+  size_t*     runs;     // ids of the runs, each with a file per partition
+  size_t      runcount;
+  size_t      runcap;
+  size_t      nextrun;  // id
+  size_t      spills;   // tables written out as runs
+  size_t      fanin;    // most runs merged at once, >= 2
+  uint64_t    spilled;  // bytes written to runs, by spills and merges
+  uint64_t    total;    // of all counts
+};
+
+// a merged count, see ht_sp_merge
+typedef void (*ht_sp_fn)(void* arg, const char* key, size_t len,
+                         uint64_t count);
+
+// a top key, by ht_sp_top_k
+typedef struct ht_sp_item ht_sp_item;
+struct ht_sp_item {
+  char*    key; // NUL terminated, owned by the array
+  size_t   keylen;
+  uint64_t count;
+};
+
+// Counts in about budget bytes of memory, with run files under dir, or
+// $TMPDIR or /tmp if dir is NULL. Returns NULL, with errno set, if the run
+// directory can't be made
+hash_table_spill* ht_sp_create(size_t budget, const char* dir);
+void              ht_sp_free(hash_table_spill* spill);
+
+// counts one occurrence of key, spilling first if the table is at the
+// budget. Returns false, with errno set, if a run can't be written
+bool ht_sp_inc(hash_table_spill* spill, ht_key_t key);
+bool ht_sp_inc_n(hash_table_spill* spill, const char* key, size_t len);
+
+// writes the table out as a run of each partition and clears it
+bool ht_sp_spill(hash_table_spill* spill);
+
+// calls fn once for every distinct key, with its total count, partition by
+// partition and in key order within each. Counting may continue afterwards.
+// Returns false, with errno set, if a run can't be read, or one merging more
+// than fanin runs can't be written
+bool ht_sp_merge(hash_table_spill* spill, ht_sp_fn fn, void* arg);
+
+// the k keys with the highest counts, best first, in a malloc'd array of
+// *count items, from a merge. Returns NULL, with errno set, as ht_sp_merge
+ht_sp_item* ht_sp_top_k(hash_table_spill* spill, size_t k, size_t* count);
+void        ht_sp_free_items(ht_sp_item* items, size_t count);
+
+// bytes of memory the table is estimated to use, against the budget
+size_t ht_sp_bytes(const hash_table_spill* spill);
@@ -0,0 +1,237 @@
+// a type specialised hashtable "template". Define the parameters, then
+// include this header to generate a table whose functions are all static
+// inline, so they get fully inlined for the given key and value types.
+//
+//   #define HT_NAME    u64map      // prefix for all types and functions
+//   #define HT_KEY_T   uint64_t
+//   #define HT_VALUE_T uint64_t
+//   #include "hashtable_tmpl.h"
+//
+// optional parameters:
+//   HT_HASH(key)  => uint64_t   default ht_hash_u64((uint64_t)(key))
+//   HT_EQ(a, b)   => bool       default (a) == (b)
+//   HT_NO_ARITH                 no _inc / _dec, eg for struct values
+//
+// keys and values are stored inline and copied by assignment, so the table
+// never allocates per key. It may be included several times with different
+// parameters, which are #undef'd at the end.
+//
+// generates, for HT_NAME = name:
+//   name_item, name
+//   name_create, name_free, name_insert, name_get, name_get_or_create,
+//   name_inc, name_dec, name_delete, name_iter_next
+//
+// Layout is open addressing with linear probing, plus one metadata byte per
+// slot holding 0 for empty or 0x80 | 7 bits of hash. Deletes shift later
+// items back, so there are no tombstones. Item pointers are only valid until
+// the next insert or delete.
+
+#if !defined(HT_NAME) || !defined(HT_KEY_T) || !defined(HT_VALUE_T)
+#error "define HT_NAME, HT_KEY_T and HT_VALUE_T before including this header"
+#endif
+
+#include "hashtable_hash.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef HT_HASH
+#define HT_HASH(key) ht_hash_u64((uint64_t)(key))
+#endif
+
+#ifndef HT_EQ
+#define HT_EQ(a, b) ((a) == (b))
+#endif
+
+#define HT_TMPL_CAT2(a, b) a##_##b
+#define HT_TMPL_CAT(a, b)  HT_TMPL_CAT2(a, b)
+#define HT_FN(fn)          HT_TMPL_CAT(HT_NAME, fn)
+#define HT_ITEM            HT_FN(item)
+
+typedef struct HT_ITEM HT_ITEM;
+struct HT_ITEM {
+  HT_KEY_T   key;
+  HT_VALUE_T value;
+};
+
+typedef struct HT_NAME HT_NAME;
+struct HT_NAME {
+  uint8_t* meta;      // per slot: 0 => empty, else 0x80 | low 7 bits of hash
+  HT_ITEM* items;     // slots
+  size_t   size;      // how many slots exist, power of 2
+  size_t   itemcount; // how many items exist
+};
+
+static inline uint8_t HT_FN(meta_of)(uint64_t hash) {
+  return 0x80 | (hash & 0x7f);
+}
+
+static inline void HT_FN(alloc_slots)(HT_NAME* restrict table, size_t size) {
+  table->meta  = calloc(size, 1);
+  table->items = calloc(size, sizeof(HT_ITEM));
+  if (!table->meta || !table->items) {
+    perror("alloc slots");
+    exit(EXIT_FAILURE);
+  }
+  table->size = size;
+}
+
+// Creates a new table
+static inline HT_NAME* HT_FN(create)(size_t size) {
+  size_t rounded = 16;
+  while (rounded < size) rounded <<= 1; // always ensure power of 2
+
+  HT_NAME* table = malloc(sizeof *table);
+  if (!table) {
+    perror("malloc table");
+    exit(EXIT_FAILURE);
+  }
+  HT_FN(alloc_slots)(table, rounded);
+  table->itemcount = 0;
+  return table;
+}
+
+// Frees the whole table
+static inline void HT_FN(free)(HT_NAME* restrict table) {
+  free(table->meta);
+  free(table->items);
+  free(table);
+}
+
+// finds the slot holding key or, if it doesn't exist, the empty slot which
+// ends its probe sequence. Sets *found accordingly
+static inline size_t HT_FN(find_slot)(const HT_NAME* restrict table,
+                                      HT_KEY_T key, uint64_t hash,
+                                      bool* found) {
+  size_t  mask = table->size - 1;
+  uint8_t meta = HT_FN(meta_of)(hash);
+  for (size_t idx = hash & mask;; idx = (idx + 1) & mask) {
+    uint8_t m = table->meta[idx];
+    if (!m) {
+      *found = false;
+      return idx;
+    }
+    if (m == meta && HT_EQ(table->items[idx].key, key)) {
+      *found = true;
+      return idx;
+    }
+  }
+}
+
+static inline void HT_FN(rehash)(HT_NAME* restrict table, size_t new_size) {
+  uint8_t* ometa  = table->meta;
+  HT_ITEM* oitems = table->items;
+  size_t   osize  = table->size;
+
+  HT_FN(alloc_slots)(table, new_size);
+  size_t mask = new_size - 1;
+  for (size_t i = 0; i < osize; i++) {
+    if (!ometa[i]) continue;
+    uint64_t hash = HT_HASH(oitems[i].key);
+    size_t   idx  = hash & mask;
+    while (table->meta[idx]) idx = (idx + 1) & mask;
+    table->meta[idx]  = HT_FN(meta_of)(hash);
+    table->items[idx] = oitems[i];
+  }
+  free(ometa);
+  free(oitems);
+}
+
+// returns the item for a key, inserting it with value if it doesn't exist.
+// linear probing degrades faster than chaining, so grow above 3/4 load
+static inline HT_ITEM* HT_FN(get_or_create)(HT_NAME* restrict table,
+                                            HT_KEY_T key, HT_VALUE_T value) {
+  uint64_t hash = HT_HASH(key);
+  bool     found;
+  size_t   idx = HT_FN(find_slot)(table, key, hash, &found);
+  if (found) return &table->items[idx];
+
+  if ((table->itemcount + 1) * 4 > table->size * 3) {
+    HT_FN(rehash)(table, table->size * 2);
+    idx = HT_FN(find_slot)(table, key, hash, &found);
+  }
+  table->meta[idx]        = HT_FN(meta_of)(hash);
+  table->items[idx].key   = key;
+  table->items[idx].value = value;
+  table->itemcount++;
+  return &table->items[idx];
+}
+
+// Inserts an item (or updates if exists)
+static inline HT_ITEM* HT_FN(insert)(HT_NAME* restrict table, HT_KEY_T key,
+                                     HT_VALUE_T value) {
+  HT_ITEM* item = HT_FN(get_or_create)(table, key, value);
+  item->value   = value;
+  return item;
+}
+
+// Searches the key in the table and returns NULL ptr if it doesn't exist
+static inline HT_ITEM* HT_FN(get)(const HT_NAME* restrict table,
+                                  HT_KEY_T                key) {
+  bool   found;
+  size_t idx = HT_FN(find_slot)(table, key, HT_HASH(key), &found);
+  return found ? &table->items[idx] : NULL;
+}
+
+#ifndef HT_NO_ARITH
+static inline HT_ITEM* HT_FN(inc)(HT_NAME* restrict table, HT_KEY_T key) {
+  HT_ITEM* item = HT_FN(get_or_create)(table, key, 0);
+  item->value++;
+  return item;
+}
+
+static inline HT_ITEM* HT_FN(dec)(HT_NAME* restrict table, HT_KEY_T key) {
+  HT_ITEM* item = HT_FN(get_or_create)(table, key, 0);
+  item->value--;
+  return item;
+}
+#endif
+
+// Deletes an item from the table. Later items of the same probe run are
+// shifted back into the hole when that doesn't move them before their home
+// slot, which keeps every probe sequence unbroken without tombstones
+static inline void HT_FN(delete)(HT_NAME* restrict table, HT_KEY_T key) {
+  bool   found;
+  size_t hole = HT_FN(find_slot)(table, key, HT_HASH(key), &found);
+  if (!found) return;
+
+  size_t mask = table->size - 1;
+  size_t idx  = (hole + 1) & mask;
+  for (; table->meta[idx]; idx = (idx + 1) & mask) {
+    size_t home = HT_HASH(table->items[idx].key) & mask;
+    // can move unless home lies cyclically in (hole, idx]
+    bool stays = hole <= idx ? (home > hole && home <= idx)
+                             : (home > hole || home <= idx);
+    if (stays) continue;
+    table->meta[hole]  = table->meta[idx];
+    table->items[hole] = table->items[idx];
+    hole               = idx;
+  }
+  table->meta[hole] = 0;
+  table->itemcount--;
+  if (table->size > 16 && table->itemcount * 100 / table->size < 20)
+    HT_FN(rehash)(table, table->size / 2);
+}
+
+// iterates over all items in slot order. Start with *idx = 0, returns NULL
+// at the end
+static inline HT_ITEM* HT_FN(iter_next)(const HT_NAME* restrict table,
+                                        size_t* restrict        idx) {
+  for (; *idx < table->size; ++*idx)
+    if (table->meta[*idx]) return &table->items[(*idx)++];
+  return NULL;
+}
+
+#undef HT_FN
+#undef HT_ITEM
+#undef HT_TMPL_CAT
+#undef HT_TMPL_CAT2
+#undef HT_NAME
+#undef HT_KEY_T
+#undef HT_VALUE_T
+#undef HT_HASH
+#undef HT_EQ
+#undef HT_NO_ARITH
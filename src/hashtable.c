@@ -1,9 +1,14 @@
 #include "hashtable.h"
+#include "hashtable_hash.h"
+#include <errno.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 static uint64_t next_pow2(uint64_t n) {
   // https://graphics.stanford.edu/~seander/bithacks.html#RoundUpPowerOf2
@@ -19,6 +24,59 @@ static uint64_t next_pow2(uint64_t n) {
   return n;
 }
 
+// the thresholds of ht_grow and ht_shrink for the current size, so neither
+// needs to divide. The minimum size of 4 never shrinks
+static void ht_set_thresholds(hash_table* restrict table) {
+  const ht_policy* policy = &table->policy;
+  table->grow_at          = (size_t)(policy->max_load * (double)table->size);
+  table->shrink_at        = 0;
+  if (policy->no_shrink || table->size <= 4) return;
+  double shrink_at = policy->min_load * (double)table->size;
+  table->shrink_at = (size_t)shrink_at;
+  if ((double)table->shrink_at < shrink_at) table->shrink_at++; // round up
+}
+
+static ht_allocator ht_default_allocator; // zeroed, ie malloc
+
+void ht_set_default_allocator(const ht_allocator* allocator) {
+  ht_default_allocator = allocator ? *allocator : (ht_allocator){0};
+}
+
+// size bytes from allocator, exits with what on failure
+static inline void* ht_alloc(const ht_allocator* restrict allocator,
+                             size_t size, bool zero, const char* what) {
+  void* ptr;
+  if (!allocator->alloc)
+    ptr = zero ? calloc(1, size) : malloc(size);
+  else
+    ptr = allocator->alloc(allocator->ctx, size, zero);
+  if (!ptr) {
+    perror(what);
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
+static inline void ht_dealloc(const ht_allocator* restrict allocator,
+                              void* ptr, size_t size) {
+  if (!ptr) return;
+  if (!allocator->free)
+    free(ptr);
+  else
+    allocator->free(allocator->ctx, ptr, size);
+}
+
+static hash_table_item** ht_alloc_slots(const ht_allocator* restrict allocator,
+                                        size_t                       size) {
+  return ht_alloc(allocator, size * sizeof(hash_table_item*), true,
+                  "calloc slots");
+}
+
+static void ht_free_slots(const ht_allocator* restrict allocator,
+                          hash_table_item** slots, size_t size) {
+  ht_dealloc(allocator, slots, size * sizeof(hash_table_item*));
+}
+
 // Creates a new hash_table
 hash_table* ht_create(size_t size) {
   if (size < 4) size = 4;
@@ -29,105 +87,457 @@ hash_table* ht_create(size_t size) {
     perror("malloc table");
     exit(EXIT_FAILURE);
   }
-  table->slots = calloc(size, sizeof(hash_table_item*));
-  if (!table->slots) {
-    perror("calloc slots");
+  table->allocator   = ht_default_allocator;
+  table->slots       = ht_alloc_slots(&table->allocator, size);
+  table->size        = size;
+  table->itemcount   = 0;
+  table->entries     = NULL;
+  table->entrycount  = 0;
+  table->entrycap    = 0;
+  table->pool        = NULL;
+  table->old_slots   = NULL;
+  table->old_size    = 0;
+  table->migrated    = 0;
+  table->incremental = false;
+  table->policy      = HT_POLICY_DEFAULT;
+  table->rehashes    = 0;
+  table->rehash_ns   = 0;
+  table->seed        = 0;
+  table->sip         = false;
+  table->sipkey      = 0;
+  table->max_chain   = 0;
+  table->reseeds     = 0;
+  ht_set_thresholds(table);
+  return table;
+}
+
+#define HT_POOL_PAGE_SIZE (64 * 1024)
+
+// a page of pool memory. Item pages hold an array of hash_table_items, key
+// pages hold key bytes back to back. Pages are chained for freeing.
+typedef struct ht_pool_page ht_pool_page;
+struct ht_pool_page {
+  ht_pool_page* next;
+  size_t        used; // bytes handed out from data
+  size_t        cap;  // bytes available in data
+  char          data[];
+};
+
+struct ht_pool {
+  ht_pool_page*    item_pages; // head is the page currently being filled
+  ht_pool_page*    key_pages;  // head is the page currently being filled
+  hash_table_item* free_items; // deleted items, linked through ->next
+};
+
+static ht_pool_page* ht_pool_new_page(const ht_allocator* restrict allocator,
+                                      ht_pool_page* next, size_t cap) {
+  ht_pool_page* page =
+      ht_alloc(allocator, sizeof *page + cap, false, "malloc pool page");
+  page->next = next;
+  page->used = 0;
+  page->cap  = cap;
+  return page;
+}
+
+// Creates a new hash_table whose items come from slab pages and whose keys
+// are bump allocated into an arena. ht_free releases whole pages at once.
+// Deleted items are reused, but their key bytes are only reclaimed by ht_free
+hash_table* ht_create_pooled(size_t size) {
+  hash_table* table = ht_create(size);
+  table->pool       = malloc(sizeof *table->pool);
+  if (!table->pool) {
+    perror("malloc pool");
     exit(EXIT_FAILURE);
   }
-  table->size      = size;
-  table->itemcount = 0;
+  table->pool->item_pages = NULL;
+  table->pool->key_pages  = NULL;
+  table->pool->free_items = NULL;
   return table;
 }
 
-// Creates a new hash_table_item
-static hash_table_item* ht_create_item(ht_key_t key, ht_value_t value) {
-  hash_table_item* item = malloc(sizeof *item);
-  if (!item) {
-    perror("malloc item");
+static hash_table_item* ht_pool_alloc_item(hash_table* restrict table) {
+  ht_pool*         pool = table->pool;
+  hash_table_item* item = pool->free_items;
+  if (item) {
+    pool->free_items = item->next;
+    return item;
+  }
+  ht_pool_page* page = pool->item_pages;
+  if (!page || page->used + sizeof *item > page->cap)
+    page = pool->item_pages =
+        ht_pool_new_page(&table->allocator, page,
+                         HT_POOL_PAGE_SIZE / sizeof *item * sizeof *item);
+  item = (hash_table_item*)(page->data + page->used);
+  page->used += sizeof *item;
+  return item;
+}
+
+// copies len bytes of key plus a NUL terminator into the key arena
+static char* ht_pool_alloc_key(hash_table* restrict table, const char* key,
+                               size_t keylen) {
+  ht_pool*      pool = table->pool;
+  size_t        len  = keylen + 1;
+  ht_pool_page* page = pool->key_pages;
+  if (!page || page->used + len > page->cap) {
+    if (len > HT_POOL_PAGE_SIZE / 4) {
+      // large keys get their own page, behind the current one
+      ht_pool_page* own =
+          ht_pool_new_page(&table->allocator, page ? page->next : NULL, len);
+      if (page)
+        page->next = own;
+      else
+        pool->key_pages = own;
+      page = own;
+    } else {
+      page = pool->key_pages =
+          ht_pool_new_page(&table->allocator, page, HT_POOL_PAGE_SIZE);
+    }
+  }
+  char* copy = page->data + page->used;
+  page->used += len;
+  memcpy(copy, key, keylen);
+  copy[keylen] = '\0';
+  return copy;
+}
+
+static void ht_pool_free_pages(const ht_allocator* restrict allocator,
+                               ht_pool_page*                page) {
+  while (page) {
+    ht_pool_page* next = page->next;
+    ht_dealloc(allocator, page, sizeof *page + page->cap);
+    page = next;
+  }
+}
+
+// the slots of a table, old then new, as one range for walking all items.
+// Outside of an incremental resize that's just table->slots
+static inline size_t ht_slot_count(const hash_table* restrict table) {
+  return table->old_size + table->size;
+}
+
+static inline hash_table_item* ht_slot_at(const hash_table* restrict table,
+                                          size_t                   idx) {
+  return idx < table->old_size ? table->old_slots[idx]
+                               : table->slots[idx - table->old_size];
+}
+
+// moves the entries into a new array of cap, which must hold them all
+static void ht_resize_entries(hash_table* restrict table, size_t cap) {
+  hash_table_item** entries =
+      ht_alloc(&table->allocator, cap * sizeof(hash_table_item*), false,
+               "malloc entries");
+  if (table->entrycount)
+    memcpy(entries, table->entries,
+           table->entrycount * sizeof(hash_table_item*));
+  ht_dealloc(&table->allocator, table->entries,
+             table->entrycap * sizeof(hash_table_item*));
+  table->entries  = entries;
+  table->entrycap = cap;
+}
+
+// squeezes the holes out of the entries, keeping their order. Every item
+// moved learns its new index
+static void ht_compact_entries(hash_table* restrict table) {
+  size_t n = 0;
+  for (size_t i = 0; i < table->entrycount; i++) {
+    hash_table_item* item = table->entries[i];
+    if (!item) continue;
+    item->entry         = (uint32_t)n;
+    table->entries[n++] = item;
+  }
+  table->entrycount = n;
+}
+
+// compacts the entries after deletes, and gives back memory while they are
+// under a quarter used
+static void ht_fit_entries(hash_table* restrict table) {
+  if (table->entrycount > table->itemcount) ht_compact_entries(table);
+  size_t cap = table->entrycap;
+  while (cap > 8 && table->entrycount < cap / 4) cap /= 2;
+  if (cap < table->entrycap) ht_resize_entries(table, cap);
+}
+
+// appends a new item to the entries. When they run out, they are compacted
+// if at least a quarter are holes, and doubled otherwise. Entry indexes are
+// 32 bits, more entries are fatal
+static void ht_add_entry(hash_table* restrict      table,
+                         hash_table_item* restrict item) {
+  if (table->entrycount == table->entrycap) {
+    size_t holes = table->entrycount - table->itemcount;
+    if (holes && holes >= table->entrycap / 4) {
+      ht_compact_entries(table);
+    } else {
+      size_t cap = table->entrycap ? table->entrycap * 2 : 8;
+      if (cap - 1 > UINT32_MAX) {
+        errno = EOVERFLOW;
+        perror("hash table entries");
+        exit(EXIT_FAILURE);
+      }
+      ht_resize_entries(table, cap);
+    }
+  }
+  item->entry                         = (uint32_t)table->entrycount;
+  table->entries[table->entrycount++] = item;
+}
+
+// leaves a hole for a deleted item. Holes at the end are dropped at once
+static void ht_remove_entry(hash_table* restrict      table,
+                            hash_table_item* restrict item) {
+  table->entries[item->entry] = NULL;
+  while (table->entrycount && !table->entries[table->entrycount - 1])
+    table->entrycount--;
+}
+
+static inline bool ht_key_is_inline(size_t len) { return len < HT_INLINE_KEY; }
+
+// the key bytes of an item. Avoids loading item->key for inline keys
+static inline const char* ht_item_key(const hash_table_item* restrict item) {
+  return ht_key_is_inline(item->keylen) ? item->inline_key : item->key;
+}
+
+// Creates a new hash_table_item, taking a NUL terminated copy of the key,
+// inline if it is short enough. keylen is 32 bits, longer keys are fatal
+static hash_table_item* ht_create_item(hash_table* restrict table,
+                                       const char* key, size_t len,
+                                       uint64_t hash, ht_value_t value) {
+  if (len > UINT32_MAX) {
+    errno = EOVERFLOW;
+    perror("key length");
     exit(EXIT_FAILURE);
   }
-  item->key   = strdup(key); // take a copy
-  item->value = value;
-  item->next  = NULL;
+  hash_table_item* item;
+  if (table->pool) {
+    item = ht_pool_alloc_item(table);
+  } else {
+    item = ht_alloc(&table->allocator, sizeof *item, false, "malloc item");
+  }
+  if (ht_key_is_inline(len)) {
+    item->key = item->inline_key;
+    memcpy(item->key, key, len);
+    item->key[len] = '\0';
+  } else if (table->pool) {
+    item->key = ht_pool_alloc_key(table, key, len);
+  } else {
+    // take a copy
+    item->key = ht_alloc(&table->allocator, len + 1, false, "malloc key");
+    memcpy(item->key, key, len);
+    item->key[len] = '\0';
+  }
+  item->value  = value;
+  item->keylen = (uint32_t)len;
+  item->hash   = hash;
+  item->next   = NULL;
+  ht_add_entry(table, item);
   return item;
 }
 
 // Frees an item. Depending on their types, if the key or value members
 // need freeing that needs to happen here too
-static inline void ht_free_item(hash_table_item* restrict item) {
-  free(item->key);
-  free(item);
+static inline void ht_free_item(hash_table* restrict      table,
+                                hash_table_item* restrict item) {
+  if (table->pool) {
+    item->next              = table->pool->free_items; // for reuse
+    table->pool->free_items = item;
+    return;
+  }
+  if (!ht_key_is_inline(item->keylen))
+    ht_dealloc(&table->allocator, item->key, (size_t)item->keylen + 1);
+  ht_dealloc(&table->allocator, item, sizeof *item);
+}
+
+bool ht_set_allocator(hash_table* restrict table,
+                      const ht_allocator*  allocator) {
+  if (table->itemcount || table->old_slots ||
+      (table->pool && (table->pool->item_pages || table->pool->key_pages)))
+    return false;
+  ht_allocator      next  = allocator ? *allocator : (ht_allocator){0};
+  hash_table_item** slots = ht_alloc_slots(&next, table->size);
+  ht_free_slots(&table->allocator, table->slots, table->size);
+  ht_dealloc(&table->allocator, table->entries,
+             table->entrycap * sizeof(hash_table_item*));
+  table->slots     = slots;
+  table->entries   = NULL;
+  table->entrycap  = 0;
+  table->allocator = next;
+  return true;
 }
 
 // Frees the whole hashtable
 void ht_free(hash_table* restrict table) {
-  // free the hash_table_items in the linked lists
-  for (size_t i = 0; i < table->size; i++) {
-    hash_table_item* item = table->slots[i];
-    while (item) {
-      hash_table_item* next = item->next;
-      ht_free_item(item);
-      item = next;
-    }
+  if (table->pool) {
+    // items and keys all live in pages
+    ht_pool_free_pages(&table->allocator, table->pool->item_pages);
+    ht_pool_free_pages(&table->allocator, table->pool->key_pages);
+    free(table->pool);
+  } else {
+    // free the hash_table_items, in one sweep of the entries
+    for (size_t i = 0; i < table->entrycount; i++)
+      if (table->entries[i]) ht_free_item(table, table->entries[i]);
   }
-  // free the array of pointers to hash_table_items
-  free(table->slots);
+  // free the arrays of pointers to hash_table_items
+  ht_dealloc(&table->allocator, table->entries,
+             table->entrycap * sizeof(hash_table_item*));
+  ht_free_slots(&table->allocator, table->old_slots, table->old_size);
+  ht_free_slots(&table->allocator, table->slots, table->size);
   free(table);
 }
 
 // hash function. crucial to efficient operation
-// returns value in range [0, size)
-// an appropriate hash function for short strings is FNV-1a
-// https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function#FNV-1a_hash
-static size_t ht_hash(size_t size, const char* restrict str) {
-  uint64_t hash = 0xcbf29ce484222325; // FNV_offset_basis
-  while (*str) hash = (hash ^ (uint8_t)*str++) * 0x100000001b3; // FNV_prime
+// returns the full 64 bit hash, which is stored in the item
+// selected at compile time, see hashtable_hash.h, unless the table is
+// seeded, see ht_set_seed and ht_set_max_chain
+static inline uint64_t ht_hash(const hash_table* restrict table,
+                               const char* restrict key, size_t len) {
+  if (__builtin_expect(table->sip, 0))
+    return ht_hash_siphash(key, len, table->seed, table->sipkey);
+  if (!table->seed) return ht_hash_bytes(key, len);
+  return ht_hash_wyhash_seeded(key, len, table->seed);
+}
 
+// returns slot index in range [0, size)
+static inline size_t ht_slot_idx(size_t size, uint64_t hash) {
   return hash & (size - 1); // fit to table. we know size is power of 2
 }
 
-hash_table_item* ht_rehash(hash_table* restrict table, size_t new_size,
-                           hash_table_item* restrict old_item) {
-  if (new_size < 4) new_size = 4;
-  new_size = next_pow2(new_size); // always ensure power of 2
-
-  hash_table_item*  new_item = old_item;
-  hash_table_item** nslots   = calloc(new_size, sizeof(hash_table_item*));
-  if (!nslots) {
-    perror("calloc nslots");
-    exit(EXIT_FAILURE);
-  }
+// how many old slots are migrated per insert or delete during an incremental
+// resize. With the default policy, doubling at 80% load, the migration
+// completes long before the next resize is due. Otherwise the next resize
+// finishes it first
+#define HT_MIGRATE_SLOTS 8
 
-  for (size_t i = 0; i < table->size; i++) {
-    hash_table_item* item = table->slots[i];
+// moves the items of up to count old slots into the new slots. Finishes the
+// incremental resize when all have been moved
+static void ht_migrate(hash_table* restrict table, size_t count) {
+  size_t end = table->migrated + count;
+  if (end > table->old_size) end = table->old_size;
+  for (size_t i = table->migrated; i < end; i++) {
+    hash_table_item* item = table->old_slots[i];
     while (item) {
-      hash_table_item*  next  = item->next; // save next
-      hash_table_item** nslot = &nslots[ht_hash(new_size, item->key)];
-      item->next            = *nslot; // push into new list
-      *nslot                = item;
-      if (item == old_item) new_item = item;
-      item = next;
+      hash_table_item*  next = item->next; // save next
+      hash_table_item** nslot =
+          &table->slots[ht_slot_idx(table->size, item->hash)];
+      item->next = *nslot; // push into new list
+      *nslot     = item;
+      item       = next;
     }
+    table->old_slots[i] = NULL;
+  }
+  table->migrated = end;
+  if (table->migrated == table->old_size) {
+    ht_free_slots(&table->allocator, table->old_slots, table->old_size);
+    table->old_slots = NULL;
+    table->old_size  = 0;
+    table->migrated  = 0;
   }
-  free(table->slots);
-  table->size  = new_size;
-  table->slots = nslots;
-  return new_item;
+}
+
+// a timestamp for rehash_ns, always 0 when HT_STATS is off
+static inline uint64_t ht_stats_now(void) {
+#if HT_STATS
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+  return 0;
+#endif
+}
+
+// starts an incremental resize: the current slots become old_slots and are
+// migrated a few at a time by ht_migrate
+static void ht_start_resize(hash_table* restrict table, size_t new_size) {
+  if (new_size < 4) new_size = 4;
+  new_size = next_pow2(new_size); // always ensure power of 2
+
+  if (table->old_slots) ht_migrate(table, table->old_size); // finish previous
+  table->old_slots = table->slots;
+  table->old_size  = table->size;
+  table->migrated  = 0;
+  table->slots     = ht_alloc_slots(&table->allocator, new_size);
+  table->size      = new_size;
+  ht_set_thresholds(table);
+#if HT_STATS
+  table->rehashes++;
+#endif
+}
+
+// rehashes the whole table in one pass, and compacts its entries. Items
+// don't move, so old_item is always returned as is
+hash_table_item* ht_rehash(hash_table* restrict table, size_t new_size,
+                           hash_table_item* restrict old_item) {
+  uint64_t start = ht_stats_now();
+  ht_start_resize(table, new_size);
+  ht_migrate(table, table->old_size);
+  ht_fit_entries(table);
+  table->rehash_ns += ht_stats_now() - start;
+  return old_item;
+}
+
+// Switches incremental resizing on or off. When off (the default) every
+// resize rehashes the whole table in one go, when on the work is spread over
+// the following inserts and deletes
+void ht_set_incremental(hash_table* restrict table, bool incremental) {
+  if (!incremental && table->old_slots) ht_migrate(table, table->old_size);
+  table->incremental = incremental;
+}
+
+static void ht_resize(hash_table* restrict table, size_t new_size) {
+  if (table->incremental)
+    ht_start_resize(table, new_size);
+  else
+    ht_rehash(table, new_size, NULL);
 }
 
 static hash_table_item* ht_grow(hash_table* restrict      table,
                                 hash_table_item* restrict old_item) {
-  table->itemcount++;
-  hash_table_item* new_item = old_item;
-  if (table->itemcount * 100 / table->size > 80)
-    new_item = ht_rehash(table, table->size * 2, old_item);
-  return new_item;
+  if (++table->itemcount > table->grow_at)
+    ht_resize(table, table->size * table->policy.growth);
+  return old_item;
 }
 
 static void ht_shrink(hash_table* restrict table) {
-  table->itemcount--;
-  if (table->size > 4 && table->itemcount * 100 / table->size < 20)
-    ht_rehash(table, table->size / 2, NULL); // no item to track
+  if (--table->itemcount < table->shrink_at) ht_resize(table, table->size / 2);
+}
+
+bool ht_set_policy(hash_table* restrict table, ht_policy policy) {
+  if (!(policy.max_load > 0) || policy.growth < 2 ||
+      (policy.growth & (policy.growth - 1)))
+    return false;
+  if (!policy.no_shrink &&
+      !(policy.min_load >= 0 && policy.min_load * 2 < policy.max_load &&
+        policy.min_load * policy.growth < policy.max_load))
+    return false;
+  table->policy = policy;
+  ht_set_thresholds(table);
+  return true;
+}
+
+// the smallest size holding n items without growing
+static size_t ht_size_for(const ht_policy* restrict policy, size_t n) {
+  size_t size = 4;
+  while ((size_t)(policy->max_load * (double)size) < n) size *= 2;
+  return size;
+}
+
+void ht_reserve(hash_table* restrict table, size_t n) {
+  size_t size = ht_size_for(&table->policy, n);
+  if (size > table->size) ht_resize(table, size);
+}
+
+// the head of the chain for a hash. During an incremental resize that is in
+// the old slots, unless that old slot has already been migrated
+static inline hash_table_item** ht_bucket(const hash_table* restrict table,
+                                          uint64_t                   hash) {
+  if (table->old_slots) {
+    size_t oidx = ht_slot_idx(table->old_size, hash);
+    if (oidx >= table->migrated) return &table->old_slots[oidx];
+  }
+  return &table->slots[ht_slot_idx(table->size, hash)];
+}
+
+// a step of any incremental resize, done before looking up the slot as it
+// relinks the chains
+static inline void ht_migrate_step(hash_table* restrict table) {
+  if (table->old_slots) ht_migrate(table, HT_MIGRATE_SLOTS);
 }
 
 // finds a slot for a key, either existing or new
@@ -136,79 +546,353 @@ static void ht_shrink(hash_table* restrict table) {
 // hanging off such a primary slot
 // this keeps the logic the same and allows reuse across insert,
 // delete, inc, dec and get
+// the hash is compared first, so memcmp only runs on a (very likely) match
+// chain, if not NULL, is incremented for every item passed over
 static inline hash_table_item** ht_find_slot(const hash_table* restrict table,
-                                             ht_key_t                   key) {
-  hash_table_item** slot = &table->slots[ht_hash(table->size, key)];
+                                             const char* key, size_t len,
+                                             uint64_t hash, size_t* chain) {
+  hash_table_item** slot = ht_bucket(table, hash);
   hash_table_item*  item = *slot;
   while (item) {
-    if (strcmp(item->key, key) == 0) {
+    if (item->hash == hash && item->keylen == len &&
+        memcmp(ht_item_key(item), key, len) == 0) {
       return slot;
     }
+    if (chain) ++*chain;
     slot = &item->next;
     item = *slot;
   }
   return slot;
 }
 
-// Inserts an item (or updates if exists)
-hash_table_item* ht_insert(hash_table* restrict table, ht_key_t key,
-                           ht_value_t value) {
-  hash_table_item** slot = ht_find_slot(table, key);
-  hash_table_item*  item = *slot;
+// recomputes the hash of every item, after the hash function changed, and
+// relinks them all
+static void ht_rehash_keys(hash_table* restrict table) {
+  for (size_t i = 0; i < table->entrycount; i++) {
+    hash_table_item* item = table->entries[i];
+    if (item) item->hash = ht_hash(table, ht_item_key(item), item->keylen);
+  }
+  ht_rehash(table, table->size, NULL);
+}
+
+// a new item went onto the end of a chain of chain items. Items don't move,
+// so the new one stays valid
+static inline void ht_check_chain(hash_table* restrict table, size_t chain) {
+  if (__builtin_expect(table->max_chain && chain >= table->max_chain, 0) &&
+      !table->sip) {
+    table->sip    = true;
+    table->seed   = ht_random_seed();
+    table->sipkey = ht_random_seed();
+    table->reseeds++;
+    ht_rehash_keys(table);
+  }
+}
+
+void ht_set_seed(hash_table* restrict table, uint64_t seed) {
+  table->seed = seed;
+  table->sip  = false;
+  ht_rehash_keys(table);
+}
+
+// from the OS, or failing that from the clock and the stack's address,
+// which ASLR randomises
+uint64_t ht_random_seed(void) {
+  uint64_t seed;
+  if (getentropy(&seed, sizeof seed) != 0) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    seed = ht_hash_u64(((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec) ^
+                       (uint64_t)(uintptr_t)&ts);
+  }
+  return seed ? seed : 1;
+}
+
+void ht_set_max_chain(hash_table* restrict table, size_t max_chain) {
+  table->max_chain = max_chain;
+}
+
+uint64_t ht_item_hash_bytes(const hash_table* restrict      table,
+                            const hash_table_item* restrict item) {
+  if (!table->seed && !table->sip) return item->hash;
+  return ht_hash_bytes(ht_item_key(item), item->keylen);
+}
+
+// the insert and get_or_create work, for an already hashed key
+static inline hash_table_item* ht_insert_hashed(hash_table* restrict table,
+                                                const char* key, size_t len,
+                                                uint64_t   hash,
+                                                ht_value_t value) {
+  ht_migrate_step(table);
+  size_t            chain = 0;
+  hash_table_item** slot  = ht_find_slot(table, key, len, hash, &chain);
+  hash_table_item*  item  = *slot;
   if (item) {
     item->value = value; // update value, free old value if needed
     return item;
   }
-  *slot = ht_create_item(key, value); // new entry
-  return ht_grow(table, *slot);       // dynamic resizing
+  item = *slot = ht_create_item(table, key, len, hash, value); // new entry
+  ht_check_chain(table, chain);
+  return ht_grow(table, item); // dynamic resizing
 }
 
-// Deletes an item from the table
-void ht_delete(hash_table* restrict table, ht_key_t key) {
-  hash_table_item** slot = ht_find_slot(table, key);
+static inline hash_table_item*
+ht_get_or_create_hashed(hash_table* restrict table, const char* key,
+                        size_t len, uint64_t hash, ht_value_t value) {
+  ht_migrate_step(table);
+  size_t            chain = 0;
+  hash_table_item** slot  = ht_find_slot(table, key, len, hash, &chain);
+  if (*slot) return *slot;
+  hash_table_item* item = *slot =
+      ht_create_item(table, key, len, hash, value); // not found, init
+  ht_check_chain(table, chain);
+  return ht_grow(table, item); // dynamic resizing
+}
+
+// Inserts an item (or updates if exists)
+hash_table_item* ht_insert_n(hash_table* restrict table, const char* key,
+                             size_t len, ht_value_t value) {
+  return ht_insert_hashed(table, key, len, ht_hash(table, key, len), value);
+}
+
+hash_table_item* ht_insert(hash_table* restrict table, ht_key_t key,
+                           ht_value_t value) {
+  return ht_insert_n(table, key, strlen(key), value);
+}
+
+static inline void ht_delete_hashed(hash_table* restrict table,
+                                    const char* key, size_t len,
+                                    uint64_t hash) {
+  ht_migrate_step(table);
+  hash_table_item** slot = ht_find_slot(table, key, len, hash, NULL);
   hash_table_item*  item = *slot;
   if (item) {
     *slot = item->next; // remove item from linked list
-    ht_free_item(item);
+    ht_remove_entry(table, item);
+    ht_free_item(table, item);
     ht_shrink(table);
     return;
   }
 }
 
+// Deletes an item from the table
+void ht_delete_n(hash_table* restrict table, const char* key, size_t len) {
+  ht_delete_hashed(table, key, len, ht_hash(table, key, len));
+}
+
+void ht_delete(hash_table* restrict table, ht_key_t key) {
+  ht_delete_n(table, key, strlen(key));
+}
+
 // Searches the key in the hashtable
 // and returns NULL ptr if it doesn't exist
+// the table is const here, so lookups don't advance an incremental resize
+hash_table_item* ht_get_n(const hash_table* restrict table, const char* key,
+                          size_t len) {
+  return *ht_find_slot(table, key, len, ht_hash(table, key, len), NULL);
+}
+
 hash_table_item* ht_get(const hash_table* restrict table, ht_key_t key) {
-  return *ht_find_slot(table, key);
+  return ht_get_n(table, key, strlen(key));
 }
 
 // increments the value for a key or inserts with value = 1
 // specialised for ht_value_t=int and faster than search then update.
+hash_table_item* ht_get_or_create_n(hash_table* restrict table,
+                                    const char* key, size_t len,
+                                    ht_value_t value) {
+  return ht_get_or_create_hashed(table, key, len, ht_hash(table, key, len),
+                                 value);
+}
+
 hash_table_item* ht_get_or_create(hash_table* restrict table, ht_key_t key,
                                   ht_value_t value) {
-  hash_table_item** slot = ht_find_slot(table, key);
-  if (*slot) return *slot;
-  *slot = ht_create_item(key, value); // not found, init with supplied value
-  return ht_grow(table, *slot);       // dynamic resizing
+  return ht_get_or_create_n(table, key, strlen(key), value);
 }
 
-hash_table_item* ht_inc(hash_table* restrict table, ht_key_t key) {
-  hash_table_item* item = ht_get_or_create(table, key, 0);
+hash_table_item* ht_inc_n(hash_table* restrict table, const char* key,
+                          size_t len) {
+  hash_table_item* item = ht_get_or_create_n(table, key, len, 0);
   item->value++;
   return item;
 }
 
+hash_table_item* ht_inc(hash_table* restrict table, ht_key_t key) {
+  return ht_inc_n(table, key, strlen(key));
+}
+
+hash_table_item* ht_dec_n(hash_table* restrict table, const char* key,
+                          size_t len) {
+  hash_table_item* item = ht_get_or_create_n(table, key, len, 0);
+  item->value--;
+  return item;
+}
+
 hash_table_item* ht_dec(hash_table* restrict table, ht_key_t key) {
-  hash_table_item* item = ht_get_or_create(table, key, 0);
+  return ht_dec_n(table, key, strlen(key));
+}
+
+// the table's hash of a key, given its ht_hash_bytes hash
+static inline uint64_t ht_hash_given(const hash_table* restrict table,
+                                     const char* restrict key, size_t len,
+                                     uint64_t hash) {
+  if (__builtin_expect(!table->seed && !table->sip, 1)) return hash;
+  return ht_hash(table, key, len);
+}
+
+hash_table_item* ht_insert_h(hash_table* restrict table, const char* key,
+                             size_t len, uint64_t hash, ht_value_t value) {
+  return ht_insert_hashed(table, key, len,
+                          ht_hash_given(table, key, len, hash), value);
+}
+
+void ht_delete_h(hash_table* restrict table, const char* key, size_t len,
+                 uint64_t hash) {
+  ht_delete_hashed(table, key, len, ht_hash_given(table, key, len, hash));
+}
+
+hash_table_item* ht_get_h(const hash_table* restrict table, const char* key,
+                          size_t len, uint64_t hash) {
+  return *ht_find_slot(table, key, len, ht_hash_given(table, key, len, hash),
+                       NULL);
+}
+
+hash_table_item* ht_get_or_create_h(hash_table* restrict table,
+                                    const char* key, size_t len,
+                                    uint64_t hash, ht_value_t value) {
+  return ht_get_or_create_hashed(table, key, len,
+                                 ht_hash_given(table, key, len, hash), value);
+}
+
+hash_table_item* ht_inc_h(hash_table* restrict table, const char* key,
+                          size_t len, uint64_t hash) {
+  hash_table_item* item = ht_get_or_create_h(table, key, len, hash, 0);
+  item->value++;
+  return item;
+}
+
+hash_table_item* ht_dec_h(hash_table* restrict table, const char* key,
+                          size_t len, uint64_t hash) {
+  hash_table_item* item = ht_get_or_create_h(table, key, len, hash, 0);
   item->value--;
   return item;
 }
 
+// batched operations keep several cache misses in flight, instead of one
+// after the other. Each key goes through a 3 stage pipeline, HT_BATCH_DIST
+// keys apart:
+//   1. hash it and prefetch its bucket
+//   2. prefetch the first item in that bucket
+//   3. resolve it exactly as the scalar function would, with the cached hash
+// The prefetches are only hints, stage 3 finds the bucket afresh, so results
+// are the same as calling the scalar function on each key in order even if
+// earlier keys of the batch resize the table. If one moves it to SipHash,
+// the keys already hashed are hashed again, see ht_batch_check
+#define HT_BATCH_DIST 8
+#define HT_BATCH_RING 32 // > 2 * HT_BATCH_DIST, power of 2
+
+typedef struct ht_batch ht_batch;
+struct ht_batch {
+  uint64_t hashes[HT_BATCH_RING];
+  size_t   lens[HT_BATCH_RING];
+  size_t   reseeds; // of the table when the hashes were taken
+};
+
+// runs stages 1 and 2 of the pipeline at step i, and returns the key index
+// due for stage 3, or count if there is none yet
+static inline size_t ht_batch_step(const hash_table* restrict table,
+                                   ht_batch* restrict b, const ht_key_t* keys,
+                                   const size_t* lens, size_t count,
+                                   size_t i) {
+  if (i < count) {
+    size_t r     = i & (HT_BATCH_RING - 1);
+    b->lens[r]   = lens ? lens[i] : strlen(keys[i]);
+    b->hashes[r] = ht_hash(table, keys[i], b->lens[r]);
+    __builtin_prefetch(ht_bucket(table, b->hashes[r]));
+  }
+  if (i >= HT_BATCH_DIST && i - HT_BATCH_DIST < count) {
+    size_t           r    = (i - HT_BATCH_DIST) & (HT_BATCH_RING - 1);
+    hash_table_item* head = *ht_bucket(table, b->hashes[r]);
+    if (head) __builtin_prefetch(head);
+  }
+  return i >= 2 * HT_BATCH_DIST ? i - 2 * HT_BATCH_DIST : count;
+}
+
+// after stage 3 of key k at step i, rehashes keys (k, i] if that switched
+// the table to SipHash
+static inline void ht_batch_check(const hash_table* restrict table,
+                                  ht_batch* restrict b, const ht_key_t* keys,
+                                  size_t count, size_t k, size_t i) {
+  if (__builtin_expect(b->reseeds == table->reseeds, 1)) return;
+  b->reseeds = table->reseeds;
+  for (size_t j = k + 1; j <= i && j < count; j++) {
+    size_t r     = j & (HT_BATCH_RING - 1);
+    b->hashes[r] = ht_hash(table, keys[j], b->lens[r]);
+  }
+}
+
+// Inserts count items, as ht_insert_n on each in order. lens may be NULL for
+// NUL terminated keys, and items NULL if the results aren't wanted
+void ht_insert_batch(hash_table* restrict table, const ht_key_t* keys,
+                     const size_t* lens, const ht_value_t* values,
+                     size_t count, hash_table_item** items) {
+  ht_batch b = {.reseeds = table->reseeds};
+  for (size_t i = 0; i < count + 2 * HT_BATCH_DIST; ++i) {
+    size_t k = ht_batch_step(table, &b, keys, lens, count, i);
+    if (k >= count) continue;
+    size_t           r    = k & (HT_BATCH_RING - 1);
+    hash_table_item* item = ht_insert_hashed(table, keys[k], b.lens[r],
+                                             b.hashes[r], values[k]);
+    ht_batch_check(table, &b, keys, count, k, i);
+    if (items) items[k] = item;
+  }
+}
+
+// Searches count keys, as ht_get_n on each. items[i] is NULL if keys[i]
+// doesn't exist
+void ht_get_batch(const hash_table* restrict table, const ht_key_t* keys,
+                  const size_t* lens, size_t count, hash_table_item** items) {
+  ht_batch b;
+  for (size_t i = 0; i < count + 2 * HT_BATCH_DIST; ++i) {
+    size_t k = ht_batch_step(table, &b, keys, lens, count, i);
+    if (k >= count) continue;
+    size_t r = k & (HT_BATCH_RING - 1);
+    items[k] = *ht_find_slot(table, keys[k], b.lens[r], b.hashes[r], NULL);
+  }
+}
+
+// Increments count keys, as ht_inc_n on each in order
+void ht_inc_batch(hash_table* restrict table, const ht_key_t* keys,
+                  const size_t* lens, size_t count, hash_table_item** items) {
+  ht_batch b = {.reseeds = table->reseeds};
+  for (size_t i = 0; i < count + 2 * HT_BATCH_DIST; ++i) {
+    size_t k = ht_batch_step(table, &b, keys, lens, count, i);
+    if (k >= count) continue;
+    size_t           r = k & (HT_BATCH_RING - 1);
+    hash_table_item* item =
+        ht_get_or_create_hashed(table, keys[k], b.lens[r], b.hashes[r], 0);
+    ht_batch_check(table, &b, keys, count, k, i);
+    item->value++;
+    if (items) items[k] = item;
+  }
+}
+
+hash_table* ht_build_from_arrays(const ht_key_t* keys, const size_t* lens,
+                                 const ht_value_t* values, size_t n) {
+  ht_policy   policy = HT_POLICY_DEFAULT;
+  hash_table* table  = ht_create(ht_size_for(&policy, n));
+  ht_insert_batch(table, keys, lens, values, n, NULL);
+  return table;
+}
+
 // debug printing. customise printf format strings by key & value types
 void ht_print(const hash_table* restrict table) {
   printf("\n---- Hash Table ---\n");
-  for (size_t i = 0; i < table->size; i++) {
-    printf("@%zu: ", i);
-    hash_table_item* item = table->slots[i];
+  for (size_t i = 0; i < ht_slot_count(table); i++) {
+    if (i < table->old_size)
+      printf("old @%zu: ", i);
+    else
+      printf("@%zu: ", i - table->old_size);
+    hash_table_item* item = ht_slot_at(table, i);
     while (item) {
       printf("%s => %d | ", item->key, item->value);
       item = item->next;
@@ -218,9 +902,81 @@ void ht_print(const hash_table* restrict table) {
   printf("-------------------\n");
 }
 
+static size_t ht_pool_page_bytes(const ht_pool_page* page) {
+  size_t bytes = 0;
+  for (; page; page = page->next) bytes += sizeof *page + page->cap;
+  return bytes;
+}
+
+// Fills stats with the chain length distribution, the counters and the
+// memory held by table. Probe counts are derived from the chain lengths:
+// a hit on the n'th item of a chain visits n items, a miss visits the whole
+// chain of its slot
+void ht_stats(const hash_table* restrict table, hash_table_stats* stats) {
+  *stats = (hash_table_stats){
+      .size        = table->size,
+      .itemcount   = table->itemcount,
+      .rehashes    = table->rehashes,
+      .rehash_ns   = table->rehash_ns,
+      .slot_bytes  = ht_slot_count(table) * sizeof(hash_table_item*),
+      .entry_bytes = table->entrycap * sizeof(hash_table_item*)};
+  size_t visits = 0; // by a hit on every item
+  // old slots [0, migrated) are empty and no longer looked up
+  for (size_t i = table->migrated; i < ht_slot_count(table); i++) {
+    size_t len = 0;
+    for (hash_table_item* item = ht_slot_at(table, i); item;
+         item                  = item->next) {
+      visits += ++len;
+      if (!table->pool && !ht_key_is_inline(item->keylen))
+        stats->key_bytes += (size_t)item->keylen + 1;
+    }
+    stats->slots++;
+    if (len == 0) stats->empty_slots++;
+    if (len > stats->max_chain) stats->max_chain = len;
+    stats->chains[len < HT_STATS_CHAINS ? len : HT_STATS_CHAINS - 1]++;
+  }
+  if (table->itemcount)
+    stats->probes_hit = (double)visits / (double)table->itemcount;
+  stats->probes_miss = (double)table->itemcount / (double)stats->slots;
+
+  if (table->pool) {
+    stats->item_bytes = sizeof *table->pool +
+                        ht_pool_page_bytes(table->pool->item_pages);
+    stats->key_bytes  = ht_pool_page_bytes(table->pool->key_pages);
+  } else {
+    stats->item_bytes = table->itemcount * sizeof(hash_table_item);
+  }
+  stats->total_bytes = sizeof *table + stats->slot_bytes + stats->entry_bytes +
+                       stats->item_bytes + stats->key_bytes;
+}
+
+void ht_print_stats(const hash_table_stats* stats) {
+  printf("\n---- Hash Table Stats ---\n");
+  printf("%-14s %12zu\n", "size", stats->size);
+  printf("%-14s %12zu\n", "itemcount", stats->itemcount);
+  printf("%-14s %12zu\n", "empty slots", stats->empty_slots);
+  printf("%-14s %12zu\n", "max chain", stats->max_chain);
+  printf("%-14s %12.2f\n", "probes hit", stats->probes_hit);
+  printf("%-14s %12.2f\n", "probes miss", stats->probes_miss);
+  printf("%-14s %12zu\n", "rehashes", stats->rehashes);
+  printf("%-14s %12.3f ms\n", "rehash time", stats->rehash_ns / 1e6);
+  printf("%-14s %12zu\n", "slot bytes", stats->slot_bytes);
+  printf("%-14s %12zu\n", "entry bytes", stats->entry_bytes);
+  printf("%-14s %12zu\n", "item bytes", stats->item_bytes);
+  printf("%-14s %12zu\n", "key bytes", stats->key_bytes);
+  printf("%-14s %12zu\n", "total bytes", stats->total_bytes);
+  printf("chain length   slots\n");
+  for (size_t len = 0; len < HT_STATS_CHAINS; len++) {
+    if (!stats->chains[len]) continue;
+    printf("%2zu%-12s %12zu\n", len, len == HT_STATS_CHAINS - 1 ? "+" : "",
+           stats->chains[len]);
+  }
+  printf("-------------------------\n");
+}
+
 // create a flat view (array) of hash_table_item pointers for iterating and/or
 // sorting. The start to array of pointers, length table->itemcount, is
-// returned.
+// returned. It is a copy of the entries, in one memcpy if there are no holes
 hash_table_item** ht_create_flat_view(const hash_table* restrict table) {
   hash_table_item** itemview =
       calloc(table->itemcount, sizeof(hash_table_item*));
@@ -228,15 +984,161 @@ hash_table_item** ht_create_flat_view(const hash_table* restrict table) {
     perror("calloc itemview");
     exit(EXIT_FAILURE);
   }
+  if (table->entrycount == table->itemcount) {
+    if (table->itemcount)
+      memcpy(itemview, table->entries,
+             table->itemcount * sizeof(hash_table_item*));
+    return itemview;
+  }
   hash_table_item** curritem = itemview;
-  for (size_t i = 0; i < table->size; i++) {
-    hash_table_item* item = table->slots[i];
-    while (item) {
-      *curritem++ = item;
-      item        = item->next;
+  for (size_t i = 0; i < table->entrycount; i++)
+    if (table->entries[i]) *curritem++ = table->entries[i];
+  return itemview;
+}
+
+hash_table_item** ht_items(hash_table* restrict table) {
+  if (table->entrycount > table->itemcount) ht_compact_entries(table);
+  return table->entries;
+}
+
+// bounded heap for ht_top_k. The root is the worst of the kept items, so a
+// new item only has to beat the root to get in
+typedef struct ht_top_heap ht_top_heap;
+struct ht_top_heap {
+  hash_table_item** items;
+  size_t            count;
+  size_t            k;
+  ht_item_cmp       cmp;
+};
+
+// whether a ranks after b, ie is worse
+static inline bool ht_top_worse(const ht_top_heap* restrict heap,
+                                hash_table_item* a, hash_table_item* b) {
+  return heap->cmp(&a, &b) > 0;
+}
+
+static void ht_top_sift_down(ht_top_heap* restrict heap, size_t idx) {
+  hash_table_item** items = heap->items;
+  for (;;) {
+    size_t worst = idx;
+    size_t left  = 2 * idx + 1;
+    size_t right = left + 1;
+    if (left < heap->count && ht_top_worse(heap, items[left], items[worst]))
+      worst = left;
+    if (right < heap->count && ht_top_worse(heap, items[right], items[worst]))
+      worst = right;
+    if (worst == idx) return;
+    hash_table_item* tmp = items[idx];
+    items[idx]           = items[worst];
+    items[worst]         = tmp;
+    idx                  = worst;
+  }
+}
+
+static void ht_top_push(ht_top_heap* restrict heap, hash_table_item* item) {
+  hash_table_item** items = heap->items;
+  if (heap->count < heap->k) {
+    size_t idx = heap->count++;
+    while (idx > 0) { // sift up
+      size_t parent = (idx - 1) / 2;
+      if (!ht_top_worse(heap, item, items[parent])) break;
+      items[idx] = items[parent];
+      idx        = parent;
     }
+    items[idx] = item;
+  } else if (heap->k > 0 && ht_top_worse(heap, items[0], item)) {
+    items[0] = item;
+    ht_top_sift_down(heap, 0);
   }
-  return itemview;
+}
+
+// pushes the items of entries [start, end)
+static void ht_top_scan(const hash_table* restrict table,
+                        ht_top_heap* restrict heap, size_t start, size_t end) {
+  for (size_t i = start; i < end; i++)
+    if (table->entries[i]) ht_top_push(heap, table->entries[i]);
+}
+
+static ht_top_heap ht_top_heap_create(const hash_table* restrict table,
+                                      size_t k, ht_item_cmp cmp) {
+  if (k > table->itemcount) k = table->itemcount;
+  ht_top_heap heap = {malloc(k * sizeof(hash_table_item*) + 1), 0, k, cmp};
+  if (!heap.items) {
+    perror("malloc top k");
+    exit(EXIT_FAILURE);
+  }
+  return heap;
+}
+
+// Returns the k best items, as ranked by cmp, best first. *count is set to
+// their number, which is less than k if the table has fewer items. cmp is as
+// for qsort on a flat view, ie it gets two hash_table_item** and returns < 0
+// if the first ranks before the second. The array is malloc'd, and only valid
+// until the table is next modified.
+// This is O(n log k) with k pointers of extra memory, rather than O(n log n)
+// and n pointers for sorting a flat view.
+hash_table_item** ht_top_k(const hash_table* restrict table, size_t k,
+                           ht_item_cmp cmp, size_t* count) {
+  ht_top_heap heap = ht_top_heap_create(table, k, cmp);
+  ht_top_scan(table, &heap, 0, table->entrycount);
+  qsort(heap.items, heap.count, sizeof(hash_table_item*), cmp);
+  *count = heap.count;
+  return heap.items;
+}
+
+typedef struct ht_top_args ht_top_args;
+struct ht_top_args {
+  const hash_table* table;
+  ht_top_heap       heap;
+  size_t            start;
+  size_t            end;
+};
+
+static void* ht_top_worker(void* arg) {
+  ht_top_args* args = arg;
+  ht_top_scan(args->table, &args->heap, args->start, args->end);
+  return NULL;
+}
+
+// As ht_top_k, with threadcount threads each selecting the best k over a
+// range of the entries. Their results are then merged on the calling thread.
+// No thread may modify the table meanwhile
+hash_table_item** ht_top_k_parallel(const hash_table* restrict table,
+                                    size_t k, ht_item_cmp cmp,
+                                    size_t threadcount, size_t* count) {
+  size_t entries = table->entrycount;
+  if (threadcount > entries) threadcount = entries;
+  if (threadcount <= 1) return ht_top_k(table, k, cmp, count);
+
+  pthread_t*   threads = malloc(threadcount * sizeof(pthread_t));
+  ht_top_args* args    = malloc(threadcount * sizeof(ht_top_args));
+  if (!threads || !args) {
+    perror("malloc top k threads");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t t = 0; t < threadcount; ++t) {
+    args[t] = (ht_top_args){table, ht_top_heap_create(table, k, cmp),
+                            entries * t / threadcount,
+                            entries * (t + 1) / threadcount};
+    if (pthread_create(&threads[t], NULL, ht_top_worker, &args[t]) != 0) {
+      perror("pthread_create");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  ht_top_heap heap = ht_top_heap_create(table, k, cmp);
+  for (size_t t = 0; t < threadcount; ++t) {
+    pthread_join(threads[t], NULL);
+    for (size_t i = 0; i < args[t].heap.count; ++i)
+      ht_top_push(&heap, args[t].heap.items[i]);
+    free(args[t].heap.items);
+  }
+  free(args);
+  free(threads);
+
+  qsort(heap.items, heap.count, sizeof(hash_table_item*), cmp);
+  *count = heap.count;
+  return heap.items;
 }
 
 // Creates an iterator for a hashtable
@@ -247,7 +1149,7 @@ hash_table_iterator* ht_create_iter(const hash_table* restrict table) {
     exit(EXIT_FAILURE);
   }
   iter->table = table;
-  ht_iter_reset(iter);// find first item
+  ht_iter_reset(iter); // find first item
   return iter;
 }
 
@@ -256,44 +1158,34 @@ void ht_free_iter(hash_table_iterator* restrict iter) {
   free(iter);
 }
 
-// Resets an iterator, finding the first item if it exists
-hash_table_item* ht_iter_reset(hash_table_iterator* restrict iter) {
-  iter->item = NULL;
-  iter->slotidx = 0;
-  for (size_t i = 0; i < iter->table->size; ++i) {
-    hash_table_item* item = iter->table->slots[i];
-    if (item) {
-      iter->item = item;
-      iter->slotidx = i;
-      break;
-    }
+// points the iterator at the first item from entry idx on, skipping holes,
+// or at NULL past the end
+static hash_table_item* ht_iter_seek(hash_table_iterator* restrict iter,
+                                     size_t                        idx) {
+  const hash_table* table = iter->table;
+  while (idx < table->entrycount && !table->entries[idx]) idx++;
+  if (idx < table->entrycount) {
+    iter->item     = table->entries[idx];
+    iter->entryidx = idx;
+  } else {
+    iter->item     = NULL;
+    iter->entryidx = 0;
   }
   return iter->item;
 }
 
+// Resets an iterator, finding the first item if it exists
+hash_table_item* ht_iter_reset(hash_table_iterator* restrict iter) {
+  return ht_iter_seek(iter, 0);
+}
+
 // Returns current item pointed to by iterator
 hash_table_item* ht_iter_current(hash_table_iterator* restrict iter) {
   return iter->item;
 }
 
-// Moves iterator to point at the next item
+// Moves iterator to point at the next item, in insertion order
 hash_table_item* ht_iter_next(hash_table_iterator* restrict iter) {
   if (!iter->item) return NULL; // at end already
-  
-  if (iter->item->next) { // along linked list
-    iter->item = iter->item->next;
-    return iter->item;
-  }
-  iter->slotidx++; // next slot
-  while (iter->slotidx < iter->table->size) {
-    hash_table_item* item = iter->table->slots[iter->slotidx];
-    if (item) {
-      iter->item = item;
-      return item;
-    }
-    iter->slotidx++; // next slot
-  }
-  iter->item = NULL;
-  iter->slotidx = 0;
-  return NULL;
+  return ht_iter_seek(iter, iter->entryidx + 1);
 }
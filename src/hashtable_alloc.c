@@ -0,0 +1,107 @@
+#include "hashtable_alloc.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#endif
+
+static size_t ht_round_up(size_t size, size_t align) {
+  return (size + align - 1) / align * align;
+}
+
+// huge page blocks for big allocations, whole pages otherwise
+static size_t ht_map_align(size_t size) {
+  return size >= HT_HUGE_PAGE ? HT_HUGE_PAGE : (size_t)sysconf(_SC_PAGESIZE);
+}
+
+// maps size bytes, zeroed, at a multiple of ht_map_align. mmap only aligns
+// to pages, so a huge page block is carved out of a bigger mapping
+static void* ht_map(size_t size) {
+  size_t align = ht_map_align(size);
+  size_t len   = ht_round_up(size, align);
+  size_t extra = align > (size_t)sysconf(_SC_PAGESIZE) ? align : 0;
+  char*  map   = mmap(NULL, len + extra, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) return NULL;
+  if (!extra) return map;
+
+  char*  ptr  = (char*)ht_round_up((uintptr_t)map, align);
+  size_t head = (size_t)(ptr - map);
+  if (head) munmap(map, head);
+  if (extra - head) munmap(ptr + len, extra - head);
+#ifdef MADV_HUGEPAGE
+  madvise(ptr, len, MADV_HUGEPAGE); // only advice, so failure is harmless
+#endif
+  return ptr;
+}
+
+static void ht_unmap(void* ptr, size_t size) {
+  munmap(ptr, ht_round_up(size, ht_map_align(size)));
+}
+
+static void* ht_huge_alloc(void* ctx, size_t size, bool zero) {
+  (void)ctx;
+  if (size < HT_HUGE_PAGE) return zero ? calloc(1, size) : malloc(size);
+  return ht_map(size); // mapped memory is zeroed already
+}
+
+static void ht_huge_free(void* ctx, void* ptr, size_t size) {
+  (void)ctx;
+  if (size < HT_HUGE_PAGE)
+    free(ptr);
+  else
+    ht_unmap(ptr, size);
+}
+
+const ht_allocator ht_allocator_huge = {ht_huge_alloc, ht_huge_free, NULL};
+
+// binds the pages of [ptr, ptr + len) to node. Pages are only placed when
+// first touched, so nothing has been placed elsewhere yet
+static bool ht_bind(void* ptr, size_t len, int node) {
+#ifdef __linux__
+  unsigned long mask[HT_NUMA_NODES / (8 * sizeof(unsigned long))] = {0};
+  if (node < 0 || node >= HT_NUMA_NODES) {
+    errno = EINVAL;
+    return false;
+  }
+  mask[node / (8 * sizeof *mask)] |= 1UL << (node % (8 * sizeof *mask));
+  // the kernel takes one bit less than maxnode
+  return syscall(__NR_mbind, ptr, len, MPOL_BIND, mask, HT_NUMA_NODES + 1,
+                 0) == 0;
+#else
+  (void)ptr, (void)len, (void)node;
+  errno = ENOSYS;
+  return false;
+#endif
+}
+
+static void* ht_numa_alloc(void* ctx, size_t size, bool zero) {
+  if (size < HT_NUMA_MAP_MIN) return zero ? calloc(1, size) : malloc(size);
+  void* ptr = ht_map(size);
+  if (ptr && !ht_bind(ptr, ht_round_up(size, ht_map_align(size)),
+                      (int)(intptr_t)ctx)) {
+    int err = errno;
+    ht_unmap(ptr, size);
+    errno = err;
+    return NULL;
+  }
+  return ptr;
+}
+
+static void ht_numa_free(void* ctx, void* ptr, size_t size) {
+  (void)ctx;
+  if (size < HT_NUMA_MAP_MIN)
+    free(ptr);
+  else
+    ht_unmap(ptr, size);
+}
+
+// the node is kept in ctx itself, so the allocator needs no storage
+ht_allocator ht_allocator_numa(int node) {
+  return (ht_allocator){ht_numa_alloc, ht_numa_free, (void*)(intptr_t)node};
+}
@@ -0,0 +1,261 @@
+#include "hashtable_approx.h"
+#include "hashtable_hash.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HT_AP_MIN_CANDIDATES 64
+#define HT_AP_MIN_WIDTH      256
+
+static size_t prev_pow2(size_t n) {
+  size_t p = 1;
+  while (p <= n / 2) p <<= 1;
+  return p;
+}
+
+hash_table_approx* ht_ap_create(size_t bytes) {
+  hash_table_approx* approx = malloc(sizeof *approx);
+  if (!approx) {
+    perror("malloc approx");
+    exit(EXIT_FAILURE);
+  }
+  // the summary: a candidate and its heap slot each, and an index of at
+  // least 2 slots per candidate, so its load stays <= 0.5
+  size_t per_candidate = sizeof(ht_ap_candidate) + sizeof(uint32_t);
+  size_t summary       = bytes / 2;
+  size_t indexsize =
+      prev_pow2(summary / (per_candidate / 2 + sizeof(uint32_t)) + 1);
+  if (indexsize < 2 * HT_AP_MIN_CANDIDATES)
+    indexsize = 2 * HT_AP_MIN_CANDIDATES;
+  if (indexsize > UINT32_MAX) indexsize = (size_t)1 << 31;
+  size_t index_bytes = indexsize * sizeof(uint32_t);
+  size_t capacity    = summary > index_bytes
+                           ? (summary - index_bytes) / per_candidate
+                           : 0;
+  if (capacity > indexsize / 2) capacity = indexsize / 2;
+  if (capacity < HT_AP_MIN_CANDIDATES) capacity = HT_AP_MIN_CANDIDATES;
+  size_t width = prev_pow2(bytes / 2 / (HT_AP_DEPTH * sizeof(uint32_t)) + 1);
+  if (width < HT_AP_MIN_WIDTH) width = HT_AP_MIN_WIDTH;
+
+  approx->width      = width;
+  approx->capacity   = capacity;
+  approx->count      = 0;
+  approx->indexsize  = indexsize;
+  approx->total      = 0;
+  approx->sketch     = calloc(HT_AP_DEPTH * width, sizeof(uint32_t));
+  approx->candidates = malloc(capacity * sizeof(ht_ap_candidate));
+  approx->heap       = malloc(capacity * sizeof(uint32_t));
+  approx->index      = calloc(approx->indexsize, sizeof(uint32_t));
+  if (!approx->sketch || !approx->candidates || !approx->heap ||
+      !approx->index) {
+    perror("malloc approx");
+    exit(EXIT_FAILURE);
+  }
+  return approx;
+}
+
+void ht_ap_free(hash_table_approx* approx) {
+  free(approx->index);
+  free(approx->heap);
+  free(approx->candidates);
+  free(approx->sketch);
+  free(approx);
+}
+
+// the counter of row r for a hash. The rows' positions come from two halves
+// of the hash, h1 + r * h2, which is as good as independent hashes
+static inline uint32_t* ht_ap_counter(const hash_table_approx* approx,
+                                      uint64_t hash, unsigned r) {
+  uint32_t h1 = (uint32_t)hash;
+  uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+  return &approx->sketch[r * approx->width +
+                         ((h1 + r * h2) & (approx->width - 1))];
+}
+
+static inline uint32_t ht_ap_query(const hash_table_approx* approx,
+                                   uint64_t                 hash) {
+  uint32_t est = UINT32_MAX;
+  for (unsigned r = 0; r < HT_AP_DEPTH; r++) {
+    uint32_t c = *ht_ap_counter(approx, hash, r);
+    if (c < est) est = c;
+  }
+  return est;
+}
+
+// conservative update: only the counters at the current minimum are raised,
+// which keeps the estimate the same but overestimates other keys less
+static inline uint32_t ht_ap_update(hash_table_approx* approx, uint64_t hash) {
+  uint32_t est = ht_ap_query(approx, hash);
+  if (est < UINT32_MAX) est++;
+  for (unsigned r = 0; r < HT_AP_DEPTH; r++) {
+    uint32_t* c = ht_ap_counter(approx, hash, r);
+    if (*c < est) *c = est;
+  }
+  return est;
+}
+
+// summary index, open addressing with linear probing on the hash
+
+static inline bool ht_ap_matches(const ht_ap_candidate* cand, uint64_t hash,
+                                 const char* key, size_t len) {
+  return cand->hash == hash && cand->keylen == len &&
+         memcmp(cand->key, key, len < HT_AP_KEY ? len : HT_AP_KEY - 1) == 0;
+}
+
+// the index slot holding key, or the empty slot where it would go
+static inline size_t ht_ap_find(const hash_table_approx* approx,
+                                uint64_t hash, const char* key, size_t len) {
+  size_t mask = approx->indexsize - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    uint32_t c = approx->index[i];
+    if (!c || ht_ap_matches(&approx->candidates[c - 1], hash, key, len))
+      return i;
+  }
+}
+
+// empties an index slot, shifting back later entries of the probe run so
+// none is left behind a gap
+static void ht_ap_unindex(hash_table_approx* approx, size_t slot) {
+  size_t mask = approx->indexsize - 1;
+  for (size_t i = (slot + 1) & mask; approx->index[i]; i = (i + 1) & mask) {
+    size_t home = approx->candidates[approx->index[i] - 1].hash & mask;
+    // move i into slot unless its home lies cyclically in (slot, i]
+    if (((i - home) & mask) >= ((i - slot) & mask)) {
+      approx->index[slot] = approx->index[i];
+      slot                = i;
+    }
+  }
+  approx->index[slot] = 0;
+}
+
+// summary heap, with each candidate's position kept in heapidx
+
+static inline void ht_ap_heap_set(hash_table_approx* approx, size_t pos,
+                                  uint32_t c) {
+  approx->heap[pos]             = c;
+  approx->candidates[c].heapidx = (uint32_t)pos;
+}
+
+// moves the candidate at pos down after its count went up
+static void ht_ap_sift_down(hash_table_approx* approx, size_t pos) {
+  uint32_t c     = approx->heap[pos];
+  uint32_t count = approx->candidates[c].count;
+  for (;;) {
+    size_t child = 2 * pos + 1;
+    if (child >= approx->count) break;
+    if (child + 1 < approx->count &&
+        approx->candidates[approx->heap[child + 1]].count <
+            approx->candidates[approx->heap[child]].count)
+      child++;
+    if (approx->candidates[approx->heap[child]].count >= count) break;
+    ht_ap_heap_set(approx, pos, approx->heap[child]);
+    pos = child;
+  }
+  ht_ap_heap_set(approx, pos, c);
+}
+
+static void ht_ap_sift_up(hash_table_approx* approx, size_t pos) {
+  uint32_t c     = approx->heap[pos];
+  uint32_t count = approx->candidates[c].count;
+  while (pos > 0) {
+    size_t parent = (pos - 1) / 2;
+    if (approx->candidates[approx->heap[parent]].count <= count) break;
+    ht_ap_heap_set(approx, pos, approx->heap[parent]);
+    pos = parent;
+  }
+  ht_ap_heap_set(approx, pos, c);
+}
+
+static void ht_ap_fill(ht_ap_candidate* cand, uint64_t hash, const char* key,
+                       size_t len, uint32_t count) {
+  size_t copy  = len < HT_AP_KEY ? len : HT_AP_KEY - 1;
+  cand->hash   = hash;
+  cand->count  = count;
+  cand->keylen = (uint32_t)len;
+  memcpy(cand->key, key, copy);
+  cand->key[copy] = '\0';
+}
+
+uint32_t ht_ap_inc_n(hash_table_approx* approx, const char* key, size_t len) {
+  if (len > UINT32_MAX) { // the length identifies candidates, see ht_ap_find
+    errno = EOVERFLOW;
+    perror("key length");
+    exit(EXIT_FAILURE);
+  }
+  uint64_t hash = ht_hash_bytes(key, len);
+  uint32_t est  = ht_ap_update(approx, hash);
+  approx->total++;
+
+  size_t   slot = ht_ap_find(approx, hash, key, len);
+  uint32_t c    = approx->index[slot];
+  if (c) { // a candidate already
+    approx->candidates[c - 1].count = est;
+    ht_ap_sift_down(approx, approx->candidates[c - 1].heapidx);
+    return est;
+  }
+  if (approx->count < approx->capacity) {
+    c = (uint32_t)approx->count++;
+    ht_ap_fill(&approx->candidates[c], hash, key, len, est);
+    approx->heap[c]     = c;
+    approx->index[slot] = c + 1;
+    ht_ap_sift_up(approx, c);
+    return est;
+  }
+  c = approx->heap[0];
+  if (est <= approx->candidates[c].count) return est;
+
+  // replace the smallest candidate
+  ht_ap_candidate* cand = &approx->candidates[c];
+  ht_ap_unindex(approx,
+                ht_ap_find(approx, cand->hash, cand->key, cand->keylen));
+  ht_ap_fill(cand, hash, key, len, est);
+  approx->index[ht_ap_find(approx, hash, key, len)] = c + 1;
+  ht_ap_sift_down(approx, 0);
+  return est;
+}
+
+uint32_t ht_ap_inc(hash_table_approx* approx, const char* key) {
+  return ht_ap_inc_n(approx, key, strlen(key));
+}
+
+uint32_t ht_ap_estimate(const hash_table_approx* approx, const char* key,
+                        size_t len) {
+  return ht_ap_query(approx, ht_hash_bytes(key, len));
+}
+
+static int ht_ap_cmp_items(const void* a, const void* b) {
+  uint64_t a_val = ((const ht_ap_item*)a)->count;
+  uint64_t b_val = ((const ht_ap_item*)b)->count;
+  if (a_val == b_val) return 0;
+  return a_val < b_val ? 1 : -1;
+}
+
+// the summary is small, so all candidates are sorted. Counts are read from
+// the sketch, as they may have risen since a candidate was last seen
+ht_ap_item* ht_ap_top_k(const hash_table_approx* approx, size_t k,
+                        size_t* count) {
+  ht_ap_item* items = malloc(approx->count * sizeof *items + 1);
+  if (!items) {
+    perror("malloc approx top k");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t i = 0; i < approx->count; i++) {
+    const ht_ap_candidate* cand = &approx->candidates[i];
+    items[i] = (ht_ap_item){cand->key, cand->keylen,
+                            ht_ap_query(approx, cand->hash)};
+  }
+  qsort(items, approx->count, sizeof *items, ht_ap_cmp_items);
+  *count = k < approx->count ? k : approx->count;
+  return items;
+}
+
+double ht_ap_error(const hash_table_approx* approx) {
+  return 2.718281828459045 * (double)approx->total / (double)approx->width;
+}
+
+size_t ht_ap_bytes(const hash_table_approx* approx) {
+  return sizeof *approx + HT_AP_DEPTH * approx->width * sizeof(uint32_t) +
+         approx->capacity * (sizeof(ht_ap_candidate) + sizeof(uint32_t)) +
+         approx->indexsize * sizeof(uint32_t);
+}
@@ -0,0 +1,325 @@
+#include "hashtable_frozen.h"
+#include "hashtable_hash.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// murmur3's 64 bit finaliser
+static inline uint64_t ht_fz_mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccd;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53;
+  x ^= x >> 33;
+  return x;
+}
+
+// x scaled into [0, n), by the high half of x * n. Uses the high bits of x
+static inline uint64_t ht_fz_range(uint64_t x, uint64_t n) {
+  ht_wymum(&x, &n);
+  return n;
+}
+
+// the partition takes the high bits of the hash, the bucket within it the
+// low bits, rotated up
+static inline size_t ht_fz_part_of(size_t partcount, uint64_t hash) {
+  return ht_fz_range(hash, partcount);
+}
+
+static inline size_t ht_fz_bucket(const ht_fz_part* part, uint64_t hash) {
+  return ht_fz_range(hash << 32 | hash >> 32, part->buckets);
+}
+
+// the entry of a key within its partition. Mixed after the pilot is applied,
+// so each pilot gives keys an independent placement
+static inline size_t ht_fz_pos(const ht_fz_part* part, uint64_t hash,
+                               uint32_t pilot) {
+  return ht_fz_range(ht_fz_mix(hash ^ (pilot * 0x9e3779b97f4a7c15)),
+                     part->count);
+}
+
+typedef struct ht_fz_key ht_fz_key;
+struct ht_fz_key {
+  uint64_t               hash;
+  const hash_table_item* item;
+};
+
+static void* ht_fz_alloc(size_t size, const char* what) {
+  void* mem = malloc(size + 1); // never 0
+  if (!mem) {
+    perror(what);
+    exit(EXIT_FAILURE);
+  }
+  return mem;
+}
+
+// builds the perfect hash of one partition and fills its entries and keys.
+// keys are the partition's, keys_offset where its key bytes start. Returns
+// false if two keys share a hash
+static bool ht_fz_build_part(hash_table_frozen* frozen, size_t p,
+                             const ht_fz_key* keys, uint64_t keys_offset) {
+  const ht_fz_part* part    = &frozen->parts[p];
+  uint32_t*         pilots  = frozen->pilots + part->pilots;
+  size_t            count   = part->count;
+  size_t            buckets = part->buckets;
+
+  // counting sort of the keys by bucket
+  uint32_t*  starts = calloc(buckets + 1, sizeof *starts);
+  ht_fz_key* sorted = ht_fz_alloc(count * sizeof *sorted, "malloc fz keys");
+  if (!starts) {
+    perror("calloc fz buckets");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t i = 0; i < count; i++)
+    starts[ht_fz_bucket(part, keys[i].hash) + 1]++;
+  size_t maxsize = 0;
+  for (size_t b = 0; b < buckets; b++) {
+    if (starts[b + 1] > maxsize) maxsize = starts[b + 1];
+    starts[b + 1] += starts[b];
+  }
+  uint32_t* next = ht_fz_alloc(buckets * sizeof *next, "malloc fz buckets");
+  memcpy(next, starts, buckets * sizeof *next);
+  for (size_t i = 0; i < count; i++)
+    sorted[next[ht_fz_bucket(part, keys[i].hash)]++] = keys[i];
+
+  // buckets, largest first, as they are the hardest to place. Counting sort
+  // by size into next, which is free again
+  uint32_t* sizestarts = calloc(maxsize + 2, sizeof *sizestarts);
+  if (!sizestarts) {
+    perror("calloc fz sizes");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t b = 0; b < buckets; b++)
+    sizestarts[maxsize - (starts[b + 1] - starts[b]) + 1]++;
+  for (size_t s = 0; s <= maxsize; s++) sizestarts[s + 1] += sizestarts[s];
+  for (size_t b = 0; b < buckets; b++)
+    next[sizestarts[maxsize - (starts[b + 1] - starts[b])]++] = (uint32_t)b;
+
+  uint64_t* taken = calloc(count / 64 + 1, sizeof *taken);
+  size_t*   pos   = ht_fz_alloc(maxsize * sizeof *pos, "malloc fz positions");
+  const hash_table_item** items =
+      ht_fz_alloc(count * sizeof *items, "malloc fz items");
+  if (!taken) {
+    perror("calloc fz taken");
+    exit(EXIT_FAILURE);
+  }
+
+  bool ok = true;
+  for (size_t o = 0; o < buckets && ok; o++) {
+    size_t           b    = next[o];
+    const ht_fz_key* bkey = sorted + starts[b];
+    size_t           size = starts[b + 1] - starts[b];
+    if (size == 0) { // and so are all the rest
+      for (; o < buckets; o++) pilots[next[o]] = 0;
+      break;
+    }
+    for (size_t i = 0; i < size && ok; i++)
+      for (size_t j = 0; j < i; j++)
+        if (bkey[i].hash == bkey[j].hash) ok = false;
+
+    // with all but a few entries taken the last buckets need ~count tries,
+    // which bounds the search in practice
+    for (uint32_t pilot = 0; ok; pilot++) {
+      size_t i = 0;
+      for (; i < size; i++) {
+        pos[i] = ht_fz_pos(part, bkey[i].hash, pilot);
+        if (taken[pos[i] / 64] >> (pos[i] % 64) & 1) break;
+        size_t j = 0;
+        while (j < i && pos[j] != pos[i]) j++;
+        if (j < i) break;
+      }
+      if (i == size) {
+        for (i = 0; i < size; i++) {
+          taken[pos[i] / 64] |= 1ULL << (pos[i] % 64);
+          items[pos[i]] = bkey[i].item;
+        }
+        pilots[b] = pilot;
+        break;
+      }
+      if (pilot == UINT32_MAX) ok = false;
+    }
+  }
+
+  // entries and keys, in entry order
+  for (size_t e = 0; e < count && ok; e++) {
+    const hash_table_item* item  = items[e];
+    ht_fz_entry*           entry = &frozen->entries[part->offset + e];
+    *entry = (ht_fz_entry){.keylen = item->keylen, .value = item->value};
+    if (item->keylen < HT_FZ_INLINE_KEY) {
+      memcpy(entry->inline_key, item->key, item->keylen + 1);
+    } else {
+      entry->key_offset = keys_offset;
+      memcpy(frozen->keys + keys_offset, item->key, (size_t)item->keylen + 1);
+      keys_offset += (size_t)item->keylen + 1;
+    }
+  }
+
+  free(items);
+  free(pos);
+  free(taken);
+  free(sizestarts);
+  free(next);
+  free(sorted);
+  free(starts);
+  return ok;
+}
+
+typedef struct ht_fz_args ht_fz_args;
+struct ht_fz_args {
+  hash_table_frozen* frozen;
+  const ht_fz_key*   keys;      // grouped by partition
+  const size_t*      starts;    // of each partition in keys
+  const uint64_t*    keystarts; // of each partition in frozen->keys
+  size_t             first;     // partitions first, first + stride, ...
+  size_t             stride;
+  bool               ok;
+};
+
+static void* ht_fz_worker(void* arg) {
+  ht_fz_args* args = arg;
+  for (size_t p = args->first; p < args->frozen->partcount && args->ok;
+       p += args->stride)
+    args->ok = ht_fz_build_part(args->frozen, p, args->keys + args->starts[p],
+                                args->keystarts[p]);
+  return NULL;
+}
+
+// Freezes table into a new hash_table_frozen, building its partitions on
+// threadcount threads. No thread may modify the table meanwhile
+hash_table_frozen* ht_freeze_parallel(const hash_table* restrict table,
+                                      size_t threadcount) {
+  size_t itemcount = table->itemcount;
+  size_t partcount = itemcount / HT_FZ_PART_KEYS + 1;
+  if (threadcount > partcount) threadcount = partcount;
+  if (threadcount < 1) threadcount = 1;
+
+  hash_table_frozen* frozen = ht_fz_alloc(sizeof *frozen, "malloc frozen");
+  frozen->itemcount         = itemcount;
+  frozen->partcount         = partcount;
+  frozen->parts =
+      ht_fz_alloc(partcount * sizeof *frozen->parts, "malloc fz partitions");
+
+  // group the keys by partition with a counting sort, totalling the key
+  // bytes of each partition on the way
+  size_t*   starts    = calloc(partcount + 1, sizeof *starts);
+  uint64_t* keystarts = calloc(partcount + 1, sizeof *keystarts);
+  if (!starts || !keystarts) {
+    perror("calloc fz partitions");
+    exit(EXIT_FAILURE);
+  }
+  hash_table_iterator* iter = ht_create_iter(table);
+  for (hash_table_item* item = ht_iter_current(iter); item;
+       item                  = ht_iter_next(iter)) {
+    size_t p = ht_fz_part_of(partcount, ht_item_hash_bytes(table, item));
+    starts[p + 1]++;
+    if (item->keylen >= HT_FZ_INLINE_KEY)
+      keystarts[p + 1] += (size_t)item->keylen + 1;
+  }
+  size_t buckets = 0;
+  for (size_t p = 0; p < partcount; p++) {
+    size_t count     = starts[p + 1];
+    frozen->parts[p] = (ht_fz_part){
+        .offset  = starts[p],
+        .pilots  = buckets,
+        .count   = (uint32_t)count,
+        .buckets = (uint32_t)(count / HT_FZ_BUCKET_KEYS + 1)};
+    buckets += frozen->parts[p].buckets;
+    starts[p + 1] += starts[p];
+    keystarts[p + 1] += keystarts[p];
+  }
+  frozen->keybytes = keystarts[partcount];
+  frozen->pilots =
+      ht_fz_alloc(buckets * sizeof *frozen->pilots, "malloc fz pilots");
+  frozen->entries =
+      ht_fz_alloc(itemcount * sizeof *frozen->entries, "malloc fz entries");
+  frozen->keys = ht_fz_alloc(frozen->keybytes, "malloc fz key bytes");
+
+  ht_fz_key* keys = ht_fz_alloc(itemcount * sizeof *keys, "malloc fz keys");
+  size_t*    next = ht_fz_alloc(partcount * sizeof *next, "malloc fz next");
+  memcpy(next, starts, partcount * sizeof *next);
+  for (hash_table_item* item = ht_iter_reset(iter); item;
+       item                  = ht_iter_next(iter)) {
+    uint64_t hash = ht_item_hash_bytes(table, item);
+    keys[next[ht_fz_part_of(partcount, hash)]++] = (ht_fz_key){hash, item};
+  }
+  ht_free_iter(iter);
+  free(next);
+
+  pthread_t* threads =
+      ht_fz_alloc(threadcount * sizeof *threads, "malloc fz threads");
+  ht_fz_args* args = ht_fz_alloc(threadcount * sizeof *args, "malloc fz args");
+  for (size_t t = 0; t < threadcount; ++t) {
+    args[t] = (ht_fz_args){frozen, keys, starts, keystarts, t, threadcount,
+                           true};
+    if (t == 0) continue; // the calling thread does its share below
+    if (pthread_create(&threads[t], NULL, ht_fz_worker, &args[t]) != 0) {
+      perror("pthread_create");
+      exit(EXIT_FAILURE);
+    }
+  }
+  ht_fz_worker(&args[0]);
+  bool ok = args[0].ok;
+  for (size_t t = 1; t < threadcount; ++t) {
+    pthread_join(threads[t], NULL);
+    ok = ok && args[t].ok;
+  }
+  free(args);
+  free(threads);
+  free(keys);
+  free(keystarts);
+  free(starts);
+
+  if (!ok) {
+    ht_fz_free(frozen);
+    errno = EINVAL;
+    return NULL;
+  }
+  return frozen;
+}
+
+hash_table_frozen* ht_freeze(const hash_table* restrict table) {
+  return ht_freeze_parallel(table, 1);
+}
+
+void ht_fz_free(hash_table_frozen* frozen) {
+  free(frozen->keys);
+  free(frozen->entries);
+  free(frozen->pilots);
+  free(frozen->parts);
+  free(frozen);
+}
+
+bool ht_fz_get_n(const hash_table_frozen* frozen, const char* key, size_t len,
+                 ht_value_t* value) {
+  uint64_t          hash = ht_hash_bytes(key, len);
+  const ht_fz_part* part =
+      &frozen->parts[ht_fz_part_of(frozen->partcount, hash)];
+  if (part->count == 0) return false; // else pos would be another's entry
+  uint32_t pilot = frozen->pilots[part->pilots + ht_fz_bucket(part, hash)];
+  const ht_fz_entry* e =
+      &frozen->entries[part->offset + ht_fz_pos(part, hash, pilot)];
+  if (e->keylen != len || memcmp(ht_fz_entry_key(frozen, e), key, len) != 0)
+    return false;
+  *value = e->value;
+  return true;
+}
+
+bool ht_fz_get(const hash_table_frozen* frozen, ht_key_t key,
+               ht_value_t* value) {
+  return ht_fz_get_n(frozen, key, strlen(key), value);
+}
+
+size_t ht_fz_itemcount(const hash_table_frozen* frozen) {
+  return frozen->itemcount;
+}
+
+size_t ht_fz_bytes(const hash_table_frozen* frozen) {
+  size_t buckets = 0;
+  for (size_t p = 0; p < frozen->partcount; p++)
+    buckets += frozen->parts[p].buckets;
+  return sizeof *frozen + frozen->partcount * sizeof *frozen->parts +
+         buckets * sizeof *frozen->pilots +
+         frozen->itemcount * sizeof *frozen->entries + frozen->keybytes;
+}
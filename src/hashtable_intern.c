@@ -0,0 +1,154 @@
+#include "hashtable_intern.h"
+#include "hashtable.h"
+#include "hashtable_hash.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// grow once the index is 3/4 full. Probes are short at that load with the
+// hash check in the slot
+static inline size_t ht_intern_capacity(size_t size) { return size / 4 * 3; }
+
+static ht_intern_slot* ht_intern_alloc_slots(size_t size) {
+  ht_intern_slot* slots = calloc(size, sizeof *slots);
+  if (!slots) {
+    perror("calloc intern slots");
+    exit(EXIT_FAILURE);
+  }
+  return slots;
+}
+
+static inline uint64_t
+ht_intern_hash(const hash_table_intern* restrict table, const char* key,
+               size_t len) {
+  return ht_hash_wyhash_seeded(key, len, table->seed);
+}
+
+// doubles *n until it is at least need, and reallocs ptr to *n items of
+// itemsize
+static void* ht_intern_grow(void* ptr, size_t itemsize, size_t* n,
+                            size_t need, const char* what) {
+  size_t cap = *n ? *n : 16;
+  while (cap < need) cap *= 2;
+  ptr = realloc(ptr, cap * itemsize);
+  if (!ptr) {
+    perror(what);
+    exit(EXIT_FAILURE);
+  }
+  *n = cap;
+  return ptr;
+}
+
+hash_table_intern* ht_intern_create(size_t size) {
+  hash_table_intern* table = calloc(1, sizeof *table);
+  if (!table) {
+    perror("calloc intern table");
+    exit(EXIT_FAILURE);
+  }
+  table->size = 8;
+  while (ht_intern_capacity(table->size) < size) table->size *= 2;
+  table->slots      = ht_intern_alloc_slots(table->size);
+  table->offsets    = ht_intern_grow(NULL, sizeof(size_t), &table->offcap,
+                                     size + 1, "malloc intern offsets");
+  table->offsets[0] = 0;
+  table->seed       = ht_random_seed();
+  return table;
+}
+
+void ht_intern_free(hash_table_intern* table) {
+  free(table->slots);
+  free(table->offsets);
+  free(table->pool);
+  free(table);
+}
+
+static inline size_t ht_intern_keylen(const hash_table_intern* restrict table,
+                                      uint32_t                          id) {
+  return table->offsets[id + 1] - table->offsets[id] - 1;
+}
+
+// the slot holding key, or the empty slot ending its probe sequence
+static inline ht_intern_slot*
+ht_intern_find_slot(const hash_table_intern* restrict table, const char* key,
+                    size_t len, uint64_t hash) {
+  uint32_t high = (uint32_t)(hash >> 32);
+  size_t   mask = table->size - 1;
+  for (size_t idx = hash & mask;; idx = (idx + 1) & mask) {
+    ht_intern_slot* slot = &table->slots[idx];
+    if (!slot->ref) return slot;
+    uint32_t id = slot->ref - 1;
+    if (slot->hash == high && ht_intern_keylen(table, id) == len &&
+        memcmp(table->pool + table->offsets[id], key, len) == 0)
+      return slot;
+  }
+}
+
+// doubles the index. Hashes are recomputed from the pool, in one sequential
+// pass over it
+static void ht_intern_rehash(hash_table_intern* restrict table) {
+  free(table->slots);
+  table->size *= 2;
+  table->slots = ht_intern_alloc_slots(table->size);
+  size_t mask  = table->size - 1;
+  for (uint32_t id = 0; id < table->count; id++) {
+    uint64_t hash = ht_intern_hash(table, table->pool + table->offsets[id],
+                                   ht_intern_keylen(table, id));
+    size_t   idx  = hash & mask;
+    while (table->slots[idx].ref) idx = (idx + 1) & mask;
+    table->slots[idx] = (ht_intern_slot){id + 1, (uint32_t)(hash >> 32)};
+  }
+}
+
+uint32_t ht_intern_n(hash_table_intern* restrict table, const char* key,
+                     size_t len) {
+  uint64_t        hash = ht_intern_hash(table, key, len);
+  ht_intern_slot* slot = ht_intern_find_slot(table, key, len, hash);
+  if (slot->ref) return slot->ref - 1;
+
+  if (table->count == HT_INTERN_NONE) {
+    fputs("ht_intern: out of ids\n", stderr);
+    exit(EXIT_FAILURE);
+  }
+  if (table->poolsize + len + 1 > table->poolcap)
+    table->pool = ht_intern_grow(table->pool, 1, &table->poolcap,
+                                 table->poolsize + len + 1,
+                                 "realloc intern pool");
+  if (table->count + 2 > table->offcap)
+    table->offsets =
+        ht_intern_grow(table->offsets, sizeof(size_t), &table->offcap,
+                       table->count + 2, "realloc intern offsets");
+  uint32_t id = (uint32_t)table->count++;
+  memcpy(table->pool + table->poolsize, key, len);
+  table->pool[table->poolsize + len] = '\0';
+  table->poolsize += len + 1;
+  table->offsets[id + 1] = table->poolsize;
+
+  *slot = (ht_intern_slot){id + 1, (uint32_t)(hash >> 32)};
+  if (table->count > ht_intern_capacity(table->size)) ht_intern_rehash(table);
+  return id;
+}
+
+uint32_t ht_intern(hash_table_intern* restrict table, const char* key) {
+  return ht_intern_n(table, key, strlen(key));
+}
+
+uint32_t ht_intern_find_n(const hash_table_intern* restrict table,
+                          const char* key, size_t len) {
+  const ht_intern_slot* slot =
+      ht_intern_find_slot(table, key, len, ht_intern_hash(table, key, len));
+  return slot->ref ? slot->ref - 1 : HT_INTERN_NONE;
+}
+
+uint32_t ht_intern_find(const hash_table_intern* restrict table,
+                        const char*                       key) {
+  return ht_intern_find_n(table, key, strlen(key));
+}
+
+const char* ht_key_of(const hash_table_intern* restrict table, uint32_t id) {
+  return table->pool + table->offsets[id];
+}
+
+size_t ht_keylen_of(const hash_table_intern* restrict table, uint32_t id) {
+  return ht_intern_keylen(table, id);
+}
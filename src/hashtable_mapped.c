@@ -0,0 +1,273 @@
+#include "hashtable_mapped.h"
+#include "hashtable_hash.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HT_MP_BYTE_ORDER 0x01020304
+
+static uint64_t ht_mp_hash_check(void) {
+  return ht_hash_bytes(HT_MP_MAGIC, sizeof HT_MP_MAGIC - 1);
+}
+
+// writes the snapshot to fp. Entries are grouped by bucket with a counting
+// sort, using the cached hashes, so no key is rehashed unless the table is
+// seeded
+static bool ht_mp_write(const hash_table* restrict table, FILE* fp) {
+  size_t bucketcount = 1;
+  while (bucketcount < table->itemcount) bucketcount <<= 1; // load <= 1
+
+  ht_mp_header header = {.version        = HT_MP_VERSION,
+                         .byte_order     = HT_MP_BYTE_ORDER,
+                         .hash_check     = ht_mp_hash_check(),
+                         .itemcount      = table->itemcount,
+                         .bucketcount    = bucketcount,
+                         .buckets_offset = sizeof(ht_mp_header)};
+  memcpy(header.magic, HT_MP_MAGIC, sizeof header.magic); // not terminated
+
+  uint64_t*    buckets = calloc(bucketcount + 1, sizeof(uint64_t));
+  ht_mp_entry* entries = malloc(table->itemcount * sizeof(ht_mp_entry) + 1);
+  if (!buckets || !entries) {
+    perror("malloc snapshot");
+    exit(EXIT_FAILURE);
+  }
+
+  hash_table_iterator* iter = ht_create_iter(table);
+  for (hash_table_item* item = ht_iter_current(iter); item;
+       item                  = ht_iter_next(iter)) {
+    buckets[(ht_item_hash_bytes(table, item) & (bucketcount - 1)) + 1]++;
+    header.keybytes += (size_t)item->keylen + 1;
+  }
+  for (size_t b = 0; b < bucketcount; b++) buckets[b + 1] += buckets[b];
+
+  header.entries_offset =
+      header.buckets_offset + (bucketcount + 1) * sizeof(uint64_t);
+  header.keys_offset =
+      header.entries_offset + table->itemcount * sizeof(ht_mp_entry);
+
+  bool ok = fwrite(&header, sizeof header, 1, fp) == 1 &&
+            fwrite(buckets, sizeof(uint64_t), bucketcount + 1, fp) ==
+                bucketcount + 1;
+
+  // buckets[b] now serves as the next free entry of bucket b, it has been
+  // written out already. Keys are written in iteration order
+  uint64_t key_offset = 0;
+  for (hash_table_item* item = ht_iter_reset(iter); item && ok;
+       item                  = ht_iter_next(iter)) {
+    uint64_t hash = ht_item_hash_bytes(table, item);
+    entries[buckets[hash & (bucketcount - 1)]++] =
+        (ht_mp_entry){hash, key_offset, item->keylen, item->value};
+    key_offset += (size_t)item->keylen + 1;
+  }
+  ok = ok && fwrite(entries, sizeof(ht_mp_entry), table->itemcount, fp) ==
+                 table->itemcount;
+  for (hash_table_item* item = ht_iter_reset(iter); item && ok;
+       item                  = ht_iter_next(iter)) {
+    size_t len = (size_t)item->keylen + 1;
+    ok         = fwrite(item->key, 1, len, fp) == len;
+  }
+
+  ht_free_iter(iter);
+  free(entries);
+  free(buckets);
+  return ok;
+}
+
+// Saves the table to path, which is written under a temporary name and then
+// renamed, so readers never see a partial file
+bool ht_save(const hash_table* restrict table, const char* path) {
+  size_t tmplen = strlen(path) + 5;
+  char*  tmp    = malloc(tmplen);
+  if (!tmp) {
+    perror("malloc path");
+    exit(EXIT_FAILURE);
+  }
+  snprintf(tmp, tmplen, "%s.tmp", path);
+
+  FILE* fp = fopen(tmp, "wbe");
+  bool  ok = fp && ht_mp_write(table, fp);
+  if (fp && fclose(fp) != 0) ok = false;
+  if (ok && rename(tmp, path) != 0) ok = false;
+  if (!ok) {
+    int saved = errno;
+    unlink(tmp);
+    errno = saved;
+  }
+  free(tmp);
+  return ok;
+}
+
+// checks that the header and all sections fit in the mapping. Checking
+// bucket ranges and keys here would read the whole file, so they are checked
+// as they are read, see ht_mp_entry_key
+static bool ht_mp_valid(const ht_mp_header* h, size_t maplen) {
+  if (maplen < sizeof *h || memcmp(h->magic, HT_MP_MAGIC, 8) != 0 ||
+      h->version != HT_MP_VERSION || h->byte_order != HT_MP_BYTE_ORDER ||
+      h->hash_check != ht_mp_hash_check())
+    return false;
+  if (h->bucketcount == 0 || (h->bucketcount & (h->bucketcount - 1)) ||
+      h->bucketcount > maplen / sizeof(uint64_t) ||
+      h->itemcount > maplen / sizeof(ht_mp_entry))
+    return false;
+  return h->buckets_offset == sizeof *h &&
+         h->entries_offset ==
+             h->buckets_offset + (h->bucketcount + 1) * sizeof(uint64_t) &&
+         h->keys_offset ==
+             h->entries_offset + h->itemcount * sizeof(ht_mp_entry) &&
+         h->keys_offset <= maplen && h->keybytes <= maplen - h->keys_offset;
+}
+
+// Maps a snapshot written by ht_save. Only the header is read here, the OS
+// pages in the rest as lookups touch it
+hash_table_mapped* ht_open_mapped(const char* path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return NULL;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return NULL;
+  }
+  size_t maplen = st.st_size;
+  void*  mem    = maplen ? mmap(NULL, maplen, PROT_READ, MAP_SHARED, fd, 0)
+                         : MAP_FAILED;
+  close(fd); // the mapping stays valid
+  if (mem == MAP_FAILED) {
+    if (!maplen) errno = EINVAL;
+    return NULL;
+  }
+  if (!ht_mp_valid(mem, maplen)) {
+    munmap(mem, maplen);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  hash_table_mapped* map = malloc(sizeof *map);
+  if (!map) {
+    perror("malloc mapped table");
+    exit(EXIT_FAILURE);
+  }
+  const char* base = mem;
+  map->header      = mem;
+  map->maplen      = maplen;
+  map->buckets     = (const uint64_t*)(base + map->header->buckets_offset);
+  map->entries     = (const ht_mp_entry*)(base + map->header->entries_offset);
+  map->keys        = base + map->header->keys_offset;
+  map->table       = NULL;
+  return map;
+}
+
+static void ht_mp_unmap(hash_table_mapped* map) {
+  if (map->header) munmap((void*)map->header, map->maplen);
+  map->header  = NULL;
+  map->buckets = NULL;
+  map->entries = NULL;
+  map->keys    = NULL;
+}
+
+void ht_mp_close(hash_table_mapped* map) {
+  ht_mp_unmap(map);
+  if (map->table) ht_free(map->table);
+  free(map);
+}
+
+// the key of an entry, or NULL if it doesn't lie within keys, in a corrupt
+// snapshot
+static inline const char* ht_mp_entry_key(const hash_table_mapped* map,
+                                          const ht_mp_entry*       e) {
+  uint64_t keybytes = map->header->keybytes;
+  if (e->key_offset >= keybytes || e->keylen >= keybytes - e->key_offset)
+    return NULL; // no room for the key and its NUL
+  return map->keys + e->key_offset;
+}
+
+// copies every entry into a new hash_table, and drops the mapping. Entries
+// with a corrupt key are left out, as lookups can't find them either
+hash_table* ht_mp_table(hash_table_mapped* map) {
+  if (map->table) return map->table;
+  size_t itemcount = map->header->itemcount;
+  map->table       = ht_create(itemcount * 5 / 4); // below the grow load
+  for (size_t i = 0; i < itemcount; i++) {
+    const ht_mp_entry* e   = &map->entries[i];
+    const char*        key = ht_mp_entry_key(map, e);
+    if (key) ht_insert_n(map->table, key, e->keylen, e->value);
+  }
+  ht_mp_unmap(map);
+  return map->table;
+}
+
+bool ht_mp_get_n(const hash_table_mapped* map, const char* key, size_t len,
+                 ht_value_t* value) {
+  if (map->table) {
+    hash_table_item* item = ht_get_n(map->table, key, len);
+    if (item) *value = item->value;
+    return item != NULL;
+  }
+  uint64_t hash  = ht_hash_bytes(key, len);
+  size_t   b     = hash & (map->header->bucketcount - 1);
+  uint64_t begin = map->buckets[b];
+  uint64_t end   = map->buckets[b + 1];
+  if (begin > end || end > map->header->itemcount) {
+    errno = EINVAL;
+    return false;
+  }
+  for (uint64_t i = begin; i < end; i++) {
+    const ht_mp_entry* e = &map->entries[i];
+    if (e->hash != hash || e->keylen != len) continue;
+    const char* ekey = ht_mp_entry_key(map, e);
+    if (!ekey) {
+      errno = EINVAL;
+      return false;
+    }
+    if (memcmp(ekey, key, len) == 0) {
+      *value = e->value;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ht_mp_get(const hash_table_mapped* map, ht_key_t key, ht_value_t* value) {
+  return ht_mp_get_n(map, key, strlen(key), value);
+}
+
+size_t ht_mp_itemcount(const hash_table_mapped* map) {
+  return map->table ? map->table->itemcount : map->header->itemcount;
+}
+
+void ht_mp_insert_n(hash_table_mapped* map, const char* key, size_t len,
+                    ht_value_t value) {
+  ht_insert_n(ht_mp_table(map), key, len, value);
+}
+
+void ht_mp_insert(hash_table_mapped* map, ht_key_t key, ht_value_t value) {
+  ht_mp_insert_n(map, key, strlen(key), value);
+}
+
+void ht_mp_delete_n(hash_table_mapped* map, const char* key, size_t len) {
+  ht_delete_n(ht_mp_table(map), key, len);
+}
+
+void ht_mp_delete(hash_table_mapped* map, ht_key_t key) {
+  ht_mp_delete_n(map, key, strlen(key));
+}
+
+ht_value_t ht_mp_inc_n(hash_table_mapped* map, const char* key, size_t len) {
+  return ht_inc_n(ht_mp_table(map), key, len)->value;
+}
+
+ht_value_t ht_mp_inc(hash_table_mapped* map, ht_key_t key) {
+  return ht_mp_inc_n(map, key, strlen(key));
+}
+
+ht_value_t ht_mp_dec_n(hash_table_mapped* map, const char* key, size_t len) {
+  return ht_dec_n(ht_mp_table(map), key, len)->value;
+}
+
+ht_value_t ht_mp_dec(hash_table_mapped* map, ht_key_t key) {
+  return ht_mp_dec_n(map, key, strlen(key));
+}
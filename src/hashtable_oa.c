@@ -0,0 +1,404 @@
+#include "hashtable_oa.h"
+#include "hashtable_hash.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) && !defined(HT_OA_NO_SIMD)
+#include <emmintrin.h>
+#define HT_OA_SSE2
+#endif
+
+// control byte values. Full slots hold 0b0xxxxxxx, the low 7 bits of the hash
+#define CTRL_EMPTY   ((int8_t)-128) // 0b10000000
+#define CTRL_DELETED ((int8_t)-2)   // 0b11111110
+
+typedef uint32_t ht_oa_mask; // one bit per slot of a group
+
+// the group matchers return a bitmask of the slots in a group of
+// HT_OA_GROUP control bytes which:
+
+// ... hold the given 7 hash bits
+static inline ht_oa_mask group_match(const int8_t* ctrl, int8_t h2) {
+#ifdef HT_OA_SSE2
+  __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+  return (ht_oa_mask)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(group, _mm_set1_epi8(h2)));
+#else
+  ht_oa_mask mask = 0;
+  for (unsigned i = 0; i < HT_OA_GROUP; ++i)
+    mask |= (ht_oa_mask)(ctrl[i] == h2) << i;
+  return mask;
+#endif
+}
+
+// ... are empty
+static inline ht_oa_mask group_match_empty(const int8_t* ctrl) {
+  return group_match(ctrl, CTRL_EMPTY);
+}
+
+// ... are empty or deleted, ie have the sign bit set
+static inline ht_oa_mask group_match_free(const int8_t* ctrl) {
+#ifdef HT_OA_SSE2
+  return (ht_oa_mask)_mm_movemask_epi8(
+      _mm_loadu_si128((const __m128i*)ctrl));
+#else
+  ht_oa_mask mask = 0;
+  for (unsigned i = 0; i < HT_OA_GROUP; ++i)
+    mask |= (ht_oa_mask)(ctrl[i] < 0) << i;
+  return mask;
+#endif
+}
+
+// table sizes are a power of 2, and at least one group
+static size_t ht_oa_round_size(size_t size) {
+  size_t rounded = HT_OA_GROUP;
+  while (rounded < size) rounded <<= 1;
+  return rounded;
+}
+
+// the same hash function as hash_table. The low 7 bits go into the control
+// byte and the rest select the group.
+static inline uint64_t ht_oa_hash(const char* restrict key, size_t len) {
+  return ht_hash_bytes(key, len);
+}
+
+static inline int8_t ht_oa_h2(uint64_t hash) { return (int8_t)(hash & 0x7f); }
+
+// first group of the probe sequence
+static inline size_t ht_oa_h1(const hash_table_oa* restrict table,
+                              uint64_t                      hash) {
+  return (hash >> 7) & (table->size / HT_OA_GROUP - 1);
+}
+
+// groups are probed in triangular steps, 1, 2, 3.. which visits every group
+// exactly once because the group count is a power of 2
+static inline size_t ht_oa_next_group(const hash_table_oa* restrict table,
+                                      size_t group, size_t step) {
+  return (group + step) & (table->size / HT_OA_GROUP - 1);
+}
+
+// entries allocated for a table size, the most the load factor lets it hold
+static inline size_t ht_oa_capacity(size_t size) { return size / 8 * 7; }
+
+// allocates empty slots and entries for size
+static void ht_oa_alloc(hash_table_oa* restrict table, size_t size) {
+  table->ctrl    = malloc(size);
+  table->index   = malloc(size * sizeof(uint32_t));
+  table->entries = malloc(ht_oa_capacity(size) * sizeof(hash_table_oa_item));
+  if (!table->ctrl || !table->index || !table->entries) {
+    perror("malloc slots");
+    exit(EXIT_FAILURE);
+  }
+  memset(table->ctrl, CTRL_EMPTY, size);
+  table->size       = size;
+  table->entrycount = 0;
+  table->tombstones = 0;
+}
+
+// Creates a new hash_table_oa
+hash_table_oa* ht_oa_create(size_t size) {
+  hash_table_oa* table = malloc(sizeof *table);
+  if (!table) {
+    perror("malloc table");
+    exit(EXIT_FAILURE);
+  }
+  ht_oa_alloc(table, ht_oa_round_size(size));
+  table->itemcount = 0;
+  return table;
+}
+
+// Frees the whole hashtable
+void ht_oa_free(hash_table_oa* restrict table) {
+  for (size_t i = 0; i < table->entrycount; i++) free(table->entries[i].key);
+  free(table->ctrl);
+  free(table->index);
+  free(table->entries);
+  free(table);
+}
+
+// finds the slot index holding a key, or SIZE_MAX if it doesn't exist
+static size_t ht_oa_find_slot(const hash_table_oa* restrict table,
+                              const char* key, size_t len, uint64_t hash) {
+  int8_t h2    = ht_oa_h2(hash);
+  size_t group = ht_oa_h1(table, hash);
+  for (size_t step = 1;; ++step) {
+    const int8_t* ctrl = table->ctrl + group * HT_OA_GROUP;
+    for (ht_oa_mask m = group_match(ctrl, h2); m; m &= m - 1) {
+      size_t idx = group * HT_OA_GROUP + __builtin_ctz(m);
+      const hash_table_oa_item* item = &table->entries[table->index[idx]];
+      if (item->keylen == len && memcmp(item->key, key, len) == 0) return idx;
+    }
+    // an empty slot ends the probe sequence: the key would have been put here
+    if (group_match_empty(ctrl)) return SIZE_MAX;
+    group = ht_oa_next_group(table, group, step);
+  }
+}
+
+// finds the first empty or deleted slot on the probe sequence for hash.
+// Terminates because the load factor guarantees free slots exist
+static size_t ht_oa_find_free(const hash_table_oa* restrict table,
+                              uint64_t                      hash) {
+  size_t group = ht_oa_h1(table, hash);
+  for (size_t step = 1;; ++step) {
+    ht_oa_mask m = group_match_free(table->ctrl + group * HT_OA_GROUP);
+    if (m) return group * HT_OA_GROUP + __builtin_ctz(m);
+    group = ht_oa_next_group(table, group, step);
+  }
+}
+
+// the item in a full slot
+static inline hash_table_oa_item*
+ht_oa_slot_item(const hash_table_oa* restrict table, size_t idx) {
+  return &table->entries[table->index[idx]];
+}
+
+// rebuilds the slots for new_size, and compacts the entries, keeping their
+// order but dropping the deleted ones
+void ht_oa_rehash(hash_table_oa* restrict table, size_t new_size) {
+  new_size = ht_oa_round_size(new_size);
+
+  int8_t*             octrl    = table->ctrl;
+  uint32_t*           oindex   = table->index;
+  hash_table_oa_item* oentries = table->entries;
+  size_t              ocount   = table->entrycount;
+
+  ht_oa_alloc(table, new_size);
+  for (size_t i = 0; i < ocount; i++) {
+    if (!oentries[i].key) continue;
+    uint64_t hash     = ht_oa_hash(oentries[i].key, oentries[i].keylen);
+    size_t   idx      = ht_oa_find_free(table, hash);
+    table->ctrl[idx]  = ht_oa_h2(hash);
+    table->index[idx] = (uint32_t)table->entrycount;
+    table->entries[table->entrycount++] = oentries[i];
+  }
+  free(octrl);
+  free(oindex);
+  free(oentries);
+}
+
+// puts a new key into a free slot and the next entry, growing the table
+// first if the load factor (counting tombstones) would go above 7/8, or
+// compacting it if the entries have run out. keylen is 32 bits, longer keys
+// are fatal
+static hash_table_oa_item* ht_oa_create_item(hash_table_oa* restrict table,
+                                             const char* key, size_t len,
+                                             uint64_t hash, ht_value_t value) {
+  if (len > UINT32_MAX) {
+    errno = EOVERFLOW;
+    perror("key length");
+    exit(EXIT_FAILURE);
+  }
+  if ((table->itemcount + table->tombstones + 1) * 8 > table->size * 7 ||
+      table->entrycount == ht_oa_capacity(table->size)) {
+    // mostly tombstones or holes => same size rehash just clears them
+    size_t new_size =
+        (table->itemcount + 1) * 16 > table->size * 7 ? table->size * 2
+                                                      : table->size;
+    ht_oa_rehash(table, new_size);
+  }
+  size_t idx = ht_oa_find_free(table, hash);
+  if (table->ctrl[idx] == CTRL_DELETED) table->tombstones--;
+  table->ctrl[idx]  = ht_oa_h2(hash);
+  table->index[idx] = (uint32_t)table->entrycount;
+
+  hash_table_oa_item* item = &table->entries[table->entrycount++];
+  item->key                = malloc(len + 1); // take a copy
+  if (!item->key) {
+    perror("malloc key");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(item->key, key, len);
+  item->key[len] = '\0';
+  item->keylen   = (uint32_t)len;
+  item->value    = value;
+  table->itemcount++;
+  return item;
+}
+
+// Inserts an item (or updates if exists)
+hash_table_oa_item* ht_oa_insert_n(hash_table_oa* restrict table,
+                                   const char* key, size_t len,
+                                   ht_value_t value) {
+  uint64_t hash = ht_oa_hash(key, len);
+  size_t   idx  = ht_oa_find_slot(table, key, len, hash);
+  if (idx != SIZE_MAX) {
+    hash_table_oa_item* item = ht_oa_slot_item(table, idx);
+    item->value              = value; // update value, free old value if needed
+    return item;
+  }
+  return ht_oa_create_item(table, key, len, hash, value);
+}
+
+hash_table_oa_item* ht_oa_insert(hash_table_oa* restrict table, ht_key_t key,
+                                 ht_value_t value) {
+  return ht_oa_insert_n(table, key, strlen(key), value);
+}
+
+// Deletes an item from the table
+void ht_oa_delete_n(hash_table_oa* restrict table, const char* key,
+                    size_t len) {
+  size_t idx = ht_oa_find_slot(table, key, len, ht_oa_hash(key, len));
+  if (idx == SIZE_MAX) return;
+
+  // leave a hole in the entries, unless it was the last one
+  hash_table_oa_item* item = ht_oa_slot_item(table, idx);
+  free(item->key);
+  item->key = NULL;
+  if (table->index[idx] + 1 == table->entrycount) table->entrycount--;
+
+  // if the group still has an empty slot no probe sequence ever continued
+  // past it, so this slot can become empty too. Otherwise leave a tombstone
+  const int8_t* group = table->ctrl + idx / HT_OA_GROUP * HT_OA_GROUP;
+  if (group_match_empty(group)) {
+    table->ctrl[idx] = CTRL_EMPTY;
+  } else {
+    table->ctrl[idx] = CTRL_DELETED;
+    table->tombstones++;
+  }
+  table->itemcount--;
+  if (table->size > HT_OA_GROUP && table->itemcount * 100 / table->size < 20)
+    ht_oa_rehash(table, table->size / 2);
+}
+
+void ht_oa_delete(hash_table_oa* restrict table, ht_key_t key) {
+  ht_oa_delete_n(table, key, strlen(key));
+}
+
+// Searches the key in the hashtable
+// and returns NULL ptr if it doesn't exist
+hash_table_oa_item* ht_oa_get_n(const hash_table_oa* restrict table,
+                                const char* key, size_t len) {
+  size_t idx = ht_oa_find_slot(table, key, len, ht_oa_hash(key, len));
+  return idx == SIZE_MAX ? NULL : ht_oa_slot_item(table, idx);
+}
+
+hash_table_oa_item* ht_oa_get(const hash_table_oa* restrict table,
+                              ht_key_t                      key) {
+  return ht_oa_get_n(table, key, strlen(key));
+}
+
+// returns the item for a key, inserting it with value if it doesn't exist
+hash_table_oa_item* ht_oa_get_or_create_n(hash_table_oa* restrict table,
+                                          const char* key, size_t len,
+                                          ht_value_t value) {
+  uint64_t hash = ht_oa_hash(key, len);
+  size_t   idx  = ht_oa_find_slot(table, key, len, hash);
+  if (idx != SIZE_MAX) return ht_oa_slot_item(table, idx);
+  return ht_oa_create_item(table, key, len, hash, value);
+}
+
+hash_table_oa_item* ht_oa_get_or_create(hash_table_oa* restrict table,
+                                        ht_key_t key, ht_value_t value) {
+  return ht_oa_get_or_create_n(table, key, strlen(key), value);
+}
+
+hash_table_oa_item* ht_oa_inc_n(hash_table_oa* restrict table,
+                                const char* key, size_t len) {
+  hash_table_oa_item* item = ht_oa_get_or_create_n(table, key, len, 0);
+  item->value++;
+  return item;
+}
+
+hash_table_oa_item* ht_oa_inc(hash_table_oa* restrict table, ht_key_t key) {
+  return ht_oa_inc_n(table, key, strlen(key));
+}
+
+hash_table_oa_item* ht_oa_dec_n(hash_table_oa* restrict table,
+                                const char* key, size_t len) {
+  hash_table_oa_item* item = ht_oa_get_or_create_n(table, key, len, 0);
+  item->value--;
+  return item;
+}
+
+hash_table_oa_item* ht_oa_dec(hash_table_oa* restrict table, ht_key_t key) {
+  return ht_oa_dec_n(table, key, strlen(key));
+}
+
+// debug printing. customise printf format strings by key & value types
+void ht_oa_print(const hash_table_oa* restrict table) {
+  printf("\n---- Hash Table OA ---\n");
+  for (size_t i = 0; i < table->size; i++) {
+    printf("@%zu: ", i);
+    if (table->ctrl[i] >= 0)
+      printf("#%u %s => %d", table->index[i], ht_oa_slot_item(table, i)->key,
+             ht_oa_slot_item(table, i)->value);
+    else if (table->ctrl[i] == CTRL_DELETED)
+      printf("<deleted>");
+    printf("\n");
+  }
+  printf("----------------------\n");
+}
+
+// create a flat view (array) of hash_table_oa_item pointers for iterating
+// and/or sorting. The start to array of pointers, length table->itemcount, is
+// returned. Items are in insertion order.
+hash_table_oa_item**
+ht_oa_create_flat_view(const hash_table_oa* restrict table) {
+  hash_table_oa_item** itemview =
+      calloc(table->itemcount, sizeof(hash_table_oa_item*));
+  if (!itemview) {
+    perror("calloc itemview");
+    exit(EXIT_FAILURE);
+  }
+  hash_table_oa_item** curritem = itemview;
+  for (size_t i = 0; i < table->entrycount; i++)
+    if (table->entries[i].key) *curritem++ = &table->entries[i];
+  return itemview;
+}
+
+hash_table_oa_item* ht_oa_items(hash_table_oa* restrict table) {
+  if (table->entrycount > table->itemcount)
+    ht_oa_rehash(table, table->size); // drops the holes
+  return table->entries;
+}
+
+// Creates an iterator for a hashtable
+hash_table_oa_iterator* ht_oa_create_iter(const hash_table_oa* restrict table) {
+  hash_table_oa_iterator* iter = malloc(sizeof *iter);
+  if (!iter) {
+    perror("malloc iter");
+    exit(EXIT_FAILURE);
+  }
+  iter->table = table;
+  ht_oa_iter_reset(iter); // find first item
+  return iter;
+}
+
+// frees an iterator - not much to do, basic wrapper
+void ht_oa_free_iter(hash_table_oa_iterator* restrict iter) { free(iter); }
+
+// moves iterator to the first live entry at or after entryidx
+static hash_table_oa_item*
+ht_oa_iter_seek(hash_table_oa_iterator* restrict iter, size_t entryidx) {
+  const hash_table_oa* table = iter->table;
+  for (; entryidx < table->entrycount; ++entryidx) {
+    if (table->entries[entryidx].key) {
+      iter->item     = &table->entries[entryidx];
+      iter->entryidx = entryidx;
+      return iter->item;
+    }
+  }
+  iter->item     = NULL;
+  iter->entryidx = 0;
+  return NULL;
+}
+
+// Resets an iterator, finding the first item if it exists
+hash_table_oa_item* ht_oa_iter_reset(hash_table_oa_iterator* restrict iter) {
+  return ht_oa_iter_seek(iter, 0);
+}
+
+// Returns current item pointed to by iterator
+hash_table_oa_item* ht_oa_iter_current(hash_table_oa_iterator* restrict iter) {
+  return iter->item;
+}
+
+// Moves iterator to point at the next item
+hash_table_oa_item* ht_oa_iter_next(hash_table_oa_iterator* restrict iter) {
+  if (!iter->item) return NULL; // at end already
+  return ht_oa_iter_seek(iter, iter->entryidx + 1);
+}
@@ -0,0 +1,405 @@
+#include "hashtable_rcu.h"
+#include "hashtable_hash.h"
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__) && !defined(HT_RCU_NO_MEMBARRIER)
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define HT_RCU_MEMBARRIER
+#endif
+
+// the slot of a deleted item. Probes continue past it, and an insert may
+// reuse it, so a slot readers see as full never becomes empty
+static ht_rcu_item ht_rcu_deleted;
+#define HT_RCU_DELETED (&ht_rcu_deleted)
+
+// slot arrays are a power of 2, and at least 8
+static size_t ht_rcu_round_size(size_t size) {
+  size_t rounded = 8;
+  while (rounded < size) rounded <<= 1;
+  return rounded;
+}
+
+static ht_rcu_slots* ht_rcu_alloc_slots(size_t size) {
+  ht_rcu_slots* slots =
+      calloc(1, sizeof *slots + size * sizeof(_Atomic(ht_rcu_item*)));
+  if (!slots) {
+    perror("calloc slots");
+    exit(EXIT_FAILURE);
+  }
+  slots->size = size; // calloc'd slots are NULL, ie empty
+  return slots;
+}
+
+// readers and writer each need a full fence between a store and a load, see
+// ht_rcu_oldest_epoch. Where the kernel can run a barrier on all threads of
+// the process on request, the writer does that, as it does so only once per
+// batch, and readers need only stop the compiler reordering. A full fence
+// per lookup would stall it until all earlier loads completed, so costs
+// lookups their overlap of cache misses
+static bool ht_rcu_membarrier_init(void) {
+#ifdef HT_RCU_MEMBARRIER
+  int cmds = (int)syscall(__NR_membarrier, MEMBARRIER_CMD_QUERY, 0, 0);
+  return cmds >= 0 && (cmds & MEMBARRIER_CMD_PRIVATE_EXPEDITED) &&
+         syscall(__NR_membarrier,
+                 MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+#else
+  return false;
+#endif
+}
+
+static void ht_rcu_writer_fence(const hash_table_rcu* table) {
+#ifdef HT_RCU_MEMBARRIER
+  if (table->membarrier &&
+      syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0) == 0)
+    return;
+#endif
+  (void)table;
+  atomic_thread_fence(memory_order_seq_cst);
+}
+
+static inline void ht_rcu_reader_fence(const hash_table_rcu* table) {
+  if (table->membarrier)
+    atomic_signal_fence(memory_order_seq_cst);
+  else
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+// Creates a new hash_table_rcu
+hash_table_rcu* ht_rcu_create(size_t size) {
+  hash_table_rcu* table =
+      aligned_alloc(_Alignof(hash_table_rcu), sizeof(hash_table_rcu));
+  if (!table) {
+    perror("aligned_alloc table");
+    exit(EXIT_FAILURE);
+  }
+  atomic_init(&table->slots, ht_rcu_alloc_slots(ht_rcu_round_size(size)));
+  atomic_init(&table->epoch, 1);
+  table->itemcount    = 0;
+  table->tombstones   = 0;
+  table->retired      = NULL;
+  table->retiredcount = 0;
+  table->retiredsize  = 0;
+  table->readers      = NULL;
+  table->membarrier   = ht_rcu_membarrier_init();
+  pthread_mutex_init(&table->readerslock, NULL);
+  return table;
+}
+
+// Frees the whole hashtable. No reader may be left
+void ht_rcu_free(hash_table_rcu* table) {
+  ht_rcu_slots* slots = atomic_load_explicit(&table->slots,
+                                             memory_order_relaxed);
+  for (size_t i = 0; i < slots->size; i++) {
+    ht_rcu_item* item = atomic_load_explicit(&slots->slots[i],
+                                             memory_order_relaxed);
+    if (item != HT_RCU_DELETED) free(item);
+  }
+  free(slots);
+  for (size_t i = 0; i < table->retiredcount; i++)
+    free(table->retired[i].ptr);
+  free(table->retired);
+  pthread_mutex_destroy(&table->readerslock);
+  free(table);
+}
+
+// reclamation
+
+// the oldest epoch a reader is in, UINT64_MAX if none is in a read section.
+// The fence orders the writer's unlinking stores before the loads of reader
+// epochs, against the reader's announcing store and its loads of slots: so
+// a reader seen outside a read section can't find what was unlinked
+static uint64_t ht_rcu_oldest_epoch(hash_table_rcu* table) {
+  ht_rcu_writer_fence(table);
+  uint64_t oldest = UINT64_MAX;
+  pthread_mutex_lock(&table->readerslock);
+  for (ht_rcu_reader* r = table->readers; r; r = r->next) {
+    uint64_t epoch = atomic_load_explicit(&r->epoch, memory_order_acquire);
+    if (epoch && epoch < oldest) oldest = epoch;
+  }
+  pthread_mutex_unlock(&table->readerslock);
+  return oldest;
+}
+
+// frees what was retired before the oldest epoch a reader is in
+static void ht_rcu_reclaim(hash_table_rcu* table) {
+  uint64_t oldest = ht_rcu_oldest_epoch(table);
+  size_t   kept   = 0;
+  for (size_t i = 0; i < table->retiredcount; i++) {
+    if (table->retired[i].epoch < oldest)
+      free(table->retired[i].ptr);
+    else
+      table->retired[kept++] = table->retired[i];
+  }
+  table->retiredcount = kept;
+}
+
+// queues ptr, already unlinked, to be freed, and moves to the next epoch.
+// Readers who announce the next epoch read it after the unlink, so only
+// those in this epoch or older may still hold ptr
+static void ht_rcu_retire(hash_table_rcu* table, void* ptr) {
+  if (table->retiredcount == table->retiredsize) {
+    table->retiredsize = table->retiredsize ? table->retiredsize * 2
+                                            : HT_RCU_RETIRE_BATCH;
+    table->retired =
+        realloc(table->retired, table->retiredsize * sizeof(ht_rcu_retired));
+    if (!table->retired) {
+      perror("realloc retired");
+      exit(EXIT_FAILURE);
+    }
+  }
+  uint64_t epoch = atomic_load_explicit(&table->epoch, memory_order_relaxed);
+  table->retired[table->retiredcount++] = (ht_rcu_retired){ptr, epoch};
+  atomic_store_explicit(&table->epoch, epoch + 1, memory_order_release);
+  if (table->retiredcount >= HT_RCU_RETIRE_BATCH) ht_rcu_reclaim(table);
+}
+
+void ht_rcu_synchronize(hash_table_rcu* table) {
+  for (;;) {
+    ht_rcu_reclaim(table);
+    if (!table->retiredcount) return;
+    sched_yield();
+  }
+}
+
+// writer side. The writer is the only thread storing to slots, so its own
+// loads of them can be relaxed
+
+static inline ht_rcu_slots* ht_rcu_writer_slots(hash_table_rcu* table) {
+  return atomic_load_explicit(&table->slots, memory_order_relaxed);
+}
+
+static inline bool ht_rcu_matches(const ht_rcu_item* item, uint64_t hash,
+                                  const char* key, size_t len) {
+  return item != HT_RCU_DELETED && item->hash == hash &&
+         item->keylen == len && memcmp(item->key, key, len) == 0;
+}
+
+// the slot holding key, or SIZE_MAX. If vacant isn't NULL it is set to the
+// first empty or deleted slot of the probe sequence, where key would go
+static size_t ht_rcu_find_slot(const ht_rcu_slots* slots, const char* key,
+                               size_t len, uint64_t hash, size_t* vacant) {
+  size_t mask = slots->size - 1;
+  if (vacant) *vacant = SIZE_MAX;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    ht_rcu_item* item =
+        atomic_load_explicit(&slots->slots[i], memory_order_relaxed);
+    if (!item) {
+      if (vacant && *vacant == SIZE_MAX) *vacant = i;
+      return SIZE_MAX;
+    }
+    if (item == HT_RCU_DELETED) {
+      if (vacant && *vacant == SIZE_MAX) *vacant = i;
+    } else if (ht_rcu_matches(item, hash, key, len)) {
+      return i;
+    }
+  }
+}
+
+// builds a new slot array of the live items and publishes it. Readers still
+// probing the old one find the same items there, and it's freed once they
+// are done
+static void ht_rcu_rehash(hash_table_rcu* table, size_t new_size) {
+  ht_rcu_slots* old   = ht_rcu_writer_slots(table);
+  ht_rcu_slots* slots = ht_rcu_alloc_slots(new_size);
+  size_t        mask  = new_size - 1;
+  for (size_t i = 0; i < old->size; i++) {
+    ht_rcu_item* item =
+        atomic_load_explicit(&old->slots[i], memory_order_relaxed);
+    if (!item || item == HT_RCU_DELETED) continue;
+    size_t idx = item->hash & mask;
+    while (atomic_load_explicit(&slots->slots[idx], memory_order_relaxed))
+      idx = (idx + 1) & mask;
+    atomic_store_explicit(&slots->slots[idx], item, memory_order_relaxed);
+  }
+  table->tombstones = 0;
+  atomic_store_explicit(&table->slots, slots, memory_order_release);
+  ht_rcu_retire(table, old);
+}
+
+// the item for key, created with value if it doesn't exist. Keeps the load
+// factor, counting tombstones, at most 1/2 as every probe is a pointer chase.
+// keylen is 32 bits, longer keys are fatal
+static ht_rcu_item* ht_rcu_get_or_create(hash_table_rcu* table,
+                                         const char* key, size_t len,
+                                         ht_value_t value) {
+  uint64_t      hash  = ht_hash_bytes(key, len);
+  ht_rcu_slots* slots = ht_rcu_writer_slots(table);
+  size_t        vacant;
+  size_t        idx = ht_rcu_find_slot(slots, key, len, hash, &vacant);
+  if (idx != SIZE_MAX)
+    return atomic_load_explicit(&slots->slots[idx], memory_order_relaxed);
+
+  if ((table->itemcount + table->tombstones + 1) * 2 > slots->size) {
+    // mostly tombstones => same size rehash just clears them
+    size_t new_size = (table->itemcount + 1) * 4 > slots->size
+                          ? slots->size * 2
+                          : slots->size;
+    ht_rcu_rehash(table, new_size);
+    slots = ht_rcu_writer_slots(table);
+    ht_rcu_find_slot(slots, key, len, hash, &vacant);
+  }
+
+  if (len > UINT32_MAX) {
+    errno = EOVERFLOW;
+    perror("key length");
+    exit(EXIT_FAILURE);
+  }
+  ht_rcu_item* item = malloc(sizeof *item + len + 1);
+  if (!item) {
+    perror("malloc item");
+    exit(EXIT_FAILURE);
+  }
+  atomic_init(&item->value, value);
+  item->keylen = (uint32_t)len;
+  item->hash   = hash;
+  memcpy(item->key, key, len);
+  item->key[len] = '\0';
+
+  ht_rcu_item* prev =
+      atomic_load_explicit(&slots->slots[vacant], memory_order_relaxed);
+  if (prev == HT_RCU_DELETED) table->tombstones--;
+  // release: a reader who finds the item sees its key
+  atomic_store_explicit(&slots->slots[vacant], item, memory_order_release);
+  table->itemcount++;
+  return item;
+}
+
+// Inserts an item (or updates if exists)
+void ht_rcu_insert_n(hash_table_rcu* table, const char* key, size_t len,
+                     ht_value_t value) {
+  ht_rcu_item* item = ht_rcu_get_or_create(table, key, len, value);
+  atomic_store_explicit(&item->value, value, memory_order_relaxed);
+}
+
+void ht_rcu_insert(hash_table_rcu* table, ht_key_t key, ht_value_t value) {
+  ht_rcu_insert_n(table, key, strlen(key), value);
+}
+
+// Deletes an item from the table. Readers may still find it until they
+// leave the read section they are in
+void ht_rcu_delete_n(hash_table_rcu* table, const char* key, size_t len) {
+  ht_rcu_slots* slots = ht_rcu_writer_slots(table);
+  size_t idx = ht_rcu_find_slot(slots, key, len, ht_hash_bytes(key, len), NULL);
+  if (idx == SIZE_MAX) return;
+
+  ht_rcu_item* item =
+      atomic_load_explicit(&slots->slots[idx], memory_order_relaxed);
+  atomic_store_explicit(&slots->slots[idx], HT_RCU_DELETED,
+                        memory_order_release);
+  table->itemcount--;
+  table->tombstones++;
+  ht_rcu_retire(table, item);
+}
+
+void ht_rcu_delete(hash_table_rcu* table, ht_key_t key) {
+  ht_rcu_delete_n(table, key, strlen(key));
+}
+
+// only the writer changes values, so it needs no read-modify-write
+static ht_value_t ht_rcu_add(hash_table_rcu* table, const char* key,
+                             size_t len, ht_value_t delta) {
+  ht_rcu_item* item  = ht_rcu_get_or_create(table, key, len, 0);
+  ht_value_t   value = atomic_load_explicit(&item->value,
+                                            memory_order_relaxed) + delta;
+  atomic_store_explicit(&item->value, value, memory_order_relaxed);
+  return value;
+}
+
+ht_value_t ht_rcu_inc_n(hash_table_rcu* table, const char* key, size_t len) {
+  return ht_rcu_add(table, key, len, 1);
+}
+
+ht_value_t ht_rcu_inc(hash_table_rcu* table, ht_key_t key) {
+  return ht_rcu_inc_n(table, key, strlen(key));
+}
+
+ht_value_t ht_rcu_dec_n(hash_table_rcu* table, const char* key, size_t len) {
+  return ht_rcu_add(table, key, len, -1);
+}
+
+ht_value_t ht_rcu_dec(hash_table_rcu* table, ht_key_t key) {
+  return ht_rcu_dec_n(table, key, strlen(key));
+}
+
+size_t ht_rcu_itemcount(const hash_table_rcu* table) {
+  return table->itemcount;
+}
+
+// reader side
+
+ht_rcu_reader* ht_rcu_reader_create(hash_table_rcu* table) {
+  ht_rcu_reader* reader =
+      aligned_alloc(_Alignof(ht_rcu_reader), sizeof(ht_rcu_reader));
+  if (!reader) {
+    perror("aligned_alloc reader");
+    exit(EXIT_FAILURE);
+  }
+  atomic_init(&reader->epoch, 0);
+  reader->depth = 0;
+  reader->table = table;
+  pthread_mutex_lock(&table->readerslock);
+  reader->next   = table->readers;
+  table->readers = reader;
+  pthread_mutex_unlock(&table->readerslock);
+  return reader;
+}
+
+// the reader must be outside any read section
+void ht_rcu_reader_free(ht_rcu_reader* reader) {
+  hash_table_rcu* table = reader->table;
+  pthread_mutex_lock(&table->readerslock);
+  ht_rcu_reader** link = &table->readers;
+  while (*link != reader) link = &(*link)->next;
+  *link = reader->next;
+  pthread_mutex_unlock(&table->readerslock);
+  free(reader);
+}
+
+// announces the current epoch. The fence pairs with the writer's in
+// ht_rcu_oldest_epoch, see there
+void ht_rcu_read_lock(ht_rcu_reader* reader) {
+  if (reader->depth++) return;
+  uint64_t epoch =
+      atomic_load_explicit(&reader->table->epoch, memory_order_acquire);
+  atomic_store_explicit(&reader->epoch, epoch, memory_order_relaxed);
+  ht_rcu_reader_fence(reader->table);
+}
+
+// release: all reads of the section happen before the writer frees
+void ht_rcu_read_unlock(ht_rcu_reader* reader) {
+  if (--reader->depth) return;
+  atomic_store_explicit(&reader->epoch, 0, memory_order_release);
+}
+
+const ht_rcu_item* ht_rcu_find(ht_rcu_reader* reader, const char* key,
+                               size_t len) {
+  uint64_t      hash = ht_hash_bytes(key, len);
+  ht_rcu_slots* slots =
+      atomic_load_explicit(&reader->table->slots, memory_order_acquire);
+  size_t mask = slots->size - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    ht_rcu_item* item =
+        atomic_load_explicit(&slots->slots[i], memory_order_acquire);
+    if (!item) return NULL;
+    if (ht_rcu_matches(item, hash, key, len)) return item;
+  }
+}
+
+bool ht_rcu_get_n(ht_rcu_reader* reader, const char* key, size_t len,
+                  ht_value_t* value) {
+  ht_rcu_read_lock(reader);
+  const ht_rcu_item* item = ht_rcu_find(reader, key, len);
+  if (item) *value = atomic_load_explicit(&item->value, memory_order_relaxed);
+  ht_rcu_read_unlock(reader);
+  return item != NULL;
+}
+
+bool ht_rcu_get(ht_rcu_reader* reader, ht_key_t key, ht_value_t* value) {
+  return ht_rcu_get_n(reader, key, strlen(key), value);
+}
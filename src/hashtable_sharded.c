@@ -0,0 +1,194 @@
+#include "hashtable_sharded.h"
+#include "hashtable_hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Creates a new hash_table_sharded
+hash_table_sharded* ht_sh_create(size_t size, size_t shardcount) {
+  unsigned bits = 0;
+  while (((size_t)1 << bits) < shardcount) bits++; // always ensure power of 2
+  shardcount = (size_t)1 << bits;
+
+  hash_table_sharded* table = malloc(sizeof *table);
+  if (!table) {
+    perror("malloc table");
+    exit(EXIT_FAILURE);
+  }
+  table->shards =
+      aligned_alloc(_Alignof(ht_shard), shardcount * sizeof(ht_shard));
+  if (!table->shards) {
+    perror("aligned_alloc shards");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t i = 0; i < shardcount; i++) {
+    pthread_mutex_init(&table->shards[i].lock, NULL);
+    table->shards[i].table = ht_create(size / shardcount);
+  }
+  table->shardcount = shardcount;
+  table->shardshift = 64 - bits; // 64 for a single shard, see ht_sh_shard
+  return table;
+}
+
+// Frees the whole hashtable. No other thread may be using it
+void ht_sh_free(hash_table_sharded* table) {
+  for (size_t i = 0; i < table->shardcount; i++) {
+    pthread_mutex_destroy(&table->shards[i].lock);
+    ht_free(table->shards[i].table);
+  }
+  free(table->shards);
+  free(table);
+}
+
+// finds the shard for a key, from the high bits of its hash. The shard
+// tables reuse the hash, see ht_insert_h
+static inline ht_shard* ht_sh_shard(const hash_table_sharded* restrict table,
+                                    uint64_t hash) {
+  if (table->shardcount == 1) return table->shards; // >> 64 is undefined
+  return &table->shards[hash >> table->shardshift];
+}
+
+// Inserts an item (or updates if exists)
+void ht_sh_insert_n(hash_table_sharded* table, const char* key, size_t len,
+                    ht_value_t value) {
+  uint64_t  hash  = ht_hash_bytes(key, len);
+  ht_shard* shard = ht_sh_shard(table, hash);
+  pthread_mutex_lock(&shard->lock);
+  ht_insert_h(shard->table, key, len, hash, value);
+  pthread_mutex_unlock(&shard->lock);
+}
+
+void ht_sh_insert(hash_table_sharded* table, ht_key_t key, ht_value_t value) {
+  ht_sh_insert_n(table, key, strlen(key), value);
+}
+
+// Deletes an item from the table
+void ht_sh_delete_n(hash_table_sharded* table, const char* key, size_t len) {
+  uint64_t  hash  = ht_hash_bytes(key, len);
+  ht_shard* shard = ht_sh_shard(table, hash);
+  pthread_mutex_lock(&shard->lock);
+  ht_delete_h(shard->table, key, len, hash);
+  pthread_mutex_unlock(&shard->lock);
+}
+
+void ht_sh_delete(hash_table_sharded* table, ht_key_t key) {
+  ht_sh_delete_n(table, key, strlen(key));
+}
+
+// Searches the key and copies its value into *value if it exists
+bool ht_sh_get_n(hash_table_sharded* table, const char* key, size_t len,
+                 ht_value_t* value) {
+  uint64_t  hash  = ht_hash_bytes(key, len);
+  ht_shard* shard = ht_sh_shard(table, hash);
+  pthread_mutex_lock(&shard->lock);
+  hash_table_item* item = ht_get_h(shard->table, key, len, hash);
+  if (item) *value = item->value;
+  pthread_mutex_unlock(&shard->lock);
+  return item != NULL;
+}
+
+bool ht_sh_get(hash_table_sharded* table, ht_key_t key, ht_value_t* value) {
+  return ht_sh_get_n(table, key, strlen(key), value);
+}
+
+// increments the value for a key or inserts with value = 1. Returns the new
+// value
+ht_value_t ht_sh_inc_n(hash_table_sharded* table, const char* key,
+                       size_t len) {
+  uint64_t  hash  = ht_hash_bytes(key, len);
+  ht_shard* shard = ht_sh_shard(table, hash);
+  pthread_mutex_lock(&shard->lock);
+  ht_value_t value = ht_inc_h(shard->table, key, len, hash)->value;
+  pthread_mutex_unlock(&shard->lock);
+  return value;
+}
+
+ht_value_t ht_sh_inc(hash_table_sharded* table, ht_key_t key) {
+  return ht_sh_inc_n(table, key, strlen(key));
+}
+
+ht_value_t ht_sh_dec_n(hash_table_sharded* table, const char* key,
+                       size_t len) {
+  uint64_t  hash  = ht_hash_bytes(key, len);
+  ht_shard* shard = ht_sh_shard(table, hash);
+  pthread_mutex_lock(&shard->lock);
+  ht_value_t value = ht_dec_h(shard->table, key, len, hash)->value;
+  pthread_mutex_unlock(&shard->lock);
+  return value;
+}
+
+ht_value_t ht_sh_dec(hash_table_sharded* table, ht_key_t key) {
+  return ht_sh_dec_n(table, key, strlen(key));
+}
+
+// total items over all shards. Only a snapshot if other threads are writing
+size_t ht_sh_itemcount(hash_table_sharded* table) {
+  size_t count = 0;
+  for (size_t i = 0; i < table->shardcount; i++) {
+    pthread_mutex_lock(&table->shards[i].lock);
+    count += table->shards[i].table->itemcount;
+    pthread_mutex_unlock(&table->shards[i].lock);
+  }
+  return count;
+}
+
+// takes a consistent copy of all items. All shards are locked, in order, for
+// the duration, so concurrent writers wait rather than see a partial state
+hash_table_sh_snapshot* ht_sh_create_snapshot(hash_table_sharded* table) {
+  for (size_t i = 0; i < table->shardcount; i++)
+    pthread_mutex_lock(&table->shards[i].lock);
+
+  size_t itemcount = 0;
+  size_t keybytes  = 0;
+  for (size_t i = 0; i < table->shardcount; i++) {
+    hash_table_iterator* iter = ht_create_iter(table->shards[i].table);
+    hash_table_item*     item = ht_iter_current(iter);
+    while (item) {
+      itemcount++;
+      keybytes += (size_t)item->keylen + 1;
+      item = ht_iter_next(iter);
+    }
+    ht_free_iter(iter);
+  }
+
+  hash_table_sh_snapshot* snapshot = malloc(sizeof *snapshot);
+  if (!snapshot) {
+    perror("malloc snapshot");
+    exit(EXIT_FAILURE);
+  }
+  // + 1 so an empty table doesn't malloc(0), which may return NULL
+  snapshot->entries   = malloc(itemcount * sizeof(hash_table_sh_entry) + 1);
+  snapshot->keys      = malloc(keybytes + 1);
+  snapshot->itemcount = itemcount;
+  if (!snapshot->entries || !snapshot->keys) {
+    perror("malloc snapshot entries");
+    exit(EXIT_FAILURE);
+  }
+
+  hash_table_sh_entry* entry = snapshot->entries;
+  char*                key   = snapshot->keys;
+  for (size_t i = 0; i < table->shardcount; i++) {
+    hash_table_iterator* iter = ht_create_iter(table->shards[i].table);
+    hash_table_item*     item = ht_iter_current(iter);
+    while (item) {
+      memcpy(key, item->key, (size_t)item->keylen + 1);
+      entry->key    = key;
+      entry->keylen = item->keylen;
+      entry->value  = item->value;
+      key += (size_t)item->keylen + 1;
+      entry++;
+      item = ht_iter_next(iter);
+    }
+    ht_free_iter(iter);
+  }
+
+  for (size_t i = table->shardcount; i-- > 0;)
+    pthread_mutex_unlock(&table->shards[i].lock);
+  return snapshot;
+}
+
+void ht_sh_free_snapshot(hash_table_sh_snapshot* snapshot) {
+  free(snapshot->entries);
+  free(snapshot->keys);
+  free(snapshot);
+}
@@ -0,0 +1,564 @@
+#include "hashtable_spill.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// a run record's fixed part, followed by keylen key bytes
+typedef struct ht_sp_record ht_sp_record;
+struct ht_sp_record {
+  uint32_t   keylen;
+  ht_value_t count;
+};
+
+// the partition of an item. Uses the high bits, as the low ones select its
+// slot. Tables are seeded afresh after every spill, so this is the unseeded
+// hash, the same for a key in every run
+static inline size_t ht_sp_part(const hash_table*      table,
+                                const hash_table_item* item) {
+  return (ht_item_hash_bytes(table, item) >> 32) & (HT_SP_PARTS - 1);
+}
+
+// keys come from the input, so tables hash under a random seed, and move to
+// SipHash should it pile keys into one chain, see ht_set_max_chain
+#define HT_SP_MAX_CHAIN 64
+
+static hash_table* ht_sp_new_table(size_t size) {
+  hash_table* table = ht_create_pooled(size);
+  ht_set_seed(table, ht_random_seed());
+  ht_set_max_chain(table, HT_SP_MAX_CHAIN);
+  return table;
+}
+
+static inline int ht_sp_cmp_keys(const char* a, size_t alen, const char* b,
+                                 size_t blen) {
+  int cmp = memcmp(a, b, alen < blen ? alen : blen);
+  if (cmp) return cmp;
+  return alen < blen ? -1 : alen > blen;
+}
+
+static int ht_sp_cmp_items(const void* a, const void* b) {
+  const hash_table_item* ia = *(hash_table_item* const*)a;
+  const hash_table_item* ib = *(hash_table_item* const*)b;
+  return ht_sp_cmp_keys(ia->key, ia->keylen, ib->key, ib->keylen);
+}
+
+static void ht_sp_run_path(const hash_table_spill* spill, size_t run,
+                           size_t part, char* path, size_t size) {
+  snprintf(path, size, "%s/r%zu-p%zu", spill->dir, run, part);
+}
+
+// removes the files of run, keeping errno
+static void ht_sp_unlink_run(const hash_table_spill* spill, size_t run) {
+  int  saved = errno;
+  char path[4096];
+  for (size_t p = 0; p < HT_SP_PARTS; p++) {
+    ht_sp_run_path(spill, run, p, path, sizeof path);
+    unlink(path);
+  }
+  errno = saved;
+}
+
+// takes up the next run id, once its files are written
+static void ht_sp_add_run(hash_table_spill* spill) {
+  if (spill->runcount == spill->runcap) {
+    spill->runcap = spill->runcap ? 2 * spill->runcap : 16;
+    spill->runs   = realloc(spill->runs, spill->runcap * sizeof(size_t));
+    if (!spill->runs) {
+      perror("realloc spill runs");
+      exit(EXIT_FAILURE);
+    }
+  }
+  spill->runs[spill->runcount++] = spill->nextrun++;
+}
+
+// Creates a new hash_table_spill, and its run directory
+hash_table_spill* ht_sp_create(size_t budget, const char* dir) {
+  if (!dir) dir = getenv("TMPDIR");
+  if (!dir || !*dir) dir = "/tmp";
+  size_t len      = strlen(dir) + sizeof "/ht-spill-XXXXXX";
+  char*  spilldir = malloc(len);
+  if (!spilldir) {
+    perror("malloc spill dir");
+    exit(EXIT_FAILURE);
+  }
+  snprintf(spilldir, len, "%s/ht-spill-XXXXXX", dir);
+  if (!mkdtemp(spilldir)) {
+    int saved = errno;
+    free(spilldir);
+    errno = saved;
+    return NULL;
+  }
+
+  hash_table_spill* spill = malloc(sizeof *spill);
+  if (!spill) {
+    perror("malloc spill");
+    exit(EXIT_FAILURE);
+  }
+  // slots of at most a 16th of the budget to start with, so it's mostly
+  // items by the first spill
+  size_t size     = budget / 16 / sizeof(hash_table_item*);
+  spill->table    = ht_sp_new_table(size < 32 * 1024 ? size : 32 * 1024);
+  spill->budget   = budget;
+  spill->keybytes = 0;
+  spill->dir      = spilldir;
+  spill->runs     = NULL;
+  spill->runcount = 0;
+  spill->runcap   = 0;
+  spill->nextrun  = 0;
+  spill->spills   = 0;
+  spill->fanin    = HT_SP_FANIN;
+  spill->spilled  = 0;
+  spill->total    = 0;
+  return spill;
+}
+
+// Frees the table, and removes the runs and their directory
+void ht_sp_free(hash_table_spill* spill) {
+  for (size_t r = 0; r < spill->runcount; r++)
+    ht_sp_unlink_run(spill, spill->runs[r]);
+  rmdir(spill->dir);
+  free(spill->runs);
+  free(spill->dir);
+  ht_free(spill->table);
+  free(spill);
+}
+
+size_t ht_sp_bytes(const hash_table_spill* spill) {
+  const hash_table* table = spill->table;
+  return sizeof *table +
+         (table->size + table->old_size) * sizeof(hash_table_item*) +
+         table->itemcount * sizeof(hash_table_item) + spill->keybytes;
+}
+
+// the table's items grouped by partition, partition p being items
+// [offsets[p], offsets[p + 1]), and each sorted by key
+static hash_table_item** ht_sp_sorted_items(const hash_table* table,
+                                            size_t* offsets) {
+  hash_table_item** view  = ht_create_flat_view(table);
+  size_t            n     = table->itemcount;
+  hash_table_item** items = malloc(n * sizeof(hash_table_item*) + 1);
+  uint8_t*          parts = malloc(n + 1); // each hashed once
+  if (!items || !parts) {
+    perror("malloc spill items");
+    exit(EXIT_FAILURE);
+  }
+  size_t next[HT_SP_PARTS + 1] = {0};
+  for (size_t i = 0; i < n; i++) {
+    parts[i] = (uint8_t)ht_sp_part(table, view[i]);
+    next[parts[i] + 1]++;
+  }
+  for (size_t p = 0; p < HT_SP_PARTS; p++) next[p + 1] += next[p];
+  memcpy(offsets, next, sizeof next);
+  for (size_t i = 0; i < n; i++) items[next[parts[i]]++] = view[i];
+  free(parts);
+  free(view);
+  for (size_t p = 0; p < HT_SP_PARTS; p++)
+    qsort(items + offsets[p], offsets[p + 1] - offsets[p],
+          sizeof(hash_table_item*), ht_sp_cmp_items);
+  return items;
+}
+
+static bool ht_sp_write_record(hash_table_spill* spill, FILE* fp,
+                               const char* key, uint32_t keylen,
+                               ht_value_t count) {
+  ht_sp_record record = {keylen, count};
+  spill->spilled += sizeof record + keylen;
+  return fwrite(&record, sizeof record, 1, fp) == 1 &&
+         fwrite(key, 1, keylen, fp) == keylen;
+}
+
+// closes a run file being written. Returns false, with errno set, if it
+// wasn't all written
+static bool ht_sp_close_run(FILE* fp, bool ok) {
+  if (!ok) {
+    int saved = errno;
+    fclose(fp);
+    errno = saved;
+    return false;
+  }
+  return fclose(fp) == 0;
+}
+
+// writes items as the next run. Returns false, with errno set, on failure
+static bool ht_sp_write_run(hash_table_spill* spill, size_t part,
+                            hash_table_item** items, size_t count) {
+  char path[4096];
+  ht_sp_run_path(spill, spill->nextrun, part, path, sizeof path);
+  FILE* fp = fopen(path, "wbe");
+  if (!fp) return false;
+  bool ok = true;
+  for (size_t i = 0; ok && i < count; i++)
+    ok = ht_sp_write_record(spill, fp, items[i]->key, items[i]->keylen,
+                            items[i]->value);
+  return ht_sp_close_run(fp, ok);
+}
+
+bool ht_sp_spill(hash_table_spill* spill) {
+  if (!spill->table->itemcount) return true;
+  size_t            offsets[HT_SP_PARTS + 1];
+  hash_table_item** items = ht_sp_sorted_items(spill->table, offsets);
+  bool              ok    = true;
+  for (size_t p = 0; ok && p < HT_SP_PARTS; p++)
+    ok = ht_sp_write_run(spill, p, items + offsets[p],
+                         offsets[p + 1] - offsets[p]);
+  free(items);
+  if (!ok) { // the counts stay in the table, and no part of the run is kept
+    ht_sp_unlink_run(spill, spill->nextrun);
+    return false;
+  }
+  ht_sp_add_run(spill);
+  spill->spills++;
+
+  // a table of the same size, as it'll fill up again
+  size_t size = spill->table->size;
+  ht_free(spill->table);
+  spill->table    = ht_sp_new_table(size);
+  spill->keybytes = 0;
+  return true;
+}
+
+bool ht_sp_inc_n(hash_table_spill* spill, const char* key, size_t len) {
+  size_t before = spill->table->itemcount;
+  ht_inc_n(spill->table, key, len);
+  spill->total++;
+  if (spill->table->itemcount == before) return true;
+  if (len >= HT_INLINE_KEY) spill->keybytes += len + 1;
+  return ht_sp_bytes(spill) <= spill->budget || ht_sp_spill(spill);
+}
+
+bool ht_sp_inc(hash_table_spill* spill, ht_key_t key) {
+  return ht_sp_inc_n(spill, key, strlen(key));
+}
+
+// merging: one cursor per run of a partition, plus one over the items still
+// in the table, in a min heap by their current key
+
+typedef struct ht_sp_cursor ht_sp_cursor;
+struct ht_sp_cursor {
+  FILE*             fp;    // NULL for the table's items
+  hash_table_item** items; // the table's, [next, end)
+  size_t            next;
+  size_t            end;
+  const char*       key; // current record
+  size_t            keylen;
+  ht_value_t        count;
+  char*             buf; // of a run's key
+  size_t            bufsize;
+};
+
+// moves to the next record. Returns false at the end, with errno 0, or
+// with errno set if a run can't be read
+static bool ht_sp_advance(ht_sp_cursor* cursor) {
+  errno = 0;
+  if (!cursor->fp) {
+    if (cursor->next == cursor->end) return false;
+    hash_table_item* item = cursor->items[cursor->next++];
+    cursor->key           = item->key;
+    cursor->keylen        = item->keylen;
+    cursor->count         = item->value;
+    return true;
+  }
+  ht_sp_record record;
+  if (fread(&record, sizeof record, 1, cursor->fp) != 1) {
+    if (!ferror(cursor->fp))
+      errno = 0; // the end
+    else if (!errno)
+      errno = EIO;
+    return false;
+  }
+  if ((size_t)record.keylen + 1 > cursor->bufsize) {
+    cursor->bufsize = (size_t)record.keylen + 1;
+    cursor->buf     = realloc(cursor->buf, cursor->bufsize);
+    if (!cursor->buf) {
+      perror("realloc spill key");
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (fread(cursor->buf, 1, record.keylen, cursor->fp) != record.keylen) {
+    if (!errno) errno = EIO; // truncated
+    return false;
+  }
+  cursor->buf[record.keylen] = '\0';
+  cursor->key                = cursor->buf;
+  cursor->keylen             = record.keylen;
+  cursor->count              = record.count;
+  return true;
+}
+
+static inline bool ht_sp_cursor_less(const ht_sp_cursor* a,
+                                     const ht_sp_cursor* b) {
+  return ht_sp_cmp_keys(a->key, a->keylen, b->key, b->keylen) < 0;
+}
+
+static void ht_sp_sift_down(ht_sp_cursor** heap, size_t count, size_t pos) {
+  ht_sp_cursor* cursor = heap[pos];
+  for (;;) {
+    size_t child = 2 * pos + 1;
+    if (child >= count) break;
+    if (child + 1 < count && ht_sp_cursor_less(heap[child + 1], heap[child]))
+      child++;
+    if (!ht_sp_cursor_less(heap[child], cursor)) break;
+    heap[pos] = heap[child];
+    pos       = child;
+  }
+  heap[pos] = cursor;
+}
+
+// merges one partition of runcount runs, and of the items of
+// cursors[runcount]. Returns false, with errno set, on a read failure
+static bool ht_sp_merge_part(const hash_table_spill* spill,
+                             const size_t* runs, size_t runcount, size_t part,
+                             ht_sp_cursor* cursors, ht_sp_cursor** heap,
+                             ht_sp_fn fn, void* arg) {
+  char   path[4096];
+  size_t heapcount = 0;
+  bool   ok        = true;
+  for (size_t r = 0; ok && r <= runcount; r++) {
+    ht_sp_cursor* cursor = &cursors[r];
+    if (r < runcount) { // the last is the table's
+      ht_sp_run_path(spill, runs[r], part, path, sizeof path);
+      cursor->fp = fopen(path, "rbe");
+      if (!cursor->fp) {
+        ok = false;
+        break;
+      }
+    }
+    if (ht_sp_advance(cursor))
+      heap[heapcount++] = cursor;
+    else
+      ok = !errno;
+  }
+  for (size_t i = heapcount; i-- > 0;) ht_sp_sift_down(heap, heapcount, i);
+
+  // the current key is copied out, as advancing its cursor overwrites it
+  char*  key     = NULL;
+  size_t keysize = 0;
+  while (ok && heapcount) {
+    size_t keylen = heap[0]->keylen;
+    if (keylen + 1 > keysize) {
+      keysize = keylen + 1;
+      key     = realloc(key, keysize);
+      if (!key) {
+        perror("realloc spill merge key");
+        exit(EXIT_FAILURE);
+      }
+    }
+    memcpy(key, heap[0]->key, keylen);
+    key[keylen] = '\0';
+
+    uint64_t count = 0;
+    while (ok && heapcount &&
+           ht_sp_cmp_keys(heap[0]->key, heap[0]->keylen, key, keylen) == 0) {
+      count += (uint64_t)heap[0]->count;
+      if (!ht_sp_advance(heap[0])) {
+        ok      = !errno;
+        heap[0] = heap[--heapcount];
+      }
+      if (heapcount) ht_sp_sift_down(heap, heapcount, 0);
+    }
+    if (ok) fn(arg, key, keylen, count);
+  }
+  free(key);
+
+  int saved = errno;
+  for (size_t r = 0; r < runcount; r++) {
+    if (cursors[r].fp) fclose(cursors[r].fp);
+    cursors[r].fp = NULL;
+  }
+  errno = saved;
+  return ok;
+}
+
+// a run being written by a merge
+typedef struct ht_sp_writer ht_sp_writer;
+struct ht_sp_writer {
+  hash_table_spill* spill;
+  FILE*             fp;
+  bool              ok;
+};
+
+static void ht_sp_write_merged(void* arg, const char* key, size_t len,
+                               uint64_t count) {
+  ht_sp_writer* writer = arg;
+  // a count beyond ht_value_t goes in several records, added up when read
+  for (; writer->ok && count > INT_MAX; count -= INT_MAX)
+    writer->ok = ht_sp_write_record(writer->spill, writer->fp, key,
+                                    (uint32_t)len, INT_MAX);
+  if (writer->ok)
+    writer->ok = ht_sp_write_record(writer->spill, writer->fp, key,
+                                    (uint32_t)len, (ht_value_t)count);
+}
+
+// merges runcount runs into the next run, and removes them. Returns false,
+// with errno set, on failure, with the runs left as they were
+static bool ht_sp_merge_runs(hash_table_spill* spill, const size_t* runs,
+                             size_t runcount) {
+  // the last cursor is over no items
+  ht_sp_cursor*  cursors = calloc(runcount + 1, sizeof(ht_sp_cursor));
+  ht_sp_cursor** heap    = malloc((runcount + 1) * sizeof(ht_sp_cursor*));
+  if (!cursors || !heap) {
+    perror("malloc spill merge");
+    exit(EXIT_FAILURE);
+  }
+  char path[4096];
+  bool ok = true;
+  for (size_t p = 0; ok && p < HT_SP_PARTS; p++) {
+    ht_sp_run_path(spill, spill->nextrun, p, path, sizeof path);
+    ht_sp_writer writer = {spill, fopen(path, "wbe"), true};
+    if (!writer.fp) {
+      ok = false;
+      break;
+    }
+    ok = ht_sp_merge_part(spill, runs, runcount, p, cursors, heap,
+                          ht_sp_write_merged, &writer);
+    ok = ht_sp_close_run(writer.fp, ok && writer.ok);
+  }
+  int saved = errno;
+  for (size_t r = 0; r < runcount; r++) free(cursors[r].buf);
+  free(heap);
+  free(cursors);
+  errno = saved;
+  if (!ok) {
+    ht_sp_unlink_run(spill, spill->nextrun);
+    return false;
+  }
+  for (size_t r = 0; r < runcount; r++) ht_sp_unlink_run(spill, runs[r]);
+  return true;
+}
+
+// merges runs fanin at a time, until there are at most fanin. Returns false,
+// with errno set, on failure, with the runs merged so far replaced
+static bool ht_sp_cascade(hash_table_spill* spill) {
+  while (spill->runcount > spill->fanin) {
+    // the merged runs are added back over the front of runs, behind the
+    // groups they came from
+    size_t* runs     = spill->runs;
+    size_t  runcount = spill->runcount;
+    spill->runcount  = 0;
+    for (size_t first = 0; first < runcount; first += spill->fanin) {
+      size_t count = runcount - first;
+      if (count > spill->fanin) count = spill->fanin;
+      if (count == 1) {
+        runs[spill->runcount++] = runs[first];
+      } else if (ht_sp_merge_runs(spill, runs + first, count)) {
+        ht_sp_add_run(spill);
+      } else {
+        memmove(runs + spill->runcount, runs + first,
+                (runcount - first) * sizeof(size_t));
+        spill->runcount += runcount - first;
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool ht_sp_merge(hash_table_spill* spill, ht_sp_fn fn, void* arg) {
+  if (!ht_sp_cascade(spill)) return false;
+  size_t            offsets[HT_SP_PARTS + 1];
+  hash_table_item** items   = ht_sp_sorted_items(spill->table, offsets);
+  size_t            count   = spill->runcount + 1;
+  ht_sp_cursor*     cursors = calloc(count, sizeof(ht_sp_cursor));
+  ht_sp_cursor**    heap    = malloc(count * sizeof(ht_sp_cursor*));
+  if (!cursors || !heap) {
+    perror("malloc spill merge");
+    exit(EXIT_FAILURE);
+  }
+  bool ok = true;
+  for (size_t p = 0; ok && p < HT_SP_PARTS; p++) {
+    cursors[spill->runcount] = (ht_sp_cursor){.items = items,
+                                              .next  = offsets[p],
+                                              .end   = offsets[p + 1]};
+    ok = ht_sp_merge_part(spill, spill->runs, spill->runcount, p, cursors,
+                          heap, fn, arg);
+  }
+  int saved = errno;
+  for (size_t r = 0; r < count; r++) free(cursors[r].buf);
+  free(heap);
+  free(cursors);
+  free(items);
+  errno = saved;
+  return ok;
+}
+
+// top k: a min heap of the best k so far, by count
+
+typedef struct ht_sp_top ht_sp_top;
+struct ht_sp_top {
+  ht_sp_item* items;
+  size_t      count;
+  size_t      k;
+};
+
+static void ht_sp_top_sift_down(ht_sp_item* heap, size_t count, size_t pos) {
+  ht_sp_item item = heap[pos];
+  for (;;) {
+    size_t child = 2 * pos + 1;
+    if (child >= count) break;
+    if (child + 1 < count && heap[child + 1].count < heap[child].count)
+      child++;
+    if (heap[child].count >= item.count) break;
+    heap[pos] = heap[child];
+    pos       = child;
+  }
+  heap[pos] = item;
+}
+
+static void ht_sp_top_add(void* arg, const char* key, size_t len,
+                          uint64_t count) {
+  ht_sp_top* top = arg;
+  if (!top->k) return;
+  if (top->count == top->k && count <= top->items[0].count) return;
+
+  char* copy = malloc(len + 1);
+  if (!copy) {
+    perror("malloc top key");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(copy, key, len + 1);
+  ht_sp_item item = {copy, len, count};
+  if (top->count < top->k) { // sift up
+    size_t pos = top->count++;
+    while (pos > 0 && top->items[(pos - 1) / 2].count > count) {
+      top->items[pos] = top->items[(pos - 1) / 2];
+      pos             = (pos - 1) / 2;
+    }
+    top->items[pos] = item;
+  } else {
+    free(top->items[0].key);
+    top->items[0] = item;
+    ht_sp_top_sift_down(top->items, top->count, 0);
+  }
+}
+
+static int ht_sp_cmp_top(const void* a, const void* b) {
+  uint64_t a_val = ((const ht_sp_item*)a)->count;
+  uint64_t b_val = ((const ht_sp_item*)b)->count;
+  if (a_val == b_val) return 0;
+  return a_val < b_val ? 1 : -1;
+}
+
+ht_sp_item* ht_sp_top_k(hash_table_spill* spill, size_t k, size_t* count) {
+  ht_sp_top top = {malloc(k * sizeof(ht_sp_item) + 1), 0, k};
+  if (!top.items) {
+    perror("malloc top");
+    exit(EXIT_FAILURE);
+  }
+  if (!ht_sp_merge(spill, ht_sp_top_add, &top)) {
+    int saved = errno;
+    ht_sp_free_items(top.items, top.count);
+    errno = saved;
+    return NULL;
+  }
+  qsort(top.items, top.count, sizeof(ht_sp_item), ht_sp_cmp_top);
+  *count = top.count;
+  return top.items;
+}
+
+void ht_sp_free_items(ht_sp_item* items, size_t count) {
+  for (size_t i = 0; i < count; i++) free(items[i].key);
+  free(items);
+}
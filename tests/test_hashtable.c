@@ -1,6 +1,7 @@
 #include "hashtable.c"
 #include "hashtable.h"
 #include "unity.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -23,7 +24,7 @@ void test_pow2(void) {
 void test_insert_delete(void) {
   TEST_ASSERT_EQUAL(0, ht->itemcount);
 
-  hash_table_item* item = ht_insert(ht, "aaa", 10); // @2
+  hash_table_item* item = ht_insert(ht, "aaa", 10); // @0
   TEST_ASSERT_EQUAL(1, ht->itemcount);
   TEST_ASSERT_NOT_NULL(item);
   TEST_ASSERT_EQUAL(10, item->value);
@@ -31,14 +32,14 @@ void test_insert_delete(void) {
   TEST_ASSERT_NULL(ht_get(ht, "aaa"));
   TEST_ASSERT_EQUAL(0, ht->itemcount);
 
-  ht_insert(ht, "bbb", 10); // @1
-  ht_insert(ht, "jjj", 10); // @1
-  ht_insert(ht, "rrr", 10); // @1
+  ht_insert(ht, "bbb", 10); // @2
+  ht_insert(ht, "ddd", 10); // @2
+  ht_insert(ht, "rrr", 10); // @2
   TEST_ASSERT_EQUAL(3, ht->itemcount);
 
-  ht_delete(ht, "jjj");
+  ht_delete(ht, "ddd");
   TEST_ASSERT_EQUAL(2, ht->itemcount);
-  TEST_ASSERT_NULL(ht_get(ht, "jjj"));
+  TEST_ASSERT_NULL(ht_get(ht, "ddd"));
   ht_delete(ht, "bbb");
   TEST_ASSERT_EQUAL(1, ht->itemcount);
   TEST_ASSERT_NULL(ht_get(ht, "bbb"));
@@ -124,8 +125,8 @@ void test_flat_view(void) {
   ht_inc(ht, "ccc2");
   hash_table_item** view = ht_create_flat_view(ht);
 
-  TEST_ASSERT_EQUAL(0, strcmp("bbb", view[0]->key));
-  TEST_ASSERT_EQUAL(0, strcmp("aaa", view[1]->key));
+  TEST_ASSERT_EQUAL(0, strcmp("aaa", view[0]->key));
+  TEST_ASSERT_EQUAL(0, strcmp("bbb", view[1]->key));
   TEST_ASSERT_EQUAL(0, strcmp("ccc2", view[2]->key));
   free(view);
 }
@@ -135,7 +136,7 @@ void test_iter(void) {
   for (size_t i = 0; i < 3; ++i) ht_inc(ht, keys[i]);
 
   hash_table_iterator* iter        = ht_create_iter(ht);
-  char keys2[3][5] = { "aaa", "ccc2" ,"bbb4" };
+  char keys2[3][5] = { "aaa", "bbb4" ,"ccc2" }; // insertion order
   size_t i = 0;
   while (ht_iter_current(iter)) {
     TEST_ASSERT_EQUAL(0, strcmp(keys2[i], iter->item->key));
@@ -152,6 +153,592 @@ void test_iter(void) {
   ht_free_iter(iter);
 }
 
+// keys in order of i, from the iterator and the flat view alike
+static void assert_in_order(int count) {
+  hash_table_item**    view = ht_create_flat_view(ht);
+  hash_table_iterator* iter = ht_create_iter(ht);
+  int                  last = -1;
+  size_t               n    = 0;
+  for (hash_table_item* item = ht_iter_current(iter); item;
+       item                  = ht_iter_next(iter), ++n) {
+    TEST_ASSERT_EQUAL_PTR(view[n], item);
+    TEST_ASSERT_TRUE(atoi(item->key + 1) > last);
+    last = atoi(item->key + 1);
+  }
+  TEST_ASSERT_EQUAL(count, n);
+  ht_free_iter(iter);
+  free(view);
+}
+
+void test_entries(void) {
+  TEST_ASSERT_EQUAL(56, sizeof(hash_table_item)); // one 64 byte malloc chunk
+  char key[16];
+  for (int i = 0; i < 100; ++i) {
+    snprintf(key, sizeof key, "k%d", i);
+    ht_insert(ht, key, i);
+  }
+  TEST_ASSERT_EQUAL(100, ht->entrycount);
+  for (int i = 0; i < 100; i += 3) {
+    snprintf(key, sizeof key, "k%d", i);
+    ht_delete(ht, key);
+  }
+  TEST_ASSERT_EQUAL(66, ht->itemcount);
+  TEST_ASSERT_EQUAL(99, ht->entrycount); // holes, but k99 was the last
+  assert_in_order(66);
+
+  // holes at the end are dropped, those left compacted in order
+  ht_delete(ht, "k98");
+  TEST_ASSERT_EQUAL(98, ht->entrycount);
+  hash_table_item** items = ht_items(ht);
+  TEST_ASSERT_EQUAL(65, ht->entrycount);
+  for (size_t j = 0; j < 65; ++j) TEST_ASSERT_EQUAL(j, items[j]->entry);
+  assert_in_order(65);
+  TEST_ASSERT_EQUAL(1, ht_get(ht, "k1")->value);
+
+  // new items go on the end, and rehash compacts
+  ht_insert(ht, "k100", 100);
+  for (int i = 1; i < 90; ++i) {
+    snprintf(key, sizeof key, "k%d", i);
+    ht_delete(ht, key);
+  }
+  TEST_ASSERT_TRUE(ht->size < 64); // shrunk
+  TEST_ASSERT_EQUAL(ht->itemcount, ht->entrycount);
+  TEST_ASSERT_TRUE(ht->entrycap < 64);
+  assert_in_order(6);
+}
+
+void test_cached_hash(void) {
+  hash_table_item* a = ht_inc(ht, "aaa");
+  TEST_ASSERT_EQUAL_UINT64(ht_hash(ht, "aaa", 3), a->hash);
+  char key[16];
+  for (int i = 0; i < 100; ++i) { // several rehashes
+    snprintf(key, sizeof key, "%d", i);
+    ht_inc(ht, key);
+  }
+  TEST_ASSERT_EQUAL_PTR(a, ht_get(ht, "aaa"));
+  TEST_ASSERT_EQUAL_UINT64(ht_hash(ht, "aaa", 3), a->hash);
+  TEST_ASSERT_EQUAL_PTR(ht_get(ht, "42"),
+                        ht->slots[ht_slot_idx(ht->size, ht_hash(ht, "42", 2))]);
+}
+
+// 12 byte keys that wyhash gives the same hash under every seed: with the
+// first 8 bytes equal to one of its secrets, its final multiply is by 0.
+// Little endian only
+static void collide_key(char key[13], unsigned i) {
+  static const unsigned char secret[8] = {0x93, 0x4b, 0xb8, 0x8b,
+                                          0xc9, 0xac, 0x2e, 0x96};
+  memcpy(key, secret, 8);
+  snprintf(key + 8, 5, "%04x", i & 0xffff);
+}
+
+void test_seed(void) {
+  char key[16];
+  for (int i = 0; i < 100; ++i) {
+    snprintf(key, sizeof key, "%d", i);
+    ht_insert(ht, key, i);
+  }
+  uint64_t unseeded = ht_get(ht, "42")->hash;
+  ht_set_seed(ht, 42);
+  TEST_ASSERT_EQUAL_UINT64(ht_hash_wyhash_seeded("42", 2, 42),
+                           ht_get(ht, "42")->hash);
+  TEST_ASSERT_EQUAL_UINT64(unseeded,
+                           ht_item_hash_bytes(ht, ht_get(ht, "42")));
+  for (int i = 0; i < 100; ++i) {
+    snprintf(key, sizeof key, "%d", i);
+    TEST_ASSERT_EQUAL(i, ht_get(ht, key)->value);
+  }
+  ht_set_seed(ht, 0);
+  TEST_ASSERT_EQUAL_UINT64(unseeded, ht_get(ht, "42")->hash);
+  TEST_ASSERT_TRUE(ht_random_seed() != ht_random_seed());
+}
+
+void test_max_chain(void) {
+  enum { N = 2000 };
+  char  keys[N][13];
+  char* ptrs[N];
+  for (unsigned i = 0; i < N; ++i) {
+    collide_key(keys[i], i);
+    ptrs[i] = keys[i];
+  }
+  ht_set_seed(ht, ht_random_seed());
+  for (unsigned i = 0; i < 100; ++i) ht_insert(ht, keys[i], (int)i);
+  hash_table_stats stats;
+  ht_stats(ht, &stats);
+  TEST_ASSERT_EQUAL(100, stats.max_chain); // one chain, seeded or not
+
+  for (int incremental = 0; incremental < 2; ++incremental) {
+    hash_table* table = ht_create(4);
+    ht_set_incremental(table, incremental);
+    ht_set_max_chain(table, 16);
+    for (unsigned i = 0; i < N / 2; ++i) ht_insert(table, keys[i], (int)i);
+    TEST_ASSERT_TRUE(table->sip);
+    TEST_ASSERT_EQUAL(1, table->reseeds);
+    // and stays on SipHash
+    ht_inc_batch(table, ptrs, NULL, N, NULL);
+    TEST_ASSERT_EQUAL(N, table->itemcount);
+    for (unsigned i = 0; i < N; ++i)
+      TEST_ASSERT_EQUAL(i < N / 2 ? (int)i + 1 : 1,
+                        ht_get(table, keys[i])->value);
+    ht_stats(table, &stats);
+    TEST_ASSERT_TRUE(stats.max_chain < 16);
+    TEST_ASSERT_EQUAL(1, table->reseeds);
+    ht_free(table);
+
+    // moved in the middle of a batch
+    table = ht_create(4);
+    ht_set_incremental(table, incremental);
+    ht_set_max_chain(table, 16);
+    ht_inc_batch(table, ptrs, NULL, N, NULL);
+    ht_inc_batch(table, ptrs, NULL, N, NULL);
+    TEST_ASSERT_EQUAL(1, table->reseeds);
+    TEST_ASSERT_EQUAL(N, table->itemcount);
+    for (unsigned i = 0; i < N; ++i)
+      TEST_ASSERT_EQUAL(2, ht_get(table, keys[i])->value);
+    ht_free(table);
+  }
+}
+
+static size_t count_iter(const hash_table* table) {
+  hash_table_iterator* iter  = ht_create_iter(table);
+  size_t               count = 0;
+  while (ht_iter_current(iter)) {
+    ht_iter_next(iter);
+    ++count;
+  }
+  ht_free_iter(iter);
+  return count;
+}
+
+void test_incremental(void) {
+  ht_set_incremental(ht, true);
+  char key[16];
+  bool seen_migration = false;
+  for (int i = 0; i < 1000; ++i) {
+    snprintf(key, sizeof key, "%d", i);
+    ht_insert(ht, key, i);
+    if (ht->old_slots) {
+      seen_migration = true;
+      TEST_ASSERT_EQUAL(ht->size / 2, ht->old_size);
+      TEST_ASSERT_EQUAL(ht->itemcount, count_iter(ht));
+      hash_table_item** view = ht_create_flat_view(ht);
+      for (size_t j = 0; j < ht->itemcount; ++j) TEST_ASSERT_NOT_NULL(view[j]);
+      free(view);
+    }
+    for (int j = 0; j <= i; j += 97) { // all keys so far are findable
+      snprintf(key, sizeof key, "%d", j);
+      TEST_ASSERT_NOT_NULL(ht_get(ht, key));
+    }
+  }
+  TEST_ASSERT_TRUE(seen_migration);
+  TEST_ASSERT_EQUAL(1000, ht->itemcount);
+  TEST_ASSERT_EQUAL(1000, count_iter(ht));
+
+  seen_migration = false;
+  for (int i = 0; i < 990; ++i) {
+    snprintf(key, sizeof key, "%d", i);
+    ht_delete(ht, key);
+    TEST_ASSERT_NULL(ht_get(ht, key));
+    if (ht->old_slots) seen_migration = true;
+  }
+  TEST_ASSERT_TRUE(seen_migration);
+  TEST_ASSERT_EQUAL(10, ht->itemcount);
+  TEST_ASSERT_EQUAL(10, count_iter(ht));
+  for (int i = 990; i < 1000; ++i) {
+    snprintf(key, sizeof key, "%d", i);
+    TEST_ASSERT_EQUAL(i, ht_get(ht, key)->value);
+  }
+
+  // switching off completes any migration
+  ht_insert(ht, "more", 1);
+  ht_set_incremental(ht, false);
+  TEST_ASSERT_NULL(ht->old_slots);
+  TEST_ASSERT_EQUAL(0, ht->old_size);
+}
+
+void test_length_delimited(void) {
+  const char* text = "the cat sat";
+  ht_inc_n(ht, text, 3);     // "the"
+  ht_inc_n(ht, text + 4, 3); // "cat"
+  ht_inc_n(ht, text + 8, 3); // "sat"
+  ht_inc_n(ht, text + 5, 2); // "at"
+  ht_inc_n(ht, text + 9, 2); // "at" again
+  TEST_ASSERT_EQUAL(4, ht->itemcount);
+  TEST_ASSERT_EQUAL(2, ht_get(ht, "at")->value);
+  hash_table_item* cat = ht_get_n(ht, "cats", 3);
+  TEST_ASSERT_NOT_NULL(cat);
+  TEST_ASSERT_EQUAL(3, cat->keylen);
+  TEST_ASSERT_EQUAL(0, strcmp("cat", cat->key)); // stored NUL terminated
+  TEST_ASSERT_NULL(ht_get_n(ht, "cats", 4));
+  TEST_ASSERT_NULL(ht_get_n(ht, "ca", 2));
+
+  // embedded NULs are part of the key
+  ht_insert_n(ht, "a\0b", 3, 7);
+  TEST_ASSERT_EQUAL(7, ht_get_n(ht, "a\0b", 3)->value);
+  TEST_ASSERT_NULL(ht_get_n(ht, "a\0c", 3));
+  ht_delete_n(ht, "the", 3);
+  TEST_ASSERT_NULL(ht_get(ht, "the"));
+  TEST_ASSERT_EQUAL(-1, ht_dec_n(ht, "dog", 3)->value);
+}
+
+void test_prehashed(void) {
+  const char* words[] = {"the", "cat", "sat", "on", "the", "mat"};
+  for (int seeded = 0; seeded < 2; ++seeded) {
+    hash_table* table = ht_create(4);
+    if (seeded) ht_set_seed(table, 42);
+    for (int i = 0; i < 6; ++i) {
+      size_t len = strlen(words[i]);
+      ht_inc_h(table, words[i], len, ht_hash_bytes(words[i], len));
+    }
+    TEST_ASSERT_EQUAL(5, table->itemcount);
+    TEST_ASSERT_EQUAL(2, ht_get(table, "the")->value);
+    TEST_ASSERT_EQUAL(2, ht_get_h(table, "the", 3, ht_hash_bytes("the", 3))
+                             ->value);
+    ht_insert_h(table, "dog", 3, ht_hash_bytes("dog", 3), 7);
+    TEST_ASSERT_EQUAL(7, ht_get(table, "dog")->value);
+    TEST_ASSERT_EQUAL(6, ht_dec_h(table, "dog", 3, ht_hash_bytes("dog", 3))
+                             ->value);
+    ht_delete_h(table, "cat", 3, ht_hash_bytes("cat", 3));
+    TEST_ASSERT_NULL(ht_get(table, "cat"));
+    TEST_ASSERT_NULL(ht_get_h(table, "cat", 3, ht_hash_bytes("cat", 3)));
+    ht_free(table);
+  }
+}
+
+void test_hash_functions(void) {
+  // FNV-1a reference values
+  TEST_ASSERT_EQUAL_UINT64(0xcbf29ce484222325, ht_hash_fnv1a("", 0));
+  TEST_ASSERT_EQUAL_UINT64(0xaf63dc4c8601ec8c, ht_hash_fnv1a("a", 1));
+
+  // wyhash reads words at a time: every length path must see every byte
+  char buf[100];
+  for (size_t len = 1; len < sizeof buf; ++len) {
+    memset(buf, 'x', len);
+    uint64_t h = ht_hash_wyhash(buf, len);
+    for (size_t i = 0; i < len; ++i) {
+      buf[i] = 'y';
+      TEST_ASSERT_TRUE(h != ht_hash_wyhash(buf, len));
+      buf[i] = 'x';
+    }
+    TEST_ASSERT_EQUAL_UINT64(h, ht_hash_wyhash(buf, len));
+    TEST_ASSERT_TRUE(h != ht_hash_wyhash(buf, len - 1));
+    TEST_ASSERT_EQUAL_UINT64(h, ht_hash_wyhash_seeded(buf, len, 0));
+    TEST_ASSERT_TRUE(h != ht_hash_wyhash_seeded(buf, len, 1));
+  }
+
+  // SipHash-2-4 reference values, key 00 01 .. 0f, message 00 01 ..
+  for (size_t i = 0; i < sizeof buf; ++i) buf[i] = (char)i;
+  uint64_t k0 = 0x0706050403020100, k1 = 0x0f0e0d0c0b0a0908;
+  TEST_ASSERT_EQUAL_UINT64(0x726fdb47dd0e0e31, ht_hash_siphash(buf, 0, k0, k1));
+  TEST_ASSERT_EQUAL_UINT64(0x74f839c593dc67fd, ht_hash_siphash(buf, 1, k0, k1));
+  TEST_ASSERT_EQUAL_UINT64(0x93f5f5799a932462, ht_hash_siphash(buf, 8, k0, k1));
+  TEST_ASSERT_EQUAL_UINT64(0xa129ca6149be45e5,
+                           ht_hash_siphash(buf, 15, k0, k1));
+}
+
+void test_inline_keys(void) {
+  char longest[HT_INLINE_KEY]; // longest inline key, with its terminator
+  memset(longest, 'i', sizeof longest - 1);
+  longest[sizeof longest - 1] = '\0';
+  char shortest[HT_INLINE_KEY + 1]; // shortest out of line key
+  memset(shortest, 'o', sizeof shortest - 1);
+  shortest[sizeof shortest - 1] = '\0';
+
+  hash_table_item* a = ht_inc(ht, "aaa");
+  hash_table_item* i = ht_inc(ht, longest);
+  hash_table_item* o = ht_inc(ht, shortest);
+  TEST_ASSERT_EQUAL_PTR(a->inline_key, a->key);
+  TEST_ASSERT_EQUAL_PTR(i->inline_key, i->key);
+  TEST_ASSERT_TRUE(o->key != o->inline_key);
+  TEST_ASSERT_EQUAL(0, strcmp(longest, i->key));
+  TEST_ASSERT_EQUAL(0, strcmp(shortest, o->key));
+  TEST_ASSERT_EQUAL_PTR(i, ht_get(ht, longest));
+  TEST_ASSERT_EQUAL_PTR(o, ht_get(ht, shortest));
+
+  hash_table_item** view  = ht_create_flat_view(ht);
+  int               found = 0;
+  for (size_t j = 0; j < ht->itemcount; ++j) {
+    found |= strcmp("aaa", view[j]->key) == 0;
+    found |= (strcmp(longest, view[j]->key) == 0) << 1;
+    found |= (strcmp(shortest, view[j]->key) == 0) << 2;
+  }
+  TEST_ASSERT_EQUAL(7, found);
+  free(view);
+
+  ht_delete(ht, longest);
+  ht_delete(ht, shortest);
+  TEST_ASSERT_EQUAL(1, ht->itemcount);
+}
+
+void test_pooled(void) {
+  hash_table* pt = ht_create_pooled(4);
+  char        key[16];
+  for (int i = 0; i < 10000; ++i) {
+    snprintf(key, sizeof key, "%d", i);
+    ht_insert(pt, key, i);
+  }
+  TEST_ASSERT_EQUAL(10000, pt->itemcount);
+  hash_table_item* item = ht_get(pt, "1234");
+  TEST_ASSERT_NOT_NULL(item);
+  TEST_ASSERT_EQUAL(1234, item->value);
+
+  // deleted items are reused for the next insert
+  ht_delete(pt, "1234");
+  TEST_ASSERT_NULL(ht_get(pt, "1234"));
+  TEST_ASSERT_EQUAL_PTR(item, ht_insert(pt, "new", 1));
+  TEST_ASSERT_EQUAL(0, strcmp("new", item->key));
+
+  // keys larger than a page
+  char* big = malloc(HT_POOL_PAGE_SIZE + 1);
+  memset(big, 'x', HT_POOL_PAGE_SIZE);
+  big[HT_POOL_PAGE_SIZE] = '\0';
+  ht_inc(pt, big);
+  ht_inc(pt, "after big");
+  TEST_ASSERT_EQUAL(1, ht_get(pt, big)->value);
+  TEST_ASSERT_EQUAL(1, ht_get(pt, "after big")->value);
+  free(big);
+
+  for (int i = 0; i < 10000; ++i) {
+    snprintf(key, sizeof key, "%d", i);
+    item = ht_get(pt, key);
+    if (i == 1234) {
+      TEST_ASSERT_NULL(item);
+    } else {
+      TEST_ASSERT_NOT_NULL(item);
+      TEST_ASSERT_EQUAL(i, item->value);
+    }
+  }
+  ht_free(pt);
+}
+
+// highest value first
+static int cmp_values(const void* a, const void* b) {
+  int a_val = (*(hash_table_item**)a)->value;
+  int b_val = (*(hash_table_item**)b)->value;
+  return a_val == b_val ? 0 : a_val < b_val ? 1 : -1;
+}
+
+void test_top_k(void) {
+  char key[16];
+  for (int i = 0; i < 1000; ++i) {
+    snprintf(key, sizeof key, "%d", i);
+    ht_insert(ht, key, (i * 7919) % 1000); // values 0..999, scrambled
+  }
+
+  size_t            count;
+  hash_table_item** top = ht_top_k(ht, 5, cmp_values, &count);
+  TEST_ASSERT_EQUAL(5, count);
+  for (size_t i = 0; i < count; ++i) TEST_ASSERT_EQUAL(999 - i, top[i]->value);
+  free(top);
+
+  top = ht_top_k(ht, 0, cmp_values, &count);
+  TEST_ASSERT_EQUAL(0, count);
+  free(top);
+
+  top = ht_top_k(ht, 5000, cmp_values, &count); // more than there are
+  TEST_ASSERT_EQUAL(1000, count);
+  for (size_t i = 0; i < count; ++i) TEST_ASSERT_EQUAL(999 - i, top[i]->value);
+  free(top);
+
+  for (size_t threads = 1; threads <= 16; threads *= 4) {
+    top = ht_top_k_parallel(ht, 20, cmp_values, threads, &count);
+    TEST_ASSERT_EQUAL(20, count);
+    for (size_t i = 0; i < count; ++i)
+      TEST_ASSERT_EQUAL(999 - i, top[i]->value);
+    free(top);
+  }
+
+  // all items are seen while a resize is in progress
+  ht_set_incremental(ht, true);
+  int i = 1000;
+  for (; !ht->old_slots; ++i) {
+    snprintf(key, sizeof key, "%d", i);
+    ht_insert(ht, key, i);
+  }
+  top = ht_top_k_parallel(ht, 1000, cmp_values, 3, &count);
+  TEST_ASSERT_EQUAL(1000, count);
+  for (size_t j = 0; j < count; ++j)
+    TEST_ASSERT_EQUAL(i - 1 - (int)j, top[j]->value);
+  free(top);
+}
+
+void test_batch(void) {
+  // many repeats, enough keys to resize several times mid batch
+  enum { N = 5000 };
+  char*      keys[N];
+  size_t     lens[N];
+  ht_value_t values[N];
+  for (int i = 0; i < N; ++i) {
+    keys[i] = malloc(16);
+    snprintf(keys[i], 16, "k%dx", (i * 37) % 1500);
+    lens[i]   = strlen(keys[i]) - 1; // without the x
+    values[i] = i;
+  }
+
+  for (int incremental = 0; incremental < 2; ++incremental) {
+    hash_table* batch  = ht_create(4);
+    hash_table* scalar = ht_create(4);
+    ht_set_incremental(batch, incremental);
+    ht_set_incremental(scalar, incremental);
+
+    hash_table_item* items[N];
+    ht_inc_batch(batch, keys, lens, N, items);
+    for (int i = 0; i < N; ++i) {
+      hash_table_item* item = ht_inc_n(scalar, keys[i], lens[i]);
+      TEST_ASSERT_EQUAL(item->keylen, items[i]->keylen);
+      TEST_ASSERT_EQUAL(0, memcmp(item->key, items[i]->key, lens[i]));
+    }
+    TEST_ASSERT_EQUAL(scalar->itemcount, batch->itemcount);
+    TEST_ASSERT_EQUAL(scalar->size, batch->size);
+
+    ht_insert_batch(batch, keys, NULL, values, N, NULL); // with the x
+    for (int i = 0; i < N; ++i) ht_insert(scalar, keys[i], values[i]);
+    TEST_ASSERT_EQUAL(scalar->itemcount, batch->itemcount);
+
+    ht_get_batch(batch, keys, lens, N, items);
+    for (int i = 0; i < N; ++i) {
+      hash_table_item* item = ht_get_n(scalar, keys[i], lens[i]);
+      TEST_ASSERT_EQUAL(item->value, items[i]->value);
+    }
+    ht_get_batch(batch, keys, NULL, N, items);
+    for (int i = 0; i < N; ++i)
+      TEST_ASSERT_EQUAL(ht_get(scalar, keys[i])->value, items[i]->value);
+
+    char* missing[2] = {"nope", "k1"};
+    ht_get_batch(batch, missing, NULL, 2, items);
+    TEST_ASSERT_NULL(items[0]);
+    TEST_ASSERT_NOT_NULL(items[1]);
+
+    ht_inc_batch(batch, keys, NULL, 0, NULL); // empty batch
+    ht_free(batch);
+    ht_free(scalar);
+  }
+  for (int i = 0; i < N; ++i) free(keys[i]);
+}
+
+void test_stats(void) {
+  hash_table_stats stats;
+  ht_stats(ht, &stats);
+  TEST_ASSERT_EQUAL(4, stats.slots);
+  TEST_ASSERT_EQUAL(4, stats.empty_slots);
+  TEST_ASSERT_EQUAL(4, stats.chains[0]);
+  TEST_ASSERT_EQUAL(0, stats.rehashes);
+  TEST_ASSERT_EQUAL(0, stats.max_chain);
+
+  char key[64];
+  for (int i = 0; i < 1000; ++i) {
+    snprintf(key, sizeof key, "key%d", i);
+    ht_insert(ht, key, i);
+  }
+  ht_insert(ht, "a key which is much too long to be stored inline", 1);
+  ht_stats(ht, &stats);
+  TEST_ASSERT_EQUAL(1001, stats.itemcount);
+  TEST_ASSERT_EQUAL(ht->size, stats.slots);
+  size_t slots = 0, items = 0;
+  for (size_t len = 0; len < HT_STATS_CHAINS; ++len) {
+    slots += stats.chains[len];
+    items += len * stats.chains[len];
+  }
+  TEST_ASSERT_EQUAL(stats.slots, slots);
+  TEST_ASSERT_EQUAL(1001, items); // no chain reaches the last bucket
+  TEST_ASSERT_EQUAL(stats.chains[0], stats.empty_slots);
+  TEST_ASSERT_TRUE(stats.probes_hit >= 1.0);
+  TEST_ASSERT_TRUE(stats.probes_miss == 1001.0 / (double)ht->size);
+  TEST_ASSERT_EQUAL(9, stats.rehashes); // 4 => 2048
+  TEST_ASSERT_EQUAL(sizeof "a key which is much too long to be stored inline",
+                    stats.key_bytes);
+  TEST_ASSERT_EQUAL(1001 * sizeof(hash_table_item), stats.item_bytes);
+  TEST_ASSERT_EQUAL(ht->size * sizeof(hash_table_item*), stats.slot_bytes);
+
+  // slots not yet migrated count too
+  hash_table* inc = ht_create(4);
+  ht_set_incremental(inc, true);
+  for (int i = 0; !inc->old_slots; ++i) {
+    snprintf(key, sizeof key, "key%d", i);
+    ht_insert(inc, key, i);
+  }
+  ht_stats(inc, &stats);
+  TEST_ASSERT_EQUAL(inc->size + inc->old_size - inc->migrated, stats.slots);
+  TEST_ASSERT_EQUAL(inc->itemcount, stats.itemcount);
+  ht_free(inc);
+
+  hash_table* pooled = ht_create_pooled(4);
+  ht_insert(pooled, "a key which is much too long to be stored inline", 1);
+  ht_stats(pooled, &stats);
+  TEST_ASSERT_TRUE(stats.item_bytes >= HT_POOL_PAGE_SIZE / 2);
+  TEST_ASSERT_TRUE(stats.key_bytes >= HT_POOL_PAGE_SIZE);
+  ht_free(pooled);
+}
+
+void test_policy(void) {
+  TEST_ASSERT_EQUAL(3, ht->grow_at);
+  TEST_ASSERT_EQUAL(0, ht->shrink_at); // min size
+
+  ht_policy policy = HT_POLICY_DEFAULT;
+  policy.min_load  = 0.5; // would shrink right after growing
+  TEST_ASSERT_FALSE(ht_set_policy(ht, policy));
+  policy.min_load = 0.2;
+  policy.growth   = 3;
+  TEST_ASSERT_FALSE(ht_set_policy(ht, policy));
+  policy.growth   = 4;
+  policy.max_load = 0;
+  TEST_ASSERT_FALSE(ht_set_policy(ht, policy));
+  TEST_ASSERT_EQUAL(2, ht->policy.growth); // unchanged
+
+  policy.max_load  = 2.0;
+  policy.no_shrink = true;
+  TEST_ASSERT_TRUE(ht_set_policy(ht, policy));
+  TEST_ASSERT_EQUAL(8, ht->grow_at);
+  char key[32];
+  for (int i = 0; i < 9; ++i) {
+    snprintf(key, sizeof key, "key%d", i);
+    ht_insert(ht, key, i);
+  }
+  TEST_ASSERT_EQUAL(16, ht->size); // grew by 4 at load > 2
+  for (int i = 0; i < 9; ++i) {
+    snprintf(key, sizeof key, "key%d", i);
+    ht_delete(ht, key);
+  }
+  TEST_ASSERT_EQUAL(16, ht->size); // no_shrink
+
+  // reserve, then fill without growing
+  hash_table* reserved = ht_create(4);
+  ht_reserve(reserved, 1000);
+  TEST_ASSERT_EQUAL(2048, reserved->size);
+  size_t rehashes = reserved->rehashes;
+  for (int i = 0; i < 1000; ++i) {
+    snprintf(key, sizeof key, "key%d", i);
+    ht_insert(reserved, key, i);
+  }
+  TEST_ASSERT_EQUAL(rehashes, reserved->rehashes);
+  TEST_ASSERT_EQUAL(2048, reserved->size);
+  ht_reserve(reserved, 10); // never shrinks
+  TEST_ASSERT_EQUAL(2048, reserved->size);
+  ht_free(reserved);
+}
+
+void test_build_from_arrays(void) {
+  enum { N = 3000 };
+  char*      keys[N];
+  ht_value_t values[N];
+  for (int i = 0; i < N; ++i) {
+    keys[i] = malloc(16);
+    snprintf(keys[i], 16, "k%d", i % 2500); // last 500 are duplicates
+    values[i] = i;
+  }
+  hash_table* built = ht_build_from_arrays(keys, NULL, values, N);
+  TEST_ASSERT_EQUAL(2500, built->itemcount);
+  TEST_ASSERT_EQUAL(0, built->rehashes);
+  TEST_ASSERT_EQUAL(4096, built->size);
+  TEST_ASSERT_EQUAL(2500, ht_get(built, "k0")->value); // last wins
+  TEST_ASSERT_EQUAL(2499, ht_get(built, "k2499")->value);
+  ht_free(built);
+
+  built = ht_build_from_arrays(keys, NULL, values, 0);
+  TEST_ASSERT_EQUAL(0, built->itemcount);
+  ht_free(built);
+  for (int i = 0; i < N; ++i) free(keys[i]);
+}
+
 int main(void) {
   UNITY_BEGIN();
   RUN_TEST(test_pow2);
@@ -161,5 +748,20 @@ int main(void) {
   RUN_TEST(test_grow_shrink);
   RUN_TEST(test_flat_view);
   RUN_TEST(test_iter);
+  RUN_TEST(test_entries);
+  RUN_TEST(test_cached_hash);
+  RUN_TEST(test_seed);
+  RUN_TEST(test_max_chain);
+  RUN_TEST(test_incremental);
+  RUN_TEST(test_length_delimited);
+  RUN_TEST(test_prehashed);
+  RUN_TEST(test_hash_functions);
+  RUN_TEST(test_inline_keys);
+  RUN_TEST(test_pooled);
+  RUN_TEST(test_top_k);
+  RUN_TEST(test_batch);
+  RUN_TEST(test_stats);
+  RUN_TEST(test_policy);
+  RUN_TEST(test_build_from_arrays);
   return UNITY_END();
 }
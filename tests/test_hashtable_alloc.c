@@ -0,0 +1,150 @@
+#include "hashtable_alloc.c"
+#include "hashtable_alloc.h"
+#include "unity.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// counts what goes through it, and checks free gets the size back
+typedef struct counted counted;
+struct counted {
+  size_t allocs;
+  size_t frees;
+  size_t bytes; // outstanding
+};
+
+static void* counted_alloc(void* ctx, size_t size, bool zero) {
+  counted* c = ctx;
+  size_t*  p = zero ? calloc(1, size + sizeof(size_t))
+                    : malloc(size + sizeof(size_t));
+  if (!p) return NULL;
+  *p = size;
+  c->allocs++;
+  c->bytes += size;
+  return p + 1;
+}
+
+static void counted_free(void* ctx, void* ptr, size_t size) {
+  counted* c = ctx;
+  size_t*  p = (size_t*)ptr - 1;
+  TEST_ASSERT_EQUAL(*p, size);
+  c->frees++;
+  c->bytes -= size;
+  free(p);
+}
+
+static counted      counts;
+static ht_allocator counting = {counted_alloc, counted_free, &counts};
+
+void setUp(void) { counts = (counted){0}; }
+
+void tearDown(void) { ht_set_default_allocator(NULL); }
+
+// inserts short and long keys, through a resize, and deletes some
+static void fill(hash_table* ht) {
+  char key[64];
+  for (int i = 0; i < 2000; ++i) {
+    snprintf(key, sizeof key, i % 3 ? "%d" : "a key longer than inline %d", i);
+    ht_insert(ht, key, i);
+  }
+  for (int i = 0; i < 2000; i += 2) {
+    snprintf(key, sizeof key, i % 3 ? "%d" : "a key longer than inline %d", i);
+    ht_delete(ht, key);
+  }
+  TEST_ASSERT_EQUAL(1000, ht->itemcount);
+  TEST_ASSERT_EQUAL(7, ht_get(ht, "7")->value);
+  TEST_ASSERT_EQUAL(9, ht_get(ht, "a key longer than inline 9")->value);
+}
+
+void test_table_allocator(void) {
+  hash_table* ht = ht_create(4);
+  TEST_ASSERT_TRUE(ht_set_allocator(ht, &counting));
+  TEST_ASSERT_EQUAL(1, counts.allocs); // the slots
+  fill(ht);
+  TEST_ASSERT_TRUE(counts.allocs > 2000);
+  TEST_ASSERT_TRUE(counts.frees > 1000);
+  TEST_ASSERT_FALSE(ht_set_allocator(ht, NULL)); // not empty
+  ht_free(ht);
+  TEST_ASSERT_EQUAL(counts.allocs, counts.frees);
+  TEST_ASSERT_EQUAL(0, counts.bytes);
+
+  // and back to malloc
+  counts = (counted){0};
+  ht     = ht_create(4);
+  TEST_ASSERT_TRUE(ht_set_allocator(ht, &counting));
+  TEST_ASSERT_TRUE(ht_set_allocator(ht, NULL));
+  fill(ht);
+  ht_free(ht);
+  TEST_ASSERT_EQUAL(1, counts.allocs);
+  TEST_ASSERT_EQUAL(0, counts.bytes);
+}
+
+void test_default_allocator(void) {
+  ht_set_default_allocator(&counting);
+  hash_table* ht = ht_create_pooled(4);
+  ht_set_default_allocator(NULL); // only for tables created from now on
+  fill(ht);
+  size_t allocs = counts.allocs;
+  TEST_ASSERT_TRUE(allocs < 30); // slots, entries and whole pages
+  TEST_ASSERT_FALSE(ht_set_allocator(ht, NULL));
+  ht_free(ht);
+  TEST_ASSERT_EQUAL(allocs, counts.frees);
+  TEST_ASSERT_EQUAL(0, counts.bytes);
+
+  ht = ht_create(4);
+  fill(ht);
+  ht_free(ht);
+  TEST_ASSERT_EQUAL(allocs, counts.allocs);
+}
+
+void test_huge(void) {
+  ht_set_default_allocator(&ht_allocator_huge);
+  hash_table* ht = ht_create(1 << 20); // 8 MB of slots
+  TEST_ASSERT_EQUAL(0, (uintptr_t)ht->slots % HT_HUGE_PAGE);
+  fill(ht);
+  ht_reserve(ht, 4 << 20); // unmaps the old slots
+  TEST_ASSERT_EQUAL(0, (uintptr_t)ht->slots % HT_HUGE_PAGE);
+  fill(ht);
+  ht_free(ht);
+
+  char* odd = ht_allocator_huge.alloc(NULL, HT_HUGE_PAGE + 1, false);
+  TEST_ASSERT_NOT_NULL(odd);
+  odd[HT_HUGE_PAGE] = 1; // rounded up to whole huge pages
+  TEST_ASSERT_EQUAL(0, odd[0]);
+  ht_allocator_huge.free(NULL, odd, HT_HUGE_PAGE + 1);
+}
+
+void test_numa(void) {
+  ht_allocator node0 = ht_allocator_numa(0);
+  errno              = 0;
+  void* probe        = node0.alloc(node0.ctx, HT_NUMA_MAP_MIN, true);
+  if (!probe) {
+    // no NUMA support here, or mbind not allowed, so nothing to bind to
+    TEST_ASSERT_TRUE(errno == ENOSYS || errno == EPERM);
+    return;
+  }
+  node0.free(node0.ctx, probe, HT_NUMA_MAP_MIN);
+
+  hash_table* ht = ht_create_pooled(1 << 20);
+  TEST_ASSERT_TRUE(ht_set_allocator(ht, &node0));
+  fill(ht);
+  ht_free(ht);
+
+  ht_allocator none = ht_allocator_numa(HT_NUMA_NODES - 1);
+  errno             = 0;
+  TEST_ASSERT_NULL(none.alloc(none.ctx, HT_HUGE_PAGE, true));
+  TEST_ASSERT_NOT_EQUAL(0, errno);
+  none = ht_allocator_numa(-1);
+  TEST_ASSERT_NULL(none.alloc(none.ctx, HT_HUGE_PAGE, true));
+  TEST_ASSERT_EQUAL(EINVAL, errno);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_table_allocator);
+  RUN_TEST(test_default_allocator);
+  RUN_TEST(test_huge);
+  RUN_TEST(test_numa);
+  return UNITY_END();
+}
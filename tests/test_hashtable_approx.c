@@ -0,0 +1,129 @@
+#include "hashtable_approx.c"
+#include "hashtable_approx.h"
+#include "unity.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static hash_table_approx* approx;
+
+void setUp(void) { approx = ht_ap_create(64 * 1024); }
+
+void tearDown(void) { ht_ap_free(approx); }
+
+// checks the summary heap and index are consistent
+static void assert_summary(void) {
+  for (size_t i = 0; i < approx->count; ++i) {
+    uint32_t c = approx->heap[i];
+    TEST_ASSERT_EQUAL(i, approx->candidates[c].heapidx);
+    if (i > 0)
+      TEST_ASSERT_TRUE(approx->candidates[approx->heap[(i - 1) / 2]].count <=
+                       approx->candidates[c].count);
+    const ht_ap_candidate* cand = &approx->candidates[c];
+    size_t slot = ht_ap_find(approx, cand->hash, cand->key, cand->keylen);
+    TEST_ASSERT_EQUAL(c + 1, approx->index[slot]);
+  }
+}
+
+void test_exact_when_small(void) {
+  // few keys: no sketch collisions to speak of and all are candidates
+  TEST_ASSERT_EQUAL(1, ht_ap_inc(approx, "aaa"));
+  TEST_ASSERT_EQUAL(2, ht_ap_inc(approx, "aaa"));
+  ht_ap_inc(approx, "bbb");
+  for (int i = 0; i < 5; ++i) ht_ap_inc(approx, "ccc");
+  TEST_ASSERT_EQUAL(2, ht_ap_estimate(approx, "aaa", 3));
+  TEST_ASSERT_EQUAL(0, ht_ap_estimate(approx, "ddd", 3));
+  TEST_ASSERT_EQUAL(8, approx->total);
+
+  size_t      count;
+  ht_ap_item* top = ht_ap_top_k(approx, 2, &count);
+  TEST_ASSERT_EQUAL(2, count);
+  TEST_ASSERT_EQUAL_STRING("ccc", top[0].key);
+  TEST_ASSERT_EQUAL(5, top[0].count);
+  TEST_ASSERT_EQUAL_STRING("aaa", top[1].key);
+  TEST_ASSERT_EQUAL(2, top[1].count);
+  free(top);
+
+  top = ht_ap_top_k(approx, 10, &count);
+  TEST_ASSERT_EQUAL(3, count);
+  free(top);
+  assert_summary();
+}
+
+void test_heavy_hitters(void) {
+  // zipf-ish stream over many more keys than candidates: key i is seen
+  // about 20000 / i times, plus a long tail seen once each
+  TEST_ASSERT_TRUE(approx->capacity < 2000);
+  char key[32];
+  size_t truth[21] = {0};
+  for (int round = 0; round < 20; ++round) {
+    for (int i = 1; i <= 1000; ++i) {
+      if (round % i) continue;
+      for (int r = 0; r < 1000 / i; ++r) {
+        snprintf(key, sizeof key, "heavy%d", i);
+        ht_ap_inc(approx, key);
+        if (i <= 20) truth[i]++;
+      }
+    }
+    for (int i = 0; i < 5000; ++i) {
+      snprintf(key, sizeof key, "tail%d_%d", round, i);
+      ht_ap_inc(approx, key);
+    }
+  }
+  assert_summary();
+
+  size_t      count;
+  ht_ap_item* top = ht_ap_top_k(approx, 5, &count);
+  TEST_ASSERT_EQUAL(5, count);
+  double error = ht_ap_error(approx);
+  for (size_t i = 0; i < count; ++i) {
+    snprintf(key, sizeof key, "heavy%zu", i + 1);
+    TEST_ASSERT_EQUAL_STRING(key, top[i].key);
+    TEST_ASSERT_TRUE(top[i].count >= truth[i + 1]); // never under
+    TEST_ASSERT_TRUE(top[i].count <= truth[i + 1] + error);
+  }
+  free(top);
+}
+
+void test_long_keys(void) {
+  const char* a = "a key which is longer than HT_AP_KEY bytes, version a";
+  const char* b = "a key which is longer than HT_AP_KEY bytes, version b";
+  for (int i = 0; i < 3; ++i) ht_ap_inc(approx, a);
+  ht_ap_inc(approx, b);
+  TEST_ASSERT_EQUAL(2, approx->count); // told apart by hash
+  TEST_ASSERT_EQUAL(3, ht_ap_estimate(approx, a, strlen(a)));
+
+  size_t      count;
+  ht_ap_item* top = ht_ap_top_k(approx, 1, &count);
+  TEST_ASSERT_EQUAL(strlen(a), top[0].keylen);
+  TEST_ASSERT_EQUAL(HT_AP_KEY - 1, strlen(top[0].key));
+  TEST_ASSERT_EQUAL(0, strncmp(a, top[0].key, HT_AP_KEY - 1));
+  free(top);
+}
+
+void test_budget(void) {
+  hash_table_approx* big = ht_ap_create(16 * 1024 * 1024);
+  TEST_ASSERT_TRUE(ht_ap_bytes(big) <= 16 * 1024 * 1024 + 1024);
+  TEST_ASSERT_TRUE(ht_ap_bytes(big) >= 8 * 1024 * 1024);
+  char key[32];
+  for (int i = 0; i < 200000; ++i) { // memory never grows
+    snprintf(key, sizeof key, "k%d", i);
+    ht_ap_inc(big, key);
+  }
+  TEST_ASSERT_EQUAL(big->capacity, big->count);
+  ht_ap_free(big);
+
+  hash_table_approx* tiny = ht_ap_create(0); // raised to the minimum
+  TEST_ASSERT_EQUAL(HT_AP_MIN_CANDIDATES, tiny->capacity);
+  TEST_ASSERT_EQUAL(1, ht_ap_inc(tiny, "x"));
+  ht_ap_free(tiny);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_exact_when_small);
+  RUN_TEST(test_heavy_hitters);
+  RUN_TEST(test_long_keys);
+  RUN_TEST(test_budget);
+  return UNITY_END();
+}
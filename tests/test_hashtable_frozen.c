@@ -0,0 +1,127 @@
+#include "hashtable_frozen.c"
+#include "hashtable_frozen.h"
+#include "unity.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static hash_table* ht;
+
+void setUp(void) { ht = ht_create(4); }
+
+void tearDown(void) { ht_free(ht); }
+
+static void fill(size_t count) {
+  char key[40];
+  for (size_t i = 0; i < count; ++i) {
+    // some keys long enough to be out of line in the source table
+    snprintf(key, sizeof key, i % 7 ? "key%zu" : "a rather longer key %zu", i);
+    ht_insert(ht, key, (ht_value_t)i);
+  }
+}
+
+static void assert_all(const hash_table_frozen* frozen, size_t count) {
+  char       key[40];
+  ht_value_t value = -1;
+  TEST_ASSERT_EQUAL(count, ht_fz_itemcount(frozen));
+  for (size_t i = 0; i < count; ++i) {
+    snprintf(key, sizeof key, i % 7 ? "key%zu" : "a rather longer key %zu", i);
+    TEST_ASSERT_TRUE(ht_fz_get(frozen, key, &value));
+    TEST_ASSERT_EQUAL(i, value);
+  }
+}
+
+void test_freeze(void) {
+  fill(1000);
+  hash_table_frozen* frozen = ht_freeze(ht);
+  TEST_ASSERT_NOT_NULL(frozen);
+  TEST_ASSERT_EQUAL(1, frozen->partcount);
+  assert_all(frozen, 1000);
+
+  ht_value_t value = -1;
+  TEST_ASSERT_FALSE(ht_fz_get(frozen, "key1000", &value));
+  TEST_ASSERT_FALSE(ht_fz_get(frozen, "", &value));
+  TEST_ASSERT_FALSE(ht_fz_get_n(frozen, "key10000", 7, &value)); // key1000
+  TEST_ASSERT_TRUE(ht_fz_get_n(frozen, "key12x", 5, &value));
+  TEST_ASSERT_EQUAL(12, value);
+  ht_fz_free(frozen);
+}
+
+void test_seeded(void) {
+  fill(1000);
+  ht_set_seed(ht, ht_random_seed()); // the frozen table hashes unseeded
+  hash_table_frozen* frozen = ht_freeze(ht);
+  assert_all(frozen, 1000);
+  ht_fz_free(frozen);
+}
+
+void test_minimal(void) {
+  // every entry holds a distinct key, so none is empty
+  fill(5000);
+  hash_table_frozen* frozen = ht_freeze(ht);
+  hash_table*        seen   = ht_create(4);
+  for (size_t e = 0; e < frozen->itemcount; ++e) {
+    const ht_fz_entry* entry = &frozen->entries[e];
+    const char*        key   = ht_fz_entry_key(frozen, entry);
+    TEST_ASSERT_EQUAL(strlen(key), entry->keylen);
+    TEST_ASSERT_EQUAL(ht_get(ht, (char*)key)->value, entry->value);
+    TEST_ASSERT_EQUAL(1, ht_inc_n(seen, key, entry->keylen)->value);
+  }
+  TEST_ASSERT_EQUAL(5000, seen->itemcount);
+  TEST_ASSERT_TRUE(ht_fz_bytes(frozen) < 5000 * 40);
+  ht_free(seen);
+  ht_fz_free(frozen);
+}
+
+void test_parallel(void) {
+  // several partitions, the same result on any number of threads
+  size_t count = 3 * HT_FZ_PART_KEYS;
+  fill(count);
+  hash_table_frozen* single   = ht_freeze(ht);
+  hash_table_frozen* parallel = ht_freeze_parallel(ht, 8);
+  TEST_ASSERT_EQUAL(4, parallel->partcount);
+  assert_all(parallel, count);
+  TEST_ASSERT_EQUAL(0, memcmp(single->entries, parallel->entries,
+                              count * sizeof(ht_fz_entry)));
+  TEST_ASSERT_EQUAL(0, memcmp(single->keys, parallel->keys, single->keybytes));
+  ht_fz_free(parallel);
+  ht_fz_free(single);
+}
+
+void test_empty(void) {
+  hash_table_frozen* frozen = ht_freeze_parallel(ht, 4);
+  TEST_ASSERT_NOT_NULL(frozen);
+  ht_value_t value = -1;
+  TEST_ASSERT_FALSE(ht_fz_get(frozen, "key", &value));
+  TEST_ASSERT_EQUAL(-1, value);
+  ht_fz_free(frozen);
+
+  ht_insert(ht, "one", 1);
+  frozen = ht_freeze(ht);
+  TEST_ASSERT_TRUE(ht_fz_get(frozen, "one", &value));
+  TEST_ASSERT_EQUAL(1, value);
+  TEST_ASSERT_FALSE(ht_fz_get(frozen, "two", &value));
+  ht_fz_free(frozen);
+}
+
+void test_same_hash(void) {
+  // forge a second key with the first's hash
+  ht_insert(ht, "aaa", 1);
+  ht_insert(ht, "bbb", 2);
+  ht_get(ht, "bbb")->hash = ht_get(ht, "aaa")->hash;
+  errno = 0;
+  TEST_ASSERT_NULL(ht_freeze(ht));
+  TEST_ASSERT_EQUAL(EINVAL, errno);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_freeze);
+  RUN_TEST(test_seeded);
+  RUN_TEST(test_minimal);
+  RUN_TEST(test_parallel);
+  RUN_TEST(test_empty);
+  RUN_TEST(test_same_hash);
+  return UNITY_END();
+}
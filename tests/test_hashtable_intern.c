@@ -0,0 +1,100 @@
+#include "hashtable_intern.c"
+#include "hashtable_intern.h"
+#include "unity.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static hash_table_intern* in;
+
+void setUp(void) { in = ht_intern_create(0); }
+
+void tearDown(void) { ht_intern_free(in); }
+
+void test_intern(void) {
+  TEST_ASSERT_EQUAL(HT_INTERN_NONE, ht_intern_find(in, "aaa"));
+  TEST_ASSERT_EQUAL(0, ht_intern(in, "aaa"));
+  TEST_ASSERT_EQUAL(1, ht_intern(in, "bbb"));
+  TEST_ASSERT_EQUAL(0, ht_intern(in, "aaa"));
+  TEST_ASSERT_EQUAL(2, ht_intern_n(in, "aaax", 2)); // "aa"
+  TEST_ASSERT_EQUAL(3, ht_intern(in, ""));
+  TEST_ASSERT_EQUAL(3, ht_intern_n(in, "x", 0));
+  TEST_ASSERT_EQUAL(4, in->count);
+
+  TEST_ASSERT_EQUAL(0, ht_intern_find(in, "aaa"));
+  TEST_ASSERT_EQUAL(2, ht_intern_find_n(in, "aab", 2));
+  TEST_ASSERT_EQUAL(HT_INTERN_NONE, ht_intern_find(in, "a"));
+  TEST_ASSERT_EQUAL_STRING("aaa", ht_key_of(in, 0));
+  TEST_ASSERT_EQUAL_STRING("aa", ht_key_of(in, 2));
+  TEST_ASSERT_EQUAL_STRING("", ht_key_of(in, 3));
+  TEST_ASSERT_EQUAL(2, ht_keylen_of(in, 2));
+  TEST_ASSERT_EQUAL(0, ht_keylen_of(in, 3));
+
+  // one pool, keys back to back
+  TEST_ASSERT_EQUAL(0, memcmp("aaa\0bbb\0aa\0", in->pool, 12));
+  TEST_ASSERT_EQUAL(12, in->poolsize);
+}
+
+void test_grow(void) {
+  enum { N = 100000 };
+  char key[48];
+  for (int i = 0; i < N; ++i) {
+    snprintf(key, sizeof key, i % 3 ? "%d" : "a much longer key, number %d", i);
+    TEST_ASSERT_EQUAL(i, ht_intern(in, key));
+  }
+  TEST_ASSERT_EQUAL(N, in->count);
+  TEST_ASSERT_TRUE(in->count <= in->size / 4 * 3);
+  for (int i = 0; i < N; ++i) {
+    snprintf(key, sizeof key, i % 3 ? "%d" : "a much longer key, number %d", i);
+    TEST_ASSERT_EQUAL(i, ht_intern_find(in, key));
+    TEST_ASSERT_EQUAL(i, ht_intern(in, key)); // ids are stable
+    TEST_ASSERT_EQUAL_STRING(key, ht_key_of(in, i));
+    TEST_ASSERT_EQUAL(strlen(key), ht_keylen_of(in, i));
+  }
+  TEST_ASSERT_EQUAL(N, in->count);
+}
+
+// the use it is for: attributes of keys in arrays indexed by id
+void test_side_arrays(void) {
+  const char* text[] = {"the", "cat", "and", "the", "hat", "and",
+                        "the", "bat", "sat", "on",  "the", "mat"};
+  enum { WORDS = sizeof text / sizeof *text };
+  uint32_t ids[WORDS];
+  for (int i = 0; i < WORDS; ++i) ids[i] = ht_intern(in, text[i]);
+
+  size_t* counts = calloc(in->count, sizeof *counts);
+  for (int i = 0; i < WORDS; ++i) counts[ids[i]]++;
+  TEST_ASSERT_EQUAL(8, in->count);
+  TEST_ASSERT_EQUAL(4, counts[ht_intern_find(in, "the")]);
+  TEST_ASSERT_EQUAL(2, counts[ht_intern_find(in, "and")]);
+  TEST_ASSERT_EQUAL(1, counts[ht_intern_find(in, "mat")]);
+  for (uint32_t id = 0; id < in->count; ++id)
+    TEST_ASSERT_EQUAL(id, ht_intern_find(in, ht_key_of(in, id)));
+  free(counts);
+}
+
+// each table hashes under its own seed, which doesn't change the ids
+void test_seeded(void) {
+  hash_table_intern* other = ht_intern_create(0);
+  TEST_ASSERT_NOT_EQUAL(0, in->seed);
+  TEST_ASSERT_NOT_EQUAL(in->seed, other->seed);
+  char key[16];
+  for (int i = 0; i < 1000; ++i) {
+    snprintf(key, sizeof key, "k%d", i);
+    TEST_ASSERT_EQUAL(ht_intern(in, key), ht_intern(other, key));
+  }
+  uint64_t hash = ht_hash_wyhash_seeded("k7", 2, in->seed);
+  TEST_ASSERT_EQUAL(7, ht_intern_find_slot(in, "k7", 2, hash)->ref - 1);
+  TEST_ASSERT_EQUAL((uint32_t)(hash >> 32),
+                    ht_intern_find_slot(in, "k7", 2, hash)->hash);
+  ht_intern_free(other);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_intern);
+  RUN_TEST(test_grow);
+  RUN_TEST(test_side_arrays);
+  RUN_TEST(test_seeded);
+  return UNITY_END();
+}
@@ -0,0 +1,224 @@
+#include "hashtable_mapped.c"
+#include "hashtable_mapped.h"
+#include "unity.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define KEYS 1000
+
+static hash_table* ht;
+static char        path[] = "/tmp/test_hashtable_mapped_XXXXXX";
+
+void setUp(void) {
+  int fd = mkstemp(path);
+  TEST_ASSERT_TRUE(fd >= 0);
+  close(fd);
+
+  ht = ht_create(4);
+  char key[16];
+  for (int i = 0; i < KEYS; ++i) {
+    snprintf(key, sizeof key, "key%d", i);
+    ht_insert(ht, key, i);
+  }
+}
+
+void tearDown(void) {
+  ht_free(ht);
+  unlink(path);
+  strcpy(path, "/tmp/test_hashtable_mapped_XXXXXX");
+}
+
+static void assert_all(const hash_table_mapped* map) {
+  char       key[16];
+  ht_value_t value = -1;
+  for (int i = 0; i < KEYS; ++i) {
+    snprintf(key, sizeof key, "key%d", i);
+    TEST_ASSERT_TRUE(ht_mp_get(map, key, &value));
+    TEST_ASSERT_EQUAL(i, value);
+  }
+}
+
+void test_save_open(void) {
+  TEST_ASSERT_TRUE(ht_save(ht, path));
+  hash_table_mapped* map = ht_open_mapped(path);
+  TEST_ASSERT_NOT_NULL(map);
+  TEST_ASSERT_NULL(map->table);
+  TEST_ASSERT_EQUAL(KEYS, ht_mp_itemcount(map));
+  TEST_ASSERT_EQUAL(1024, map->header->bucketcount);
+  assert_all(map);
+
+  ht_value_t value = -1;
+  TEST_ASSERT_FALSE(ht_mp_get(map, "missing", &value));
+  TEST_ASSERT_EQUAL(-1, value);
+  TEST_ASSERT_TRUE(ht_mp_get_n(map, "key12x", 5, &value));
+  TEST_ASSERT_EQUAL(12, value);
+  TEST_ASSERT_NULL(map->table); // reads don't promote
+  ht_mp_close(map);
+}
+
+void test_seeded(void) {
+  ht_set_seed(ht, ht_random_seed()); // the snapshot hashes unseeded
+  TEST_ASSERT_TRUE(ht_save(ht, path));
+  hash_table_mapped* map = ht_open_mapped(path);
+  TEST_ASSERT_NOT_NULL(map);
+  assert_all(map);
+  ht_mp_close(map);
+}
+
+void test_promote_on_write(void) {
+  TEST_ASSERT_TRUE(ht_save(ht, path));
+  hash_table_mapped* map = ht_open_mapped(path);
+  TEST_ASSERT_EQUAL(6, ht_mp_inc(map, "key5"));
+  TEST_ASSERT_NOT_NULL(map->table);
+  TEST_ASSERT_NULL(map->header);
+  TEST_ASSERT_EQUAL(1, ht_mp_inc(map, "new"));
+  TEST_ASSERT_EQUAL(KEYS + 1, ht_mp_itemcount(map));
+
+  ht_value_t value;
+  TEST_ASSERT_TRUE(ht_mp_get(map, "key5", &value));
+  TEST_ASSERT_EQUAL(6, value);
+  ht_mp_delete(map, "new");
+  TEST_ASSERT_FALSE(ht_mp_get(map, "new", &value));
+  TEST_ASSERT_EQUAL(5, ht_mp_dec(map, "key5"));
+  ht_mp_insert(map, "key5", 5);
+  assert_all(map);
+  TEST_ASSERT_EQUAL(KEYS, ht_mp_table(map)->itemcount);
+
+  // the file is unchanged
+  hash_table_mapped* again = ht_open_mapped(path);
+  TEST_ASSERT_FALSE(ht_mp_get(again, "new", &value));
+  ht_mp_close(again);
+  ht_mp_close(map);
+}
+
+void test_long_and_empty_keys(void) {
+  char long_key[300];
+  memset(long_key, 'z', sizeof long_key - 1);
+  long_key[sizeof long_key - 1] = '\0';
+  ht_insert(ht, long_key, 300);
+  ht_insert(ht, "", 7);
+  TEST_ASSERT_TRUE(ht_save(ht, path));
+
+  hash_table_mapped* map = ht_open_mapped(path);
+  ht_value_t         value;
+  TEST_ASSERT_TRUE(ht_mp_get(map, long_key, &value));
+  TEST_ASSERT_EQUAL(300, value);
+  TEST_ASSERT_TRUE(ht_mp_get(map, "", &value));
+  TEST_ASSERT_EQUAL(7, value);
+  ht_mp_close(map);
+}
+
+void test_empty_table(void) {
+  hash_table* empty = ht_create(4);
+  TEST_ASSERT_TRUE(ht_save(empty, path));
+  ht_free(empty);
+
+  hash_table_mapped* map = ht_open_mapped(path);
+  TEST_ASSERT_NOT_NULL(map);
+  ht_value_t value;
+  TEST_ASSERT_EQUAL(0, ht_mp_itemcount(map));
+  TEST_ASSERT_FALSE(ht_mp_get(map, "key1", &value));
+  TEST_ASSERT_EQUAL(1, ht_mp_inc(map, "key1"));
+  ht_mp_close(map);
+}
+
+void test_during_incremental_resize(void) {
+  ht_set_incremental(ht, true);
+  char key[16];
+  int  i = KEYS;
+  for (; !ht->old_slots; ++i) {
+    snprintf(key, sizeof key, "key%d", i);
+    ht_insert(ht, key, i);
+  }
+  TEST_ASSERT_TRUE(ht_save(ht, path));
+  hash_table_mapped* map = ht_open_mapped(path);
+  TEST_ASSERT_EQUAL(i, ht_mp_itemcount(map));
+  assert_all(map);
+  ht_mp_close(map);
+}
+
+void test_invalid_files(void) {
+  TEST_ASSERT_NULL(ht_open_mapped("/nonexistent/test_hashtable_mapped"));
+  TEST_ASSERT_EQUAL(ENOENT, errno);
+
+  TEST_ASSERT_NULL(ht_open_mapped(path)); // empty
+  TEST_ASSERT_EQUAL(EINVAL, errno);
+
+  TEST_ASSERT_TRUE(ht_save(ht, path));
+  TEST_ASSERT_EQUAL(0, truncate(path, 1000)); // sections cut short
+  TEST_ASSERT_NULL(ht_open_mapped(path));
+  TEST_ASSERT_EQUAL(EINVAL, errno);
+
+  FILE* fp = fopen(path, "w");
+  fputs("not a snapshot, but long enough for a header....................",
+        fp);
+  fclose(fp);
+  TEST_ASSERT_NULL(ht_open_mapped(path));
+  TEST_ASSERT_EQUAL(EINVAL, errno);
+
+  TEST_ASSERT_FALSE(ht_save(ht, "/nonexistent/test_hashtable_mapped"));
+}
+
+// overwrites a uint64_t of the snapshot at offset
+static void patch(uint64_t offset, uint64_t value) {
+  FILE* fp = fopen(path, "r+b");
+  TEST_ASSERT_NOT_NULL(fp);
+  TEST_ASSERT_EQUAL(0, fseek(fp, (long)offset, SEEK_SET));
+  TEST_ASSERT_EQUAL(1, fwrite(&value, sizeof value, 1, fp));
+  fclose(fp);
+}
+
+void test_corrupt_sections(void) {
+  TEST_ASSERT_TRUE(ht_save(ht, path));
+  hash_table_mapped* map = ht_open_mapped(path);
+  TEST_ASSERT_NOT_NULL(map);
+  uint64_t hash = ht_hash_bytes("key0", 4);
+  size_t   b    = hash & (map->header->bucketcount - 1);
+  uint64_t end  = map->header->buckets_offset + (b + 1) * sizeof(uint64_t);
+  size_t   i    = map->buckets[b];
+  while (map->entries[i].hash != hash) ++i;
+  uint64_t key_offset = map->header->entries_offset + i * sizeof(ht_mp_entry) +
+                        offsetof(ht_mp_entry, key_offset);
+  ht_mp_close(map);
+
+  // a bucket running past the entries
+  patch(end, KEYS + 100);
+  map = ht_open_mapped(path);
+  TEST_ASSERT_NOT_NULL(map);
+  ht_value_t value = -1;
+  errno            = 0;
+  TEST_ASSERT_FALSE(ht_mp_get(map, "key0", &value));
+  TEST_ASSERT_EQUAL(EINVAL, errno);
+  ht_mp_close(map);
+
+  // a key past the end of the keys
+  TEST_ASSERT_TRUE(ht_save(ht, path));
+  patch(key_offset, UINT64_MAX - 2);
+  map = ht_open_mapped(path);
+  TEST_ASSERT_NOT_NULL(map);
+  errno = 0;
+  TEST_ASSERT_FALSE(ht_mp_get(map, "key0", &value));
+  TEST_ASSERT_EQUAL(EINVAL, errno);
+  TEST_ASSERT_TRUE(ht_mp_get(map, "key1", &value));
+  TEST_ASSERT_EQUAL(1, value);
+  // and left out when promoted
+  TEST_ASSERT_EQUAL(KEYS - 1, ht_mp_table(map)->itemcount);
+  TEST_ASSERT_FALSE(ht_mp_get(map, "key0", &value));
+  ht_mp_close(map);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_save_open);
+  RUN_TEST(test_seeded);
+  RUN_TEST(test_promote_on_write);
+  RUN_TEST(test_long_and_empty_keys);
+  RUN_TEST(test_empty_table);
+  RUN_TEST(test_during_incremental_resize);
+  RUN_TEST(test_invalid_files);
+  RUN_TEST(test_corrupt_sections);
+  return UNITY_END();
+}
@@ -0,0 +1,286 @@
+#include "hashtable_oa.c"
+#include "hashtable_oa.h"
+#include "unity.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static hash_table_oa* ht;
+
+void setUp(void) { ht = ht_oa_create(4); }
+
+void tearDown(void) { ht_oa_free(ht); }
+
+void test_round_size(void) {
+  TEST_ASSERT_EQUAL(16, ht_oa_round_size(0));
+  TEST_ASSERT_EQUAL(16, ht_oa_round_size(16));
+  TEST_ASSERT_EQUAL(32, ht_oa_round_size(17));
+  TEST_ASSERT_EQUAL(1024, ht_oa_round_size(768));
+  TEST_ASSERT_EQUAL(16, ht->size);
+}
+
+void test_group_match(void) {
+  int8_t ctrl[HT_OA_GROUP];
+  for (unsigned i = 0; i < HT_OA_GROUP; ++i) ctrl[i] = CTRL_EMPTY;
+  ctrl[0]  = 5;
+  ctrl[3]  = CTRL_DELETED;
+  ctrl[7]  = 5;
+  ctrl[15] = 127;
+  TEST_ASSERT_EQUAL(1U << 0 | 1U << 7, group_match(ctrl, 5));
+  TEST_ASSERT_EQUAL(1U << 15, group_match(ctrl, 127));
+  TEST_ASSERT_EQUAL(0, group_match(ctrl, 0));
+  TEST_ASSERT_EQUAL(0xffffU & ~(1U << 0 | 1U << 3 | 1U << 7 | 1U << 15),
+                    group_match_empty(ctrl));
+  TEST_ASSERT_EQUAL(0xffffU & ~(1U << 0 | 1U << 7 | 1U << 15),
+                    group_match_free(ctrl));
+}
+
+void test_insert_delete(void) {
+  TEST_ASSERT_EQUAL(0, ht->itemcount);
+
+  hash_table_oa_item* item = ht_oa_insert(ht, "aaa", 10);
+  TEST_ASSERT_EQUAL(1, ht->itemcount);
+  TEST_ASSERT_NOT_NULL(item);
+  TEST_ASSERT_EQUAL(10, item->value);
+  item = ht_oa_insert(ht, "aaa", 11); // update
+  TEST_ASSERT_EQUAL(1, ht->itemcount);
+  TEST_ASSERT_EQUAL(11, item->value);
+  ht_oa_delete(ht, "aaa");
+  TEST_ASSERT_NULL(ht_oa_get(ht, "aaa"));
+  TEST_ASSERT_EQUAL(0, ht->itemcount);
+
+  ht_oa_insert(ht, "bbb", 10);
+  ht_oa_insert(ht, "jjj", 10);
+  ht_oa_insert(ht, "rrr", 10);
+  TEST_ASSERT_EQUAL(3, ht->itemcount);
+
+  ht_oa_delete(ht, "jjj");
+  TEST_ASSERT_EQUAL(2, ht->itemcount);
+  TEST_ASSERT_NULL(ht_oa_get(ht, "jjj"));
+  TEST_ASSERT_NOT_NULL(ht_oa_get(ht, "bbb"));
+  TEST_ASSERT_NOT_NULL(ht_oa_get(ht, "rrr"));
+  ht_oa_delete(ht, "bbb");
+  TEST_ASSERT_EQUAL(1, ht->itemcount);
+  TEST_ASSERT_NULL(ht_oa_get(ht, "bbb"));
+  ht_oa_delete(ht, "rrr");
+  TEST_ASSERT_EQUAL(0, ht->itemcount);
+  TEST_ASSERT_NULL(ht_oa_get(ht, "rrr"));
+  ht_oa_delete(ht, "rrr"); // not there, no-op
+  TEST_ASSERT_EQUAL(0, ht->itemcount);
+}
+
+void test_inc(void) {
+  ht_oa_inc(ht, "aaa");
+  ht_oa_inc(ht, "bbb");
+  ht_oa_inc(ht, "ccc");
+  TEST_ASSERT_EQUAL(3, ht->itemcount);
+
+  ht_oa_inc(ht, "aaa");
+  hash_table_oa_item* a = ht_oa_inc(ht, "aaa");
+  TEST_ASSERT_NOT_NULL(a);
+  TEST_ASSERT_EQUAL(3, a->value);
+
+  hash_table_oa_item* b = ht_oa_inc(ht, "bbb");
+  TEST_ASSERT_EQUAL(2, b->value);
+
+  hash_table_oa_item* c = ht_oa_get(ht, "ccc");
+  TEST_ASSERT_NOT_NULL(c);
+  TEST_ASSERT_EQUAL(1, c->value);
+}
+
+void test_dec(void) {
+  ht_oa_dec(ht, "aaa");
+  ht_oa_dec(ht, "aaa");
+  hash_table_oa_item* a = ht_oa_dec(ht, "aaa");
+  TEST_ASSERT_EQUAL(-3, a->value);
+  TEST_ASSERT_EQUAL(1, ht->itemcount);
+}
+
+void test_grow_shrink(void) {
+  char key[16];
+  for (int i = 0; i < 14; ++i) {
+    snprintf(key, sizeof key, "k%d", i);
+    ht_oa_inc(ht, key);
+  }
+  TEST_ASSERT_EQUAL(16, ht->size); // 14/16 is still <= 7/8
+  ht_oa_inc(ht, "k14");            // > 7/8 => grow
+  TEST_ASSERT_EQUAL(15, ht->itemcount);
+  TEST_ASSERT_EQUAL(32, ht->size);
+
+  for (int i = 0; i < 8; ++i) {
+    snprintf(key, sizeof key, "k%d", i);
+    ht_oa_delete(ht, key);
+  }
+  TEST_ASSERT_EQUAL(32, ht->size);
+  ht_oa_delete(ht, "k8"); // down to 6/32 < 20% => shrink
+  TEST_ASSERT_EQUAL(6, ht->itemcount);
+  TEST_ASSERT_EQUAL(16, ht->size);
+  for (int i = 9; i < 15; ++i) {
+    snprintf(key, sizeof key, "k%d", i);
+    TEST_ASSERT_NOT_NULL(ht_oa_get(ht, key));
+    ht_oa_delete(ht, key);
+  }
+  TEST_ASSERT_EQUAL(0, ht->itemcount);
+  TEST_ASSERT_EQUAL(16, ht->size); // min 1 group!
+}
+
+void test_many(void) {
+  // enough keys for many groups, collisions on the 7 bit hash, and
+  // tombstones from the deletes
+  const int n = 20000;
+  char      key[16];
+  for (int i = 0; i < n; ++i) {
+    snprintf(key, sizeof key, "%d", i);
+    ht_oa_insert(ht, key, i);
+    if (i % 3 == 0) ht_oa_inc(ht, key);
+  }
+  TEST_ASSERT_EQUAL(n, ht->itemcount);
+  for (int i = 0; i < n; i += 2) {
+    snprintf(key, sizeof key, "%d", i);
+    ht_oa_delete(ht, key);
+  }
+  TEST_ASSERT_EQUAL(n / 2, ht->itemcount);
+  for (int i = 0; i < n; ++i) {
+    snprintf(key, sizeof key, "%d", i);
+    hash_table_oa_item* item = ht_oa_get(ht, key);
+    if (i % 2 == 0) {
+      TEST_ASSERT_NULL(item);
+    } else {
+      TEST_ASSERT_NOT_NULL(item);
+      TEST_ASSERT_EQUAL(i + (i % 3 == 0), item->value);
+    }
+  }
+}
+
+void test_length_delimited(void) {
+  const char* text = "the cat sat";
+  ht_oa_inc_n(ht, text, 3);     // "the"
+  ht_oa_inc_n(ht, text + 4, 3); // "cat"
+  ht_oa_inc_n(ht, text + 5, 2); // "at"
+  ht_oa_inc_n(ht, text + 9, 2); // "at" again
+  TEST_ASSERT_EQUAL(3, ht->itemcount);
+  TEST_ASSERT_EQUAL(2, ht_oa_get(ht, "at")->value);
+  hash_table_oa_item* cat = ht_oa_get_n(ht, "cats", 3);
+  TEST_ASSERT_NOT_NULL(cat);
+  TEST_ASSERT_EQUAL(3, cat->keylen);
+  TEST_ASSERT_EQUAL(0, strcmp("cat", cat->key)); // stored NUL terminated
+  TEST_ASSERT_NULL(ht_oa_get_n(ht, "cats", 4));
+  ht_oa_insert_n(ht, "a\0b", 3, 7);
+  TEST_ASSERT_EQUAL(7, ht_oa_get_n(ht, "a\0b", 3)->value);
+  ht_oa_delete_n(ht, "the", 3);
+  TEST_ASSERT_NULL(ht_oa_get(ht, "the"));
+  TEST_ASSERT_EQUAL(-1, ht_oa_dec_n(ht, "dog", 3)->value);
+}
+
+void test_flat_view(void) {
+  ht_oa_inc(ht, "aaa");
+  ht_oa_inc(ht, "bbb");
+  ht_oa_inc(ht, "ccc2");
+  hash_table_oa_item** view = ht_oa_create_flat_view(ht);
+
+  // view is in entry order
+  int found = 0;
+  for (size_t i = 0; i < ht->itemcount; ++i) {
+    if (i > 0) TEST_ASSERT_TRUE(view[i - 1] < view[i]);
+    found |= strcmp("aaa", view[i]->key) == 0;
+    found |= (strcmp("bbb", view[i]->key) == 0) << 1;
+    found |= (strcmp("ccc2", view[i]->key) == 0) << 2;
+  }
+  TEST_ASSERT_EQUAL(7, found);
+  free(view);
+}
+
+void test_iter(void) {
+  char keys[3][5] = {"aaa", "bbb4", "ccc2"};
+  for (size_t i = 0; i < 3; ++i) ht_oa_inc(ht, keys[i]);
+
+  hash_table_oa_item** view = ht_oa_create_flat_view(ht);
+  hash_table_oa_iterator* iter = ht_oa_create_iter(ht);
+  size_t                  i    = 0;
+  while (ht_oa_iter_current(iter)) {
+    TEST_ASSERT_EQUAL_PTR(view[i], iter->item);
+    ht_oa_iter_next(iter);
+    ++i;
+  }
+  TEST_ASSERT_EQUAL(3, i);
+  TEST_ASSERT_NULL(ht_oa_iter_next(iter));
+  TEST_ASSERT_EQUAL_PTR(view[0], ht_oa_iter_reset(iter));
+  ht_oa_free_iter(iter);
+  free(view);
+}
+
+void test_insertion_order(void) {
+  char key[16];
+  for (int i = 0; i < 100; ++i) {
+    snprintf(key, sizeof key, "k%d", i);
+    ht_oa_insert(ht, key, i);
+  }
+  for (int i = 0; i < 100; i += 3) {
+    snprintf(key, sizeof key, "k%d", i);
+    ht_oa_delete(ht, key);
+  }
+  ht_oa_delete(ht, "k99"); // the last entry, so no hole
+  TEST_ASSERT_EQUAL(99, ht->entrycount);
+  ht_oa_insert(ht, "k0", 100); // back in, at the end
+  ht_oa_insert(ht, "k1", 101); // update, stays put
+
+  hash_table_oa_iterator* iter = ht_oa_create_iter(ht);
+  int                     last = -1;
+  size_t                  n    = 0;
+  for (hash_table_oa_item* item = ht_oa_iter_current(iter); item;
+       item                     = ht_oa_iter_next(iter), ++n) {
+    int i = item->value == 101 ? 1 : item->value;
+    TEST_ASSERT_TRUE(i > last);
+    TEST_ASSERT_TRUE(i % 3 != 0 || i == 100);
+    last = i;
+  }
+  TEST_ASSERT_EQUAL(ht->itemcount, n);
+  ht_oa_free_iter(iter);
+
+  // compacted in place, in the same order, and still found by key
+  size_t              count = ht->itemcount;
+  hash_table_oa_item* items = ht_oa_items(ht);
+  TEST_ASSERT_EQUAL(count, ht->entrycount);
+  TEST_ASSERT_EQUAL(count, ht->itemcount);
+  TEST_ASSERT_EQUAL_STRING("k1", items[0].key);
+  TEST_ASSERT_EQUAL_STRING("k2", items[1].key);
+  TEST_ASSERT_EQUAL_STRING("k0", items[count - 1].key);
+  for (size_t i = 0; i < count; ++i)
+    TEST_ASSERT_EQUAL_PTR(&items[i], ht_oa_get(ht, items[i].key));
+  TEST_ASSERT_EQUAL_PTR(items, ht_oa_items(ht)); // nothing to do
+}
+
+void test_churn(void) {
+  // insert and delete cycles leave holes, not tombstones, and the holes
+  // must not exhaust the entries
+  char key[16];
+  for (int i = 0; i < 1000; ++i) {
+    snprintf(key, sizeof key, "a%d", i);
+    ht_oa_insert(ht, key, i);
+    snprintf(key, sizeof key, "b%d", i);
+    ht_oa_insert(ht, key, i);
+    snprintf(key, sizeof key, "a%d", i);
+    ht_oa_delete(ht, key);
+    TEST_ASSERT_TRUE(ht->entrycount <= ht->size / 8 * 7);
+  }
+  TEST_ASSERT_EQUAL(1000, ht->itemcount);
+  TEST_ASSERT_NULL(ht_oa_get(ht, "a999"));
+  TEST_ASSERT_EQUAL(999, ht_oa_get(ht, "b999")->value);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_size);
+  RUN_TEST(test_group_match);
+  RUN_TEST(test_insert_delete);
+  RUN_TEST(test_inc);
+  RUN_TEST(test_dec);
+  RUN_TEST(test_grow_shrink);
+  RUN_TEST(test_many);
+  RUN_TEST(test_length_delimited);
+  RUN_TEST(test_flat_view);
+  RUN_TEST(test_iter);
+  RUN_TEST(test_insertion_order);
+  RUN_TEST(test_churn);
+  return UNITY_END();
+}
@@ -0,0 +1,149 @@
+#include "hashtable_rcu.c"
+#include "hashtable_rcu.h"
+#include "unity.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static hash_table_rcu* ht;
+static ht_rcu_reader*  reader;
+
+void setUp(void) {
+  ht     = ht_rcu_create(4);
+  reader = ht_rcu_reader_create(ht);
+}
+
+void tearDown(void) {
+  ht_rcu_reader_free(reader);
+  ht_rcu_free(ht);
+}
+
+void test_insert_get_delete(void) {
+  ht_value_t value = 0;
+  TEST_ASSERT_FALSE(ht_rcu_get(reader, "aaa", &value));
+  ht_rcu_insert(ht, "aaa", 10);
+  TEST_ASSERT_TRUE(ht_rcu_get(reader, "aaa", &value));
+  TEST_ASSERT_EQUAL(10, value);
+  TEST_ASSERT_EQUAL(11, ht_rcu_inc(ht, "aaa"));
+  TEST_ASSERT_EQUAL(10, ht_rcu_dec(ht, "aaa"));
+  TEST_ASSERT_EQUAL(1, ht_rcu_inc_n(ht, "bbbx", 3));
+  TEST_ASSERT_TRUE(ht_rcu_get_n(reader, "bbb", 3, &value));
+  TEST_ASSERT_EQUAL(1, value);
+  TEST_ASSERT_FALSE(ht_rcu_get(reader, "bbbx", &value));
+  TEST_ASSERT_EQUAL(2, ht_rcu_itemcount(ht));
+  ht_rcu_delete(ht, "aaa");
+  TEST_ASSERT_FALSE(ht_rcu_get(reader, "aaa", &value));
+  TEST_ASSERT_EQUAL(1, ht_rcu_itemcount(ht));
+  ht_rcu_delete(ht, "aaa"); // not there, no-op
+  ht_rcu_insert(ht, "aaa", 5); // reuses the tombstone
+  TEST_ASSERT_TRUE(ht_rcu_get(reader, "aaa", &value));
+  TEST_ASSERT_EQUAL(5, value);
+  TEST_ASSERT_EQUAL(0, reader->epoch); // left its read sections
+}
+
+void test_grow(void) {
+  char key[16];
+  for (int i = 0; i < 10000; ++i) {
+    snprintf(key, sizeof key, "%d", i);
+    ht_rcu_insert(ht, key, i);
+  }
+  for (int i = 0; i < 10000; i += 2) {
+    snprintf(key, sizeof key, "%d", i);
+    ht_rcu_delete(ht, key);
+  }
+  TEST_ASSERT_EQUAL(5000, ht_rcu_itemcount(ht));
+  TEST_ASSERT_TRUE(ht->slots->size >= 2 * (ht->itemcount + ht->tombstones));
+  for (int i = 0; i < 10000; ++i) {
+    ht_value_t value;
+    snprintf(key, sizeof key, "%d", i);
+    TEST_ASSERT_EQUAL(i % 2 == 1, ht_rcu_get(reader, key, &value));
+    if (i % 2) TEST_ASSERT_EQUAL(i, value);
+  }
+  // nobody in a read section, so at most one batch is waiting
+  TEST_ASSERT_TRUE(ht->retiredcount < HT_RCU_RETIRE_BATCH);
+}
+
+void test_read_section(void) {
+  ht_rcu_insert(ht, "aaa", 1);
+  ht_rcu_read_lock(reader);
+  ht_rcu_read_lock(reader); // nested
+  const ht_rcu_item* item = ht_rcu_find(reader, "aaa", 3);
+  TEST_ASSERT_NOT_NULL(item);
+  ht_rcu_read_unlock(reader);
+  TEST_ASSERT_NOT_EQUAL(0, reader->epoch); // still in the outer one
+
+  // deleted and its slots replaced, but neither freed while the reader is
+  // in the section, however many batches go by
+  ht_rcu_delete(ht, "aaa");
+  char key[16];
+  for (int i = 0; i < 1000; ++i) {
+    snprintf(key, sizeof key, "%d", i);
+    ht_rcu_insert(ht, key, i);
+    ht_rcu_delete(ht, key);
+  }
+  TEST_ASSERT_TRUE(ht->retiredcount > 1000);
+  TEST_ASSERT_EQUAL_STRING("aaa", item->key); // asan would object if freed
+  TEST_ASSERT_EQUAL(1, item->value);
+  ht_rcu_read_unlock(reader);
+
+  ht_rcu_synchronize(ht);
+  TEST_ASSERT_EQUAL(0, ht->retiredcount);
+}
+
+// one writer inserting keys 0.. with value == key, while readers check that
+// every key it has published is found with the right value, through growth
+// and reclamation
+#define READERS 4
+#define KEYS    50000
+
+static _Atomic int published;
+
+static void* read_worker(void* arg) {
+  (void)arg;
+  ht_rcu_reader* r = ht_rcu_reader_create(ht);
+  char           key[16];
+  long           bad = 0;
+  for (unsigned round = 0; atomic_load(&published) < KEYS; ++round) {
+    int        upto = atomic_load(&published);
+    int        i    = upto ? (int)(round * 7919 % (unsigned)upto) : 0;
+    ht_value_t value;
+    snprintf(key, sizeof key, "%d", i);
+    if (upto && (!ht_rcu_get(r, key, &value) || value != i)) bad++;
+    snprintf(key, sizeof key, "d%d", i); // deleted as fast as inserted
+    ht_rcu_get(r, key, &value);
+  }
+  ht_rcu_reader_free(r);
+  return (void*)bad;
+}
+
+void test_concurrent(void) {
+  pthread_t threads[READERS];
+  atomic_store(&published, 0);
+  for (int t = 0; t < READERS; ++t)
+    pthread_create(&threads[t], NULL, read_worker, NULL);
+  char key[16];
+  for (int i = 0; i < KEYS; ++i) {
+    snprintf(key, sizeof key, "%d", i);
+    ht_rcu_insert(ht, key, i);
+    snprintf(key, sizeof key, "d%d", i);
+    ht_rcu_insert(ht, key, i);
+    ht_rcu_delete(ht, key);
+    atomic_store(&published, i + 1);
+  }
+  for (int t = 0; t < READERS; ++t) {
+    void* bad;
+    pthread_join(threads[t], &bad);
+    TEST_ASSERT_EQUAL(0, (long)bad);
+  }
+  TEST_ASSERT_EQUAL(KEYS, ht_rcu_itemcount(ht));
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_insert_get_delete);
+  RUN_TEST(test_grow);
+  RUN_TEST(test_read_section);
+  RUN_TEST(test_concurrent);
+  return UNITY_END();
+}
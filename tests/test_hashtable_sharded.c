@@ -0,0 +1,123 @@
+#include "hashtable_sharded.c"
+#include "hashtable_sharded.h"
+#include "unity.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static hash_table_sharded* ht;
+
+void setUp(void) { ht = ht_sh_create(64, 8); }
+
+void tearDown(void) { ht_sh_free(ht); }
+
+void test_create(void) {
+  TEST_ASSERT_EQUAL(8, ht->shardcount);
+  TEST_ASSERT_EQUAL(61, ht->shardshift);
+  hash_table_sharded* odd = ht_sh_create(0, 5);
+  TEST_ASSERT_EQUAL(8, odd->shardcount);
+  ht_sh_free(odd);
+  hash_table_sharded* one = ht_sh_create(0, 1);
+  TEST_ASSERT_EQUAL(1, one->shardcount);
+  TEST_ASSERT_EQUAL(1, ht_sh_inc(one, "aaa"));
+  ht_sh_free(one);
+}
+
+void test_insert_get_delete(void) {
+  ht_value_t value = 0;
+  TEST_ASSERT_FALSE(ht_sh_get(ht, "aaa", &value));
+  ht_sh_insert(ht, "aaa", 10);
+  TEST_ASSERT_TRUE(ht_sh_get(ht, "aaa", &value));
+  TEST_ASSERT_EQUAL(10, value);
+  TEST_ASSERT_EQUAL(11, ht_sh_inc(ht, "aaa"));
+  TEST_ASSERT_EQUAL(10, ht_sh_dec(ht, "aaa"));
+  TEST_ASSERT_EQUAL(1, ht_sh_inc_n(ht, "bbbx", 3));
+  TEST_ASSERT_TRUE(ht_sh_get_n(ht, "bbb", 3, &value));
+  TEST_ASSERT_EQUAL(1, value);
+  TEST_ASSERT_EQUAL(2, ht_sh_itemcount(ht));
+  ht_sh_delete(ht, "aaa");
+  TEST_ASSERT_FALSE(ht_sh_get(ht, "aaa", &value));
+  TEST_ASSERT_EQUAL(1, ht_sh_itemcount(ht));
+}
+
+// keys spread over all shards
+void test_shards_used(void) {
+  char key[16];
+  for (int i = 0; i < 1000; ++i) {
+    snprintf(key, sizeof key, "%d", i);
+    ht_sh_inc(ht, key);
+  }
+  TEST_ASSERT_EQUAL(1000, ht_sh_itemcount(ht));
+  for (size_t s = 0; s < ht->shardcount; ++s)
+    TEST_ASSERT_GREATER_THAN(50, ht->shards[s].table->itemcount);
+}
+
+#define THREADS 8
+#define KEYS    1000
+#define ROUNDS  50
+
+static void* inc_worker(void* arg) {
+  hash_table_sharded* table = arg;
+  char                key[16];
+  for (int r = 0; r < ROUNDS; ++r) {
+    for (int i = 0; i < KEYS; ++i) {
+      snprintf(key, sizeof key, "%d", i);
+      ht_sh_inc(table, key);
+    }
+  }
+  return NULL;
+}
+
+void test_concurrent_inc(void) {
+  pthread_t threads[THREADS];
+  for (int t = 0; t < THREADS; ++t)
+    pthread_create(&threads[t], NULL, inc_worker, ht);
+  for (int t = 0; t < THREADS; ++t) pthread_join(threads[t], NULL);
+
+  TEST_ASSERT_EQUAL(KEYS, ht_sh_itemcount(ht));
+  char key[16];
+  for (int i = 0; i < KEYS; ++i) {
+    snprintf(key, sizeof key, "%d", i);
+    ht_value_t value = 0;
+    TEST_ASSERT_TRUE(ht_sh_get(ht, key, &value));
+    TEST_ASSERT_EQUAL(THREADS * ROUNDS, value);
+  }
+}
+
+void test_snapshot(void) {
+  ht_sh_insert(ht, "aaa", 1);
+  ht_sh_insert(ht, "bbb", 2);
+  ht_sh_insert(ht, "ccc", 3);
+
+  hash_table_sh_snapshot* snap = ht_sh_create_snapshot(ht);
+  ht_sh_delete(ht, "aaa"); // snapshot owns its keys
+  ht_sh_inc(ht, "bbb");
+
+  TEST_ASSERT_EQUAL(3, snap->itemcount);
+  int sum = 0;
+  for (size_t i = 0; i < snap->itemcount; ++i) {
+    hash_table_sh_entry* e = &snap->entries[i];
+    TEST_ASSERT_EQUAL(3, e->keylen);
+    TEST_ASSERT_EQUAL(e->key[0] - 'a' + 1, e->value);
+    sum += e->value;
+  }
+  TEST_ASSERT_EQUAL(6, sum);
+  ht_sh_free_snapshot(snap);
+
+  hash_table_sharded* empty = ht_sh_create(0, 4);
+  snap                      = ht_sh_create_snapshot(empty);
+  TEST_ASSERT_EQUAL(0, snap->itemcount);
+  ht_sh_free_snapshot(snap);
+  ht_sh_free(empty);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_create);
+  RUN_TEST(test_insert_get_delete);
+  RUN_TEST(test_shards_used);
+  RUN_TEST(test_concurrent_inc);
+  RUN_TEST(test_snapshot);
+  return UNITY_END();
+}
@@ -0,0 +1,267 @@
+#include "hashtable_spill.c"
+#include "hashtable_spill.h"
+#include "unity.h"
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static hash_table_spill* sp;
+static hash_table*       exact; // the same counts, in memory
+
+void setUp(void) {
+  sp    = ht_sp_create(64 * 1024, NULL);
+  exact = ht_create(64);
+}
+
+void tearDown(void) {
+  ht_sp_free(sp);
+  ht_free(exact);
+}
+
+static void count(char* key) {
+  TEST_ASSERT_TRUE(ht_sp_inc(sp, key));
+  ht_inc(exact, key);
+}
+
+// a skewed stream of n keys over about n / 4 distinct ones, some long
+static void count_stream(int n) {
+  char key[64];
+  for (int i = 0; i < n; ++i) {
+    int k = i % 7 == 0 ? i % 13 : i / 4;
+    if (k % 5 == 0)
+      snprintf(key, sizeof key, "a long key beyond HT_INLINE_KEY %d", k);
+    else
+      snprintf(key, sizeof key, "k%d", k);
+    count(key);
+  }
+}
+
+typedef struct checked checked;
+struct checked {
+  size_t   keys;
+  uint64_t total;
+  char     last[64]; // of the partition
+  size_t   lastlen;
+  size_t   part;
+};
+
+// every key is merged once, with its exact count, in key order within a
+// partition
+static void check_merged(void* arg, const char* key, size_t len,
+                         uint64_t count) {
+  checked*         c    = arg;
+  hash_table_item* item = ht_get_n(exact, key, len);
+  TEST_ASSERT_NOT_NULL(item);
+  TEST_ASSERT_EQUAL(item->value, count);
+  TEST_ASSERT_EQUAL(len, strlen(key)); // NUL terminated
+  size_t part = ht_sp_part(exact, item);
+  TEST_ASSERT_TRUE(part >= c->part);
+  if (part == c->part && c->keys)
+    TEST_ASSERT_TRUE(ht_sp_cmp_keys(c->last, c->lastlen, key, len) < 0);
+  memcpy(c->last, key, len);
+  c->lastlen = len;
+  c->part    = part;
+  c->keys++;
+  c->total += count;
+}
+
+static void assert_merge_exact(void) {
+  checked c = {0};
+  TEST_ASSERT_TRUE(ht_sp_merge(sp, check_merged, &c));
+  TEST_ASSERT_EQUAL(exact->itemcount, c.keys);
+  TEST_ASSERT_EQUAL(sp->total, c.total);
+}
+
+void test_in_memory(void) {
+  count("b");
+  count("a");
+  count("b");
+  count("ab");
+  TEST_ASSERT_EQUAL(0, sp->runcount);
+  assert_merge_exact();
+}
+
+void test_spill_and_merge(void) {
+  count_stream(200000);
+  TEST_ASSERT_TRUE(sp->runcount > 5);
+  TEST_ASSERT_TRUE(sp->spilled > 0);
+  TEST_ASSERT_TRUE(ht_sp_bytes(sp) <= sp->budget);
+  assert_merge_exact();
+
+  // counting goes on after a merge, and an explicit spill empties the table
+  count_stream(1000);
+  TEST_ASSERT_TRUE(ht_sp_spill(sp));
+  TEST_ASSERT_EQUAL(0, sp->table->itemcount);
+  assert_merge_exact();
+}
+
+static int by_value(const void* a, const void* b) {
+  int a_val = (*(hash_table_item**)a)->value;
+  int b_val = (*(hash_table_item**)b)->value;
+  return (a_val < b_val) - (a_val > b_val);
+}
+
+// 15 byte keys that wyhash gives the same hash under every seed, see
+// test_max_chain in test_hashtable.c. Little endian only
+static void count_colliding(unsigned from, unsigned to) {
+  static const char secret[8] = "\x93\x4b\xb8\x8b\xc9\xac\x2e\x96";
+  char              key[16];
+  for (unsigned i = from; i < to; ++i) {
+    memcpy(key, secret, 8);
+    snprintf(key + 8, 8, "%07x", i & 0xfffffff);
+    count(key);
+  }
+}
+
+// each run is counted in a table of its own seed, some moved to SipHash,
+// and a key is still merged once, from the same partition of every run
+void test_seeded_runs(void) {
+  TEST_ASSERT_NOT_EQUAL(0, sp->table->seed);
+  for (unsigned run = 0; run < 4; ++run) {
+    count_stream(2000);
+    count_colliding(run * 100, run * 100 + 300);
+    TEST_ASSERT_TRUE(sp->table->sip);
+    uint64_t seed = sp->table->seed;
+    TEST_ASSERT_TRUE(ht_sp_spill(sp));
+    TEST_ASSERT_FALSE(sp->table->sip);
+    TEST_ASSERT_NOT_EQUAL(seed, sp->table->seed);
+  }
+  count_colliding(0, 1000); // and some left in the table
+  TEST_ASSERT_TRUE(sp->runcount >= 4);
+  assert_merge_exact();
+}
+
+void test_top_k(void) {
+  count_stream(100000);
+  TEST_ASSERT_TRUE(sp->runcount > 0);
+
+  size_t            k = 20, count;
+  ht_sp_item*       top = ht_sp_top_k(sp, k, &count);
+  hash_table_item** ref = ht_top_k(exact, k, by_value, &k);
+  TEST_ASSERT_NOT_NULL(top);
+  TEST_ASSERT_EQUAL(k, count);
+  for (size_t i = 0; i < count; ++i) {
+    TEST_ASSERT_EQUAL(ref[i]->value, top[i].count); // ties may differ
+    TEST_ASSERT_EQUAL(top[i].count, ht_get(exact, top[i].key)->value);
+    TEST_ASSERT_EQUAL(strlen(top[i].key), top[i].keylen);
+  }
+  free(ref);
+  ht_sp_free_items(top, count);
+
+  top = ht_sp_top_k(sp, 0, &count);
+  TEST_ASSERT_EQUAL(0, count);
+  ht_sp_free_items(top, count);
+}
+
+void test_files(void) {
+  char dir[4096];
+  strcpy(dir, sp->dir);
+  count_stream(100000);
+  struct stat st;
+  TEST_ASSERT_EQUAL(0, stat(dir, &st));
+  ht_sp_free(sp);
+  TEST_ASSERT_EQUAL(-1, stat(dir, &st)); // removed with the runs
+  sp = ht_sp_create(1024, NULL);
+
+  errno = 0;
+  TEST_ASSERT_NULL(ht_sp_create(1024, "/nonexistent/dir"));
+  TEST_ASSERT_EQUAL(ENOENT, errno);
+}
+
+static size_t run_files(void) {
+  size_t         files = 0;
+  DIR*           d     = opendir(sp->dir);
+  struct dirent* entry;
+  while ((entry = readdir(d)))
+    if (entry->d_name[0] == 'r') files++;
+  closedir(d);
+  return files;
+}
+
+// more runs than the fanin are merged into fewer, pass by pass, so that no
+// merge opens more than fanin files per partition
+void test_cascade(void) {
+  sp->fanin = 2;
+  count_stream(200000);
+  size_t spills = sp->spills;
+  TEST_ASSERT_TRUE(sp->runcount > 4); // two passes at least
+  TEST_ASSERT_EQUAL(spills, sp->runcount);
+  uint64_t spilled = sp->spilled;
+  assert_merge_exact();
+  TEST_ASSERT_TRUE(sp->runcount <= 2);
+  TEST_ASSERT_TRUE(sp->spilled > spilled);
+  TEST_ASSERT_EQUAL(sp->runcount * HT_SP_PARTS, run_files());
+
+  // merged runs merge again with new ones
+  count_stream(20000);
+  spills = sp->spills;
+  TEST_ASSERT_TRUE(ht_sp_spill(sp));
+  TEST_ASSERT_TRUE(ht_sp_spill(sp)); // of an empty table, no run
+  TEST_ASSERT_EQUAL(spills + 1, sp->spills);
+  TEST_ASSERT_TRUE(sp->runcount > 2);
+  assert_merge_exact();
+  TEST_ASSERT_TRUE(sp->runcount <= 2);
+  TEST_ASSERT_EQUAL(sp->runcount * HT_SP_PARTS, run_files());
+}
+
+static void sum_count(void* arg, const char* key, size_t len,
+                      uint64_t count) {
+  TEST_ASSERT_EQUAL_STRING("big", key);
+  TEST_ASSERT_EQUAL(3, len);
+  *(uint64_t*)arg += count;
+}
+
+// a count beyond ht_value_t is written by a merge as several records
+void test_big_count(void) {
+  uint64_t big = 2 * (uint64_t)INT_MAX + 5;
+  char     path[4096];
+  for (size_t r = 0; r < 3; r++) {
+    for (size_t p = 0; p < HT_SP_PARTS; p++) {
+      ht_sp_run_path(sp, sp->nextrun, p, path, sizeof path);
+      ht_sp_writer writer = {sp, fopen(path, "wbe"), true};
+      TEST_ASSERT_NOT_NULL(writer.fp);
+      if (p == 0) ht_sp_write_merged(&writer, "big", 3, big);
+      TEST_ASSERT_TRUE(ht_sp_close_run(writer.fp, writer.ok));
+    }
+    ht_sp_add_run(sp);
+  }
+  sp->fanin      = 2;
+  uint64_t total = 0;
+  TEST_ASSERT_TRUE(ht_sp_merge(sp, sum_count, &total));
+  TEST_ASSERT_EQUAL(2, sp->runcount);
+  TEST_ASSERT_TRUE(3 * big == total);
+}
+
+void test_read_error(void) {
+  count_stream(100000);
+  TEST_ASSERT_TRUE(sp->runcount > 0);
+  char path[4096];
+  ht_sp_run_path(sp, 0, 0, path, sizeof path);
+  FILE* fp = fopen(path, "ab");
+  fputc('x', fp); // a record cut short
+  fputc('\1', fp);
+  fputc('\0', fp);
+  fputc('\0', fp);
+  fputs("1234", fp);
+  fclose(fp);
+  errno = 0;
+  checked c = {0};
+  TEST_ASSERT_FALSE(ht_sp_merge(sp, check_merged, &c));
+  TEST_ASSERT_EQUAL(EIO, errno);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_in_memory);
+  RUN_TEST(test_spill_and_merge);
+  RUN_TEST(test_seeded_runs);
+  RUN_TEST(test_top_k);
+  RUN_TEST(test_files);
+  RUN_TEST(test_cascade);
+  RUN_TEST(test_big_count);
+  RUN_TEST(test_read_error);
+  return UNITY_END();
+}
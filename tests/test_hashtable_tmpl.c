@@ -0,0 +1,134 @@
+#include "unity.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HT_NAME    u64map
+#define HT_KEY_T   uint64_t
+#define HT_VALUE_T uint64_t
+#include "hashtable_tmpl.h"
+
+// non owning string keys, the caller keeps them alive
+#define HT_NAME      strmap
+#define HT_KEY_T     const char*
+#define HT_VALUE_T   int
+#define HT_HASH(key) ht_hash_bytes(key, strlen(key))
+#define HT_EQ(a, b)  (strcmp(a, b) == 0)
+#include "hashtable_tmpl.h"
+
+typedef struct point {
+  int x, y;
+} point;
+
+#define HT_NAME    pointmap
+#define HT_KEY_T   uint32_t
+#define HT_VALUE_T point
+#define HT_NO_ARITH
+#include "hashtable_tmpl.h"
+
+static u64map* ht;
+
+void setUp(void) { ht = u64map_create(4); }
+
+void tearDown(void) { u64map_free(ht); }
+
+void test_insert_delete(void) {
+  TEST_ASSERT_EQUAL(16, ht->size);
+  u64map_item* item = u64map_insert(ht, 42, 10);
+  TEST_ASSERT_EQUAL(1, ht->itemcount);
+  TEST_ASSERT_EQUAL_UINT64(10, item->value);
+  u64map_insert(ht, 42, 11);
+  TEST_ASSERT_EQUAL(1, ht->itemcount);
+  TEST_ASSERT_EQUAL_UINT64(11, u64map_get(ht, 42)->value);
+  TEST_ASSERT_NULL(u64map_get(ht, 43));
+  u64map_delete(ht, 43); // not there, no-op
+  u64map_delete(ht, 42);
+  TEST_ASSERT_NULL(u64map_get(ht, 42));
+  TEST_ASSERT_EQUAL(0, ht->itemcount);
+}
+
+void test_inc_dec(void) {
+  u64map_inc(ht, 7);
+  u64map_inc(ht, 7);
+  TEST_ASSERT_EQUAL_UINT64(2, u64map_get(ht, 7)->value);
+  u64map_dec(ht, 7);
+  TEST_ASSERT_EQUAL_UINT64(1, u64map_get(ht, 7)->value);
+
+  // 64 bit counters don't overflow where int would
+  u64map_insert(ht, 8, (uint64_t)INT32_MAX);
+  u64map_inc(ht, 8);
+  TEST_ASSERT_EQUAL_UINT64((uint64_t)INT32_MAX + 1, u64map_get(ht, 8)->value);
+}
+
+void test_many(void) {
+  // sequential keys, then delete every other one. Exercises growth,
+  // shrinking and the backward shift in delete
+  const uint64_t n = 100000;
+  for (uint64_t i = 0; i < n; ++i) u64map_insert(ht, i, i * 3);
+  TEST_ASSERT_EQUAL(n, ht->itemcount);
+  TEST_ASSERT_TRUE(ht->itemcount * 4 <= ht->size * 3);
+  for (uint64_t i = 0; i < n; i += 2) u64map_delete(ht, i);
+  TEST_ASSERT_EQUAL(n / 2, ht->itemcount);
+  for (uint64_t i = 0; i < n; ++i) {
+    u64map_item* item = u64map_get(ht, i);
+    if (i % 2 == 0) {
+      TEST_ASSERT_NULL(item);
+    } else {
+      TEST_ASSERT_NOT_NULL(item);
+      TEST_ASSERT_EQUAL_UINT64(i * 3, item->value);
+    }
+  }
+  for (uint64_t i = 1; i < n; i += 2) u64map_delete(ht, i);
+  TEST_ASSERT_EQUAL(0, ht->itemcount);
+  TEST_ASSERT_EQUAL(16, ht->size);
+}
+
+void test_iter(void) {
+  for (uint64_t i = 1; i <= 100; ++i) u64map_insert(ht, i, i);
+  size_t       idx   = 0;
+  size_t       count = 0;
+  uint64_t     sum   = 0;
+  u64map_item* item;
+  while ((item = u64map_iter_next(ht, &idx))) {
+    TEST_ASSERT_EQUAL_UINT64(item->key, item->value);
+    sum += item->key;
+    ++count;
+  }
+  TEST_ASSERT_EQUAL(100, count);
+  TEST_ASSERT_EQUAL_UINT64(5050, sum);
+  TEST_ASSERT_NULL(u64map_iter_next(ht, &idx));
+}
+
+void test_string_keys(void) {
+  strmap* sm = strmap_create(0);
+  strmap_inc(sm, "aaa");
+  strmap_inc(sm, "bbb");
+  char aaa[] = "aaa"; // a different pointer, same string
+  strmap_inc(sm, aaa);
+  TEST_ASSERT_EQUAL(2, sm->itemcount);
+  TEST_ASSERT_EQUAL(2, strmap_get(sm, "aaa")->value);
+  strmap_delete(sm, "aaa");
+  TEST_ASSERT_NULL(strmap_get(sm, "aaa"));
+  TEST_ASSERT_EQUAL(1, strmap_get(sm, "bbb")->value);
+  strmap_free(sm);
+}
+
+void test_struct_values(void) {
+  pointmap* pm = pointmap_create(0);
+  pointmap_insert(pm, 1, (point){1, 2});
+  pointmap_get_or_create(pm, 2, (point){3, 4})->value.y++;
+  TEST_ASSERT_EQUAL(2, pointmap_get(pm, 1)->value.y);
+  TEST_ASSERT_EQUAL(5, pointmap_get(pm, 2)->value.y);
+  pointmap_free(pm);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_insert_delete);
+  RUN_TEST(test_inc_dec);
+  RUN_TEST(test_many);
+  RUN_TEST(test_iter);
+  RUN_TEST(test_string_keys);
+  RUN_TEST(test_struct_values);
+  return UNITY_END();
+}
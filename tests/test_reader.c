@@ -0,0 +1,128 @@
+#include "reader.c"
+#include "reader.h"
+#include "unity.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PIPE_BYTES (3 * READER_BUFSIZE + 123)
+
+static char path[] = "/tmp/test_reader_XXXXXX";
+
+void setUp(void) {
+  int fd = mkstemp(path);
+  TEST_ASSERT_TRUE(fd >= 0);
+  TEST_ASSERT_EQUAL(11, write(fd, "hello world", 11));
+  close(fd);
+}
+
+void tearDown(void) {
+  unlink(path);
+  strcpy(path, "/tmp/test_reader_XXXXXX");
+}
+
+void test_mapped_file(void) {
+  reader* r = reader_open(path);
+  TEST_ASSERT_NOT_NULL(r);
+  TEST_ASSERT_FALSE(r->threaded);
+
+  size_t      len   = 0;
+  const char* whole = reader_map(r, &len);
+  TEST_ASSERT_EQUAL(11, len);
+  TEST_ASSERT_EQUAL(0, memcmp(whole, "hello world", 11));
+
+  const char* block = reader_next(r, &len);
+  TEST_ASSERT_EQUAL_PTR(whole, block);
+  TEST_ASSERT_EQUAL(11, len);
+  TEST_ASSERT_NULL(reader_next(r, &len));
+  TEST_ASSERT_NULL(reader_next(r, &len));
+  reader_close(r);
+}
+
+void test_empty_file(void) {
+  TEST_ASSERT_EQUAL(0, truncate(path, 0));
+  reader* r   = reader_open(path);
+  size_t  len = 1;
+  TEST_ASSERT_NOT_NULL(reader_map(r, &len));
+  TEST_ASSERT_EQUAL(0, len);
+  TEST_ASSERT_NULL(reader_next(r, &len));
+  reader_close(r);
+}
+
+void test_missing_file(void) {
+  TEST_ASSERT_NULL(reader_open("/nonexistent/test_reader"));
+}
+
+static void* pipe_writer(void* arg) {
+  int   fd  = *(int*)arg;
+  char* buf = malloc(PIPE_BYTES);
+  for (size_t i = 0; i < PIPE_BYTES; ++i) buf[i] = (char)(i % 251);
+  // several writes, so the reader sees short reads
+  for (size_t done = 0; done < PIPE_BYTES;) {
+    size_t  want = PIPE_BYTES - done < 10000 ? PIPE_BYTES - done : 10000;
+    ssize_t got  = write(fd, buf + done, want);
+    if (got <= 0) break;
+    done += got;
+  }
+  close(fd);
+  free(buf);
+  return NULL;
+}
+
+void test_pipe(void) {
+  int fds[2];
+  TEST_ASSERT_EQUAL(0, pipe(fds));
+  pthread_t writer;
+  pthread_create(&writer, NULL, pipe_writer, &fds[1]);
+
+  reader* r   = reader_open_fd(fds[0], true);
+  size_t  len = 0;
+  TEST_ASSERT_TRUE(r->threaded);
+  TEST_ASSERT_NULL(reader_map(r, &len));
+
+  size_t      total  = 0;
+  size_t      blocks = 0;
+  bool        same   = true;
+  const char* block;
+  while ((block = reader_next(r, &len))) {
+    TEST_ASSERT_TRUE(len > 0 && len <= READER_BUFSIZE);
+    for (size_t i = 0; i < len; ++i)
+      same &= block[i] == (char)((total + i) % 251);
+    total += len;
+    blocks++;
+  }
+  TEST_ASSERT_TRUE(same);
+  TEST_ASSERT_EQUAL(PIPE_BYTES, total);
+  TEST_ASSERT_EQUAL(4, blocks); // blocks are filled, despite short reads
+  TEST_ASSERT_NULL(reader_next(r, &len));
+
+  pthread_join(writer, NULL);
+  reader_close(r);
+}
+
+void test_close_early(void) {
+  signal(SIGPIPE, SIG_IGN);
+  int fds[2];
+  TEST_ASSERT_EQUAL(0, pipe(fds));
+  pthread_t writer;
+  pthread_create(&writer, NULL, pipe_writer, &fds[1]);
+
+  reader* r   = reader_open_fd(fds[0], true);
+  size_t  len = 0;
+  TEST_ASSERT_NOT_NULL(reader_next(r, &len));
+  reader_close(r); // the writer then fails with EPIPE
+  pthread_join(writer, NULL);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_mapped_file);
+  RUN_TEST(test_empty_file);
+  RUN_TEST(test_missing_file);
+  RUN_TEST(test_pipe);
+  RUN_TEST(test_close_early);
+  return UNITY_END();
+}
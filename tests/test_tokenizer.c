@@ -0,0 +1,173 @@
+#include "tokenizer.c"
+#include "tokenizer.h"
+#include "unity.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static hash_table* ht;
+
+void setUp(void) { ht = ht_create(64); }
+
+void tearDown(void) { ht_free(ht); }
+
+static void count(const char* text, bool utf8) {
+  tokenizer tok;
+  tok_init(&tok, utf8);
+  tok_block(&tok, ht, text, strlen(text));
+  tok_finish(&tok, ht);
+  tok_free(&tok);
+}
+
+// the same text, fed in blocks of at most blocksize bytes
+static hash_table* count_blocks(const char* text, size_t blocksize,
+                                bool utf8) {
+  hash_table* table = ht_create(64);
+  tokenizer   tok;
+  tok_init(&tok, utf8);
+  size_t len = strlen(text);
+  for (size_t i = 0; i < len; i += blocksize)
+    tok_block(&tok, table, text + i, len - i < blocksize ? len - i : blocksize);
+  tok_finish(&tok, table);
+  tok_free(&tok);
+  return table;
+}
+
+static int value_of(hash_table* table, const char* key) {
+  hash_table_item* item = ht_get_n(table, key, strlen(key));
+  return item ? item->value : 0;
+}
+
+static void assert_same(hash_table* a, hash_table* b) {
+  TEST_ASSERT_EQUAL(a->itemcount, b->itemcount);
+  hash_table_iterator* iter = ht_create_iter(a);
+  for (hash_table_item* item = ht_iter_current(iter); item;
+       item                  = ht_iter_next(iter))
+    TEST_ASSERT_EQUAL(item->value, value_of(b, item->key));
+  ht_free_iter(iter);
+}
+
+void test_ascii(void) {
+  count("The cat, the HAT and\tthe\nbat. abc1def [x]@y", false);
+  TEST_ASSERT_EQUAL(3, value_of(ht, "the"));
+  TEST_ASSERT_EQUAL(1, value_of(ht, "hat"));
+  TEST_ASSERT_EQUAL(1, value_of(ht, "abc"));
+  TEST_ASSERT_EQUAL(1, value_of(ht, "def"));
+  TEST_ASSERT_EQUAL(1, value_of(ht, "x"));
+  TEST_ASSERT_EQUAL(1, value_of(ht, "y"));
+  TEST_ASSERT_EQUAL(0, value_of(ht, "The"));
+  TEST_ASSERT_EQUAL(9, ht->itemcount);
+}
+
+void test_tolower(void) {
+  TEST_ASSERT_EQUAL('a', tok_tolower('A'));
+  TEST_ASSERT_EQUAL('z', tok_tolower('z'));
+  TEST_ASSERT_EQUAL('1', tok_tolower('1')); // used to become 'Q'
+  TEST_ASSERT_EQUAL('[', tok_tolower('['));
+}
+
+void test_long_words(void) {
+  char text[300];
+  memset(text, 'a', 200);
+  text[100] = 'B';
+  strcpy(text + 200, " end");
+  count(text, false);
+  text[100] = 'b';
+  text[200] = '\0';
+  TEST_ASSERT_EQUAL(1, value_of(ht, text));
+  TEST_ASSERT_EQUAL(1, value_of(ht, "end"));
+}
+
+void test_ascii_mode_splits_utf8(void) {
+  count("caf\xc3\xa9x", false);
+  TEST_ASSERT_EQUAL(1, value_of(ht, "caf"));
+  TEST_ASSERT_EQUAL(1, value_of(ht, "x"));
+  TEST_ASSERT_EQUAL(2, ht->itemcount);
+}
+
+void test_utf8(void) {
+  // Café CAFÉ café — naïve «ΑΒΓ» αβγ Привет привет ÀÉÎ
+  count("Caf\xc3\xa9 CAF\xc3\x89 caf\xc3\xa9 \xe2\x80\x94 na\xc3\xafve "
+        "\xc2\xab\xce\x91\xce\x92\xce\x93\xc2\xbb \xce\xb1\xce\xb2\xce\xb3 "
+        "\xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82 "
+        "\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82 "
+        "\xc3\x80\xc3\x89\xc3\x8e",
+        true);
+  TEST_ASSERT_EQUAL(3, value_of(ht, "caf\xc3\xa9"));
+  TEST_ASSERT_EQUAL(1, value_of(ht, "na\xc3\xafve"));
+  TEST_ASSERT_EQUAL(2, value_of(ht, "\xce\xb1\xce\xb2\xce\xb3"));
+  TEST_ASSERT_EQUAL(
+      2, value_of(ht, "\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82"));
+  TEST_ASSERT_EQUAL(1, value_of(ht, "\xc3\xa0\xc3\xa9\xc3\xae"));
+  TEST_ASSERT_EQUAL(5, ht->itemcount); // no punctuation words
+}
+
+void test_blocks(void) {
+  const char* text = "Hello, World! aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaB "
+                     "caf\xc3\xa9\xe2\x80\x94Na\xc3\x8fve \xc2\xbb" "end";
+  for (int utf8 = 0; utf8 < 2; ++utf8) {
+    hash_table* whole = count_blocks(text, strlen(text), utf8);
+    for (size_t blocksize = 1; blocksize < 40; ++blocksize) {
+      hash_table* split = count_blocks(text, blocksize, utf8);
+      assert_same(whole, split);
+      ht_free(split);
+    }
+    ht_free(whole);
+  }
+}
+
+// whole strides are classified with SIMD, 1 byte blocks only with the scalar
+// classifier
+void test_simd_matches_scalar(void) {
+  srand(1); // fixed seed
+  static const char alphabet[] = "aZq xY.\n\xc3\xa9\xe2\x80\x94\xd0\x9f";
+  char              text[4001];
+  for (size_t i = 0; i < 4000; ++i)
+    text[i] = alphabet[rand() % (sizeof alphabet - 1)];
+  text[4000] = '\0';
+  for (int utf8 = 0; utf8 < 2; ++utf8) {
+    hash_table* simd   = count_blocks(text, 4000, utf8);
+    hash_table* scalar = count_blocks(text, 1, utf8);
+    assert_same(simd, scalar);
+    assert_same(scalar, simd);
+    ht_free(simd);
+    ht_free(scalar);
+  }
+}
+
+static void count_into(void* counter, const char* word, size_t len) {
+  ht_inc_n(counter, word, len);
+}
+
+void test_counter(void) {
+  const char* text = "One two, TWO three three THREE; a much longer word "
+                     "which runs across the strides \xc3\xa9t\xc3\xa9";
+  count(text, true);
+
+  hash_table* counted = ht_create(64);
+  tokenizer   tok;
+  tok_init(&tok, true);
+  tok_set_counter(&tok, count_into, counted);
+  size_t len = strlen(text);
+  for (size_t i = 0; i < len; i += 7) // words split between blocks too
+    tok_block(&tok, NULL, text + i, len - i < 7 ? len - i : 7);
+  tok_finish(&tok, NULL);
+  tok_free(&tok);
+  assert_same(ht, counted);
+  TEST_ASSERT_EQUAL(3, value_of(counted, "three"));
+  TEST_ASSERT_EQUAL(1, value_of(counted, "\xc3\xa9t\xc3\xa9"));
+  ht_free(counted);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_ascii);
+  RUN_TEST(test_tolower);
+  RUN_TEST(test_long_words);
+  RUN_TEST(test_ascii_mode_splits_utf8);
+  RUN_TEST(test_utf8);
+  RUN_TEST(test_blocks);
+  RUN_TEST(test_simd_matches_scalar);
+  RUN_TEST(test_counter);
+  return UNITY_END();
+}
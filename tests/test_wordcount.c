@@ -0,0 +1,161 @@
+#include "wordcount.c"
+#include "wordcount.h"
+#include "unity.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// the partitions of a parallel count into one table. Each word must be in
+// exactly one partition
+static void join_parts(hash_table* table, wc_part* parts, size_t count) {
+  for (size_t p = 0; p < count; ++p) {
+    hash_table_iterator* iter = ht_create_iter(parts[p].table);
+    for (hash_table_item* item = ht_iter_current(iter); item;
+         item                  = ht_iter_next(iter)) {
+      TEST_ASSERT_NULL(ht_get_n(table, item->key, item->keylen));
+      ht_insert_n(table, item->key, item->keylen, item->value);
+    }
+    ht_free_iter(iter);
+  }
+  wc_free_parts(parts, count);
+}
+
+// as topwords -j threadcount
+static hash_table* count_j(const char* text, bool utf8, size_t threadcount,
+                           size_t max_chain) {
+  hash_table* table = ht_create(64);
+  wc_chunk*   chunks =
+      wc_count(text, strlen(text), utf8, threadcount, max_chain);
+  join_parts(table, wc_merge(chunks, threadcount, 10), threadcount);
+  return table;
+}
+
+static int value_of(hash_table* table, const char* key) {
+  hash_table_item* item = ht_get_n(table, key, strlen(key));
+  return item ? item->value : 0;
+}
+
+static void assert_same(hash_table* a, hash_table* b) {
+  TEST_ASSERT_EQUAL(a->itemcount, b->itemcount);
+  hash_table_iterator* iter = ht_create_iter(a);
+  for (hash_table_item* item = ht_iter_current(iter); item;
+       item                  = ht_iter_next(iter))
+    TEST_ASSERT_EQUAL(item->value, value_of(b, item->key));
+  ht_free_iter(iter);
+}
+
+// -j 1 and -j 2 to -j 8 count text the same
+static hash_table* assert_same_j(const char* text, bool utf8,
+                                 size_t max_chain) {
+  hash_table* one = count_j(text, utf8, 1, max_chain);
+  for (size_t threadcount = 2; threadcount <= 8; ++threadcount) {
+    hash_table* many = count_j(text, utf8, threadcount, max_chain);
+    assert_same(one, many);
+    ht_free(many);
+  }
+  return one;
+}
+
+void test_split_words(void) {
+  const char* text = "abcdefghij kl mn";
+  size_t      half = strlen(text) / 2;
+  // -j 2 targets a boundary inside abcdefghij
+  TEST_ASSERT_TRUE(tok_is_letter(text[half - 1]));
+  TEST_ASSERT_TRUE(tok_is_letter(text[half]));
+  wc_chunk* chunks = wc_count(text, strlen(text), false, 2, WC_MAX_CHAIN);
+  TEST_ASSERT_EQUAL(11, chunks[0].end); // after the space
+  TEST_ASSERT_EQUAL(11, chunks[1].start);
+  wc_free_parts(wc_merge(chunks, 2, 10), 2);
+
+  hash_table* one = assert_same_j(text, false, WC_MAX_CHAIN);
+  TEST_ASSERT_EQUAL(3, one->itemcount);
+  TEST_ASSERT_EQUAL(1, value_of(one, "abcdefghij"));
+  ht_free(one);
+
+  // a word longer than a chunk leaves the chunks it covers empty
+  one = assert_same_j("the aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa the a",
+                      false, WC_MAX_CHAIN);
+  TEST_ASSERT_EQUAL(3, one->itemcount);
+  TEST_ASSERT_EQUAL(2, value_of(one, "the"));
+  ht_free(one);
+
+  one = assert_same_j("The cat, the HAT and\tthe\nbat. abc1def [x]@y the",
+                      false, WC_MAX_CHAIN);
+  TEST_ASSERT_EQUAL(4, value_of(one, "the"));
+  TEST_ASSERT_EQUAL(9, one->itemcount);
+  ht_free(one);
+}
+
+void test_split_utf8(void) {
+  const char* text = "ba\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9 \xc3\xb1\xc3\xb1 "
+                     "\xc3\xa9\xc3\xa9 \xc3\xa9\xc3\xa9";
+  size_t      half = strlen(text) / 2;
+  // -j 2 targets a boundary inside an ñ, with -u
+  TEST_ASSERT_EQUAL(0x80, text[half] & 0xc0);
+  wc_chunk* chunks = wc_count(text, strlen(text), true, 2, WC_MAX_CHAIN);
+  TEST_ASSERT_EQUAL(16, chunks[0].end);
+  wc_free_parts(wc_merge(chunks, 2, 10), 2);
+
+  hash_table* one = assert_same_j(text, true, WC_MAX_CHAIN);
+  TEST_ASSERT_EQUAL(3, one->itemcount);
+  TEST_ASSERT_EQUAL(1, value_of(one, "ba\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9"));
+  TEST_ASSERT_EQUAL(1, value_of(one, "\xc3\xb1\xc3\xb1"));
+  TEST_ASSERT_EQUAL(2, value_of(one, "\xc3\xa9\xc3\xa9"));
+  ht_free(one);
+
+  // without -u the non ASCII bytes separate words, wherever the chunks end
+  one = assert_same_j(text, false, WC_MAX_CHAIN);
+  TEST_ASSERT_EQUAL(1, one->itemcount);
+  TEST_ASSERT_EQUAL(1, value_of(one, "ba"));
+  ht_free(one);
+}
+
+// spells i as a 4 letter word
+static char* word_of(char* word, unsigned i) {
+  word[0] = 'w';
+  for (int c = 3; c > 0; --c, i /= 26) word[c] = (char)('a' + i % 26);
+  word[4] = '\0';
+  return word;
+}
+
+void test_sip_chunk(void) {
+  // the first half has many distinct words, so with max_chain 1 its table
+  // moves to SipHash, the second half repeats 2 of them and doesn't. The
+  // words of both must still meet in the same merge partition
+  enum { N = 1000 };
+  char*  text = malloc(N * 5 * 2 + 1);
+  char   word[5];
+  size_t len = 0;
+  for (unsigned i = 0; i < N; ++i)
+    len += sprintf(text + len, "%s ", word_of(word, i));
+  for (unsigned i = 0; i < N; ++i)
+    len += sprintf(text + len, "%s ", word_of(word, i % 2));
+
+  wc_chunk* chunks = wc_count(text, len, false, 2, 1);
+  TEST_ASSERT_TRUE(chunks[0].table->sip);
+  TEST_ASSERT_FALSE(chunks[1].table->sip);
+  TEST_ASSERT_EQUAL(2, chunks[1].table->itemcount);
+  hash_table* two = ht_create(64);
+  join_parts(two, wc_merge(chunks, 2, 10), 2);
+  TEST_ASSERT_EQUAL(N, two->itemcount);
+  TEST_ASSERT_EQUAL(1 + N / 2, value_of(two, "waaa"));
+  TEST_ASSERT_EQUAL(1, value_of(two, "waad"));
+
+  hash_table* one = assert_same_j(text, false, 1);
+  assert_same(one, two);
+  ht_free(one);
+  ht_free(two);
+  free(text);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_split_words);
+  RUN_TEST(test_split_utf8);
+  RUN_TEST(test_sip_chunk);
+  return UNITY_END();
+}